@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2020 Shotaro Uchida <fantom@xmaker.mx>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <quakembd.h>
+#include "display.h"
+
+#define	DEFAULT_DISPLAY_WIDTH 800
+#define	DEFAULT_DISPLAY_HEIGHT 480
+
+static int display_width = DEFAULT_DISPLAY_WIDTH;
+static int display_height = DEFAULT_DISPLAY_HEIGHT;
+
+/* There is no window, frames are only converted into this buffer */
+static uint32_t *buffer;
+
+void display_setmode(int width, int height)
+{
+	display_width = width;
+	display_height = height;
+}
+
+int qembd_get_width()
+{
+	return display_width;
+}
+
+int qembd_get_height()
+{
+	return display_height;
+}
+
+void qembd_vidinit()
+{
+	buffer = malloc(display_width * display_height * sizeof(uint32_t));
+	if (!buffer)
+		qembd_error("Can't allocate display buffer");
+}
+
+void qembd_fillrect(uint8_t *src, uint32_t *clut, uint16_t x, uint16_t y, uint16_t xsize, uint16_t ysize)
+{
+	int offset;
+	int px;
+	int py;
+
+	if (!buffer)
+		return;
+
+	for (py = 0; py < ysize; py++) {
+		offset = (y + py) * display_width + x;
+		for (px = 0; px < xsize; px++) {
+			buffer[offset + px] = clut[src[offset + px]];
+		}
+	}
+}
+
+void qembd_refresh()
+{
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2020 Shotaro Uchida <fantom@xmaker.mx>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <quakembd.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "display.h"
+
+#define MAX_INSTANCES 64
+#define DEFAULT_PORT 26000
+
+uint64_t qembd_get_us_time()
+{
+	struct timespec ts;
+	static time_t secbase;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	if (!secbase) {
+		secbase = ts.tv_sec;
+		return (uint64_t) (ts.tv_nsec / 1000);
+	}
+
+	return ((uint64_t) (ts.tv_sec - secbase) * 1000000) + (ts.tv_nsec / 1000);
+}
+
+void qembd_udelay(uint32_t us)
+{
+	usleep(us);
+}
+
+/*
+ * -instances <n> runs n copies of the program, dedicated servers as a rule,
+ * in processes of their own on consecutive ports from -port, and prints
+ * the CPU time each one used as it exits.  The engine keeps its state in
+ * globals, so instances can't share a process.
+ */
+static int run_instances(int c, char **v, int n)
+{
+	pid_t pids[MAX_INSTANCES];
+	char ports[MAX_INSTANCES][8];
+	char **args;
+	struct rusage ru;
+	pid_t pid;
+	int port = DEFAULT_PORT;
+	int status;
+	int i, j, k;
+
+	if (n > MAX_INSTANCES)
+		n = MAX_INSTANCES;
+
+	/* every instance gets its own -port in place of the one given */
+	args = malloc((c + 3) * sizeof(*args));
+	for (i = 1, k = 0; i < c; i++) {
+		if ((!strcmp(v[i], "-port") || !strcmp(v[i], "-instances")) && i < c - 1) {
+			if (!strcmp(v[i], "-port"))
+				port = atoi(v[i + 1]);
+			i++;
+			continue;
+		}
+		args[++k] = v[i];
+	}
+	args[0] = v[0];
+	args[k + 1] = "-port";
+	args[k + 3] = NULL;
+
+	for (i = 0; i < n; i++) {
+		sprintf(ports[i], "%d", port + i);
+		pids[i] = fork();
+		if (pids[i] == 0) {
+			args[k + 2] = ports[i];
+			exit(qembd_main(k + 3, args));
+		}
+		if (pids[i] == -1)
+			qembd_error("Instance %d could not be started", i);
+	}
+
+	for (j = 0; j < n; j++) {
+		pid = wait4(-1, &status, 0, &ru);
+		if (pid == -1)
+			break;
+		for (i = 0; i < n; i++)
+			if (pids[i] == pid)
+				break;
+		qembd_info("Instance %d (port %s) used %.2f s user, %.2f s system",
+			i, i < n ? ports[i] : "?",
+			ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1000000.0,
+			ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1000000.0);
+	}
+
+	free(args);
+	return 0;
+}
+
+int main(int c, char **v)
+{
+	int width = 0;
+	int height = 0;
+	int i;
+
+	/* -width / -height select the framebuffer size, engine ignores them */
+	for (i = 1; i < c - 1; i++) {
+		if (!strcmp(v[i], "-width"))
+			width = atoi(v[i + 1]);
+		else if (!strcmp(v[i], "-height"))
+			height = atoi(v[i + 1]);
+	}
+
+	if (width > 0 && height > 0)
+		display_setmode(width, height);
+	else if (width || height)
+		qembd_warn("Both -width and -height are needed, using default");
+
+	for (i = 1; i < c - 1; i++)
+		if (!strcmp(v[i], "-instances") && atoi(v[i + 1]) > 1)
+			return run_instances(c, v, atoi(v[i + 1]));
+
+	return qembd_main(c, v);
+}
+
+void *qembd_allocmain(size_t size)
+{
+	return malloc(size);
+}
+
+int qembd_dequeue_key_event(key_event_t *e)
+{
+	/* No input */
+	return -1;
+}
+
+int qembd_get_current_position(mouse_position_t *position)
+{
+	/* No input */
+	return -1;
+}
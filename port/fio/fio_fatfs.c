@@ -199,4 +199,9 @@ void Sys_File_gets(int handle, char *buf, int len)
 {
 	FIL *fp = HANDLE_TO_FILE(handle);
 	f_gets(buf, len, fp);
-}
\ No newline at end of file
+}
+
+void *Sys_FileMap(int handle, int length)
+{
+	return NULL;
+}
@@ -21,6 +21,7 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <errno.h>
 
@@ -99,4 +100,15 @@ void Sys_File_gets(int handle, char *buf, int len)
 	FILE *fp = fdopen(handle, "r");
 	fgets(buf, len, fp);
 	fclose(fp);
-}
\ No newline at end of file
+}
+
+void *Sys_FileMap(int handle, int length)
+{
+	void *p;
+
+	p = mmap(NULL, length, PROT_READ, MAP_SHARED, handle, 0);
+	if (p == MAP_FAILED)
+		return NULL;
+
+	return p;
+}
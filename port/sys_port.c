@@ -146,7 +146,9 @@ int qembd_main(int c, char **v)
 		if (cls.state == ca_dedicated) {
 			// play vcrfiles at max speed
 			if (time < sys_ticrate.value && (vcrFile == -1 || recording)) {
-				qembd_udelay(1);
+				// sleep until the tic, or until packets arrive
+				if (!NET_Sleep(sys_ticrate.value - time))
+					qembd_udelay((sys_ticrate.value - time) * 1000000);
 				continue;	// not time to run a server only tic yet
 			}
 			time = sys_ticrate.value;
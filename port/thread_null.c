@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2020 Shotaro Uchida <fantom@xmaker.mx>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <quakedef.h>
+
+/* No threads: jobs run one after another on the caller */
+
+static int null_lock;
+
+int Sys_NumWorkers(void)
+{
+	return 1;
+}
+
+void Sys_RunWorkers(int numjobs, workfunc_t func, void *arg)
+{
+	int i;
+
+	for (i = 0; i < numjobs; i++)
+		func(i, arg);
+}
+
+void *Sys_LockCreate(void)
+{
+	return &null_lock;
+}
+
+void Sys_LockShared(void *lock)
+{
+}
+
+void Sys_LockExclusive(void *lock)
+{
+}
+
+void Sys_Unlock(void *lock)
+{
+}
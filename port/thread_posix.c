@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2020 Shotaro Uchida <fantom@xmaker.mx>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <quakedef.h>
+#include <quakembd.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define MAX_WORKERS 32
+/* Band scans keep their edge, surface and span lists on the stack */
+#define WORKER_STACK_SIZE (4 * 1024 * 1024)
+
+static int num_workers;		/* including the thread calling Sys_RunWorkers */
+static int workers_started;
+static pthread_t workers[MAX_WORKERS];
+
+static pthread_mutex_t work_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t work_done = PTHREAD_COND_INITIALIZER;
+
+static workfunc_t work_func;
+static void *work_arg;
+static int work_numjobs;
+static int work_nextjob;
+static int work_pending;
+static unsigned int work_generation;
+
+static void run_jobs(void)
+{
+	int job;
+
+	pthread_mutex_lock(&work_mutex);
+	while (work_nextjob < work_numjobs) {
+		job = work_nextjob++;
+		pthread_mutex_unlock(&work_mutex);
+
+		work_func(job, work_arg);
+
+		pthread_mutex_lock(&work_mutex);
+		if (--work_pending == 0)
+			pthread_cond_broadcast(&work_done);
+	}
+	pthread_mutex_unlock(&work_mutex);
+}
+
+static void *worker_main(void *arg)
+{
+	unsigned int generation = 0;
+
+	while (1) {
+		pthread_mutex_lock(&work_mutex);
+		while (work_generation == generation)
+			pthread_cond_wait(&work_start, &work_mutex);
+		generation = work_generation;
+		pthread_mutex_unlock(&work_mutex);
+
+		run_jobs();
+	}
+
+	return NULL;
+}
+
+static void start_workers(void)
+{
+	pthread_attr_t attr;
+	int i;
+
+	workers_started = 1;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, WORKER_STACK_SIZE);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	for (i = 1; i < Sys_NumWorkers(); i++) {
+		if (pthread_create(&workers[i], &attr, worker_main, NULL) != 0) {
+			qembd_warn("Can't create worker thread, using %d", i);
+			num_workers = i;
+			break;
+		}
+	}
+
+	pthread_attr_destroy(&attr);
+}
+
+int Sys_NumWorkers(void)
+{
+	int i;
+
+	if (num_workers)
+		return num_workers;
+
+	i = COM_CheckParm("-threads");
+	if (i && i < com_argc - 1)
+		num_workers = Q_atoi(com_argv[i + 1]);
+	else
+		num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (num_workers < 1)
+		num_workers = 1;
+	if (num_workers > MAX_WORKERS)
+		num_workers = MAX_WORKERS;
+
+	return num_workers;
+}
+
+void Sys_RunWorkers(int numjobs, workfunc_t func, void *arg)
+{
+	int i;
+
+	if (numjobs < 2 || Sys_NumWorkers() < 2) {
+		for (i = 0; i < numjobs; i++)
+			func(i, arg);
+		return;
+	}
+
+	if (!workers_started)
+		start_workers();
+
+	pthread_mutex_lock(&work_mutex);
+	work_func = func;
+	work_arg = arg;
+	work_numjobs = numjobs;
+	work_nextjob = 0;
+	work_pending = numjobs;
+	work_generation++;
+	pthread_cond_broadcast(&work_start);
+	pthread_mutex_unlock(&work_mutex);
+
+	run_jobs();
+
+	pthread_mutex_lock(&work_mutex);
+	while (work_pending)
+		pthread_cond_wait(&work_done, &work_mutex);
+	pthread_mutex_unlock(&work_mutex);
+}
+
+void *Sys_LockCreate(void)
+{
+	pthread_rwlock_t *lock;
+
+	lock = malloc(sizeof(pthread_rwlock_t));
+	if (!lock || pthread_rwlock_init(lock, NULL) != 0)
+		Sys_Error("Sys_LockCreate: failed");
+
+	return lock;
+}
+
+void Sys_LockShared(void *lock)
+{
+	pthread_rwlock_rdlock(lock);
+}
+
+void Sys_LockExclusive(void *lock)
+{
+	pthread_rwlock_wrlock(lock);
+}
+
+void Sys_Unlock(void *lock)
+{
+	pthread_rwlock_unlock(lock);
+}
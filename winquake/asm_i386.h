@@ -51,7 +51,11 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define	hu_lastclipnode		12
 #define	hu_clip_mins		16
 #define	hu_clip_maxs		28
-#define hu_size  			40
+#define	hu_node_children	40
+#define	hu_node_dist		44
+#define	hu_node_normal		48
+#define	hu_node_type		52
+#define hu_size  			56
 
 // dnode_t structure
 // !!! if this is changed, it must be changed in bspfile.h too !!!
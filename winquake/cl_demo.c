@@ -22,6 +22,16 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 void CL_FinishTimeDemo (void);
 
+#define	MAX_TIMEDEMO_FRAMES	16384
+
+static char		*td_benchdir;			// -benchmark <dir>, NULL if not benchmarking
+static float	*td_frametimes;			// per frame msec, only with -benchmark
+static int		td_numframetimes;
+static char		td_demoname[MAX_OSPATH];
+static char		td_queue[MAX_OSPATH*4];	// demos left to time after this one
+static surfcachestats_t	td_surfcache;	// surface cache counters at the start
+static qboolean	td_restarting;			// a new timedemo is interrupting the old one
+
 /*
 ==============================================================================
 
@@ -105,7 +115,19 @@ int CL_GetMessage (void)
 			// if this is the second frame, grab the real td_starttime
 			// so the bogus time on the first frame doesn't count
 				if (host_framecount == cls.td_startframe + 1)
+				{
 					cls.td_starttime = realtime;
+					if (td_benchdir)
+					{
+						td_numframetimes = 0;
+						memset (&r_speedstotal, 0, sizeof(r_speedstotal));
+						r_collectspeeds = true;
+						D_SurfaceCacheStats (&td_surfcache);
+					}
+				}
+				else if (td_benchdir && td_numframetimes < MAX_TIMEDEMO_FRAMES)
+					td_frametimes[td_numframetimes++] = (realtime - cls.td_lastframetime) * 1000;
+				cls.td_lastframetime = realtime;
 			}
 			else if ( /* cl.time > 0 && */ cl.time <= cl.mtime[0])
 			{
@@ -252,6 +274,7 @@ void CL_Record_f (void)
 		Con_Printf ("ERROR: couldn't open.\n");
 		return;
 	}
+	COM_FlushFileIndex ();
 
 	cls.forcetrack = track;
 	buf_s = sprintf (buf, "%i\n", cls.forcetrack);
@@ -321,6 +344,170 @@ void CL_PlayDemo_f (void)
 //	fscanf (cls.demofile, "%i\n", &cls.forcetrack);
 }
 
+/*
+====================
+CL_FrameTimeCompare
+====================
+*/
+static int CL_FrameTimeCompare (const void *a, const void *b)
+{
+	float	fa, fb;
+
+	fa = *(float *)a;
+	fb = *(float *)b;
+	if (fa < fb)
+		return -1;
+	if (fa > fb)
+		return 1;
+	return 0;
+}
+
+/*
+====================
+CL_FrameTimePercentile
+
+Nearest rank percentile of the sorted td_frametimes
+====================
+*/
+static float CL_FrameTimePercentile (int percent)
+{
+	int		rank;
+
+	if (!td_numframetimes)
+		return 0;
+
+	rank = (td_numframetimes * percent + 99) / 100;
+	if (rank < 1)
+		rank = 1;
+	return td_frametimes[rank - 1];
+}
+
+/*
+====================
+CL_WriteTimeDemoStats
+
+Writes <benchdir>/<demo>.json for the timedemo that just finished
+====================
+*/
+static void CL_WriteTimeDemoStats (int frames, float time)
+{
+	char		name[MAX_OSPATH];
+	char		base[MAX_OSPATH];
+	char		buf[2048];
+	rspeeds_t	*rs;
+	surfcachestats_t	sc;
+	double		sum;
+	float		mean, p50, p95, p99;
+	float		div;
+	int			i, len, handle;
+
+	qsort (td_frametimes, td_numframetimes, sizeof(float), CL_FrameTimeCompare);
+
+	sum = 0;
+	for (i=0 ; i<td_numframetimes ; i++)
+		sum += td_frametimes[i];
+	mean = td_numframetimes ? sum / td_numframetimes : 0;
+	p50 = CL_FrameTimePercentile (50);
+	p95 = CL_FrameTimePercentile (95);
+	p99 = CL_FrameTimePercentile (99);
+
+	Con_Printf ("frame msec: mean %5.2f p50 %5.2f p95 %5.2f p99 %5.2f\n",
+				mean, p50, p95, p99);
+
+	rs = &r_speedstotal;
+	div = rs->frames ? (float)rs->frames : 1;
+
+	D_SurfaceCacheStats (&sc);
+	sc.lookups -= td_surfcache.lookups;
+	sc.builds -= td_surfcache.builds;
+	sc.evictions -= td_surfcache.evictions;
+	sc.frameevictions -= td_surfcache.frameevictions;
+
+	len = sprintf (buf,
+		"{\n"
+		"\t\"demo\": \"%s\",\n"
+		"\t\"width\": %i,\n"
+		"\t\"height\": %i,\n"
+		"\t\"frames\": %i,\n"
+		"\t\"total_sec\": %.4f,\n"
+		"\t\"fps\": %.2f,\n"
+		"\t\"frame_ms\": {\n"
+		"\t\t\"samples\": %i,\n"
+		"\t\t\"mean\": %.4f,\n"
+		"\t\t\"p50\": %.4f,\n"
+		"\t\t\"p95\": %.4f,\n"
+		"\t\t\"p99\": %.4f\n"
+		"\t},\n"
+		"\t\"refresh\": {\n"
+		"\t\t\"frames\": %i,\n"
+		"\t\t\"ms\": %.4f,\n"
+		"\t\t\"world_ms\": %.4f,\n"
+		"\t\t\"bmodels_ms\": %.4f,\n"
+		"\t\t\"scanedges_ms\": %.4f,\n"
+		"\t\t\"entities_ms\": %.4f,\n"
+		"\t\t\"viewmodel_ms\": %.4f,\n"
+		"\t\t\"particles_ms\": %.4f,\n"
+		"\t\t\"faceclip\": %.2f,\n"
+		"\t\t\"polys\": %.2f,\n"
+		"\t\t\"drawnpolys\": %.2f,\n"
+		"\t\t\"surfcache_builds\": %.2f\n"
+		"\t},\n"
+		"\t\"surfcache\": {\n"
+		"\t\t\"size_kb\": %i,\n"
+		"\t\t\"lookups\": %i,\n"
+		"\t\t\"builds\": %i,\n"
+		"\t\t\"hit_rate\": %.4f,\n"
+		"\t\t\"evictions\": %i,\n"
+		"\t\t\"frame_evictions\": %i,\n"
+		"\t\t\"free_kb\": %i,\n"
+		"\t\t\"free_blocks\": %i,\n"
+		"\t\t\"fragmentation\": %.4f\n"
+		"\t}\n"
+		"}\n",
+		td_demoname, vid.width, vid.height, frames, time, frames/time,
+		td_numframetimes, mean, p50, p95, p99,
+		rs->frames, rs->ms / div, rs->rw_time / div, rs->db_time / div,
+		rs->se_time / div, rs->de_time / div, rs->dv_time / div,
+		rs->dp_time / div, rs->faceclip / div, rs->polycount / div,
+		rs->drawnpolycount / div, rs->surf / div,
+		sc.size / 1024, sc.lookups, sc.builds,
+		sc.lookups ? 1.0 - (double)sc.builds / sc.lookups : 0.0,
+		sc.evictions, sc.frameevictions, sc.freebytes / 1024, sc.freeblocks,
+		sc.freebytes ? 1.0 - (double)sc.largestfree / sc.freebytes : 0.0);
+
+	COM_StripExtension (COM_SkipPath (td_demoname), base);
+	sprintf (name, "%s/%s.json", td_benchdir, base);
+
+	handle = Sys_FileOpenWrite (name);
+	if (handle < 0)
+	{
+		Con_Printf ("ERROR: couldn't write %s.\n", name);
+		return;
+	}
+	Sys_FileWrite (handle, buf, len);
+	Sys_FileClose (handle);
+	Con_Printf ("wrote %s\n", name);
+}
+
+/*
+====================
+CL_NextTimeDemo
+
+Moves on to the next demo given to timedemo, or quits after the last one
+when benchmarking
+====================
+*/
+static void CL_NextTimeDemo (void)
+{
+	if (td_restarting)
+		return;
+
+	if (td_queue[0])
+		Cbuf_InsertText (va("timedemo %s\n", td_queue));
+	else if (td_benchdir)
+		Sys_Quit ();
+}
+
 /*
 ====================
 CL_FinishTimeDemo
@@ -333,6 +520,7 @@ void CL_FinishTimeDemo (void)
 	float	time;
 	
 	cls.timedemo = false;
+	r_collectspeeds = false;
 	
 // the first frame didn't count
 	frames = (host_framecount - cls.td_startframe) - 1;
@@ -340,27 +528,55 @@ void CL_FinishTimeDemo (void)
 	if (!time)
 		time = 1;
 	Con_Printf ("%i frames %5.1f seconds %5.1f fps\n", frames, time, frames/time);
+
+	if (td_benchdir)
+		CL_WriteTimeDemoStats (frames, time);
+
+	CL_NextTimeDemo ();
 }
 
 /*
 ====================
 CL_TimeDemo_f
 
-timedemo [demoname]
+timedemo [demoname] [demoname ...]
 ====================
 */
 void CL_TimeDemo_f (void)
 {
+	int		i;
+
 	if (cmd_source != src_command)
 		return;
 
-	if (Cmd_Argc() != 2)
+	if (Cmd_Argc() < 2)
 	{
-		Con_Printf ("timedemo <demoname> : gets demo speeds\n");
+		Con_Printf ("timedemo <demoname> [<demoname> ...] : gets demo speeds\n");
 		return;
 	}
 
+// remember the rest of the list, the demos are timed one after another
+	td_queue[0] = 0;
+	for (i=2 ; i<Cmd_Argc() ; i++)
+	{
+		if (strlen(td_queue) + strlen(Cmd_Argv(i)) + 2 > sizeof(td_queue))
+		{
+			Con_Printf ("timedemo: too many demos, list truncated\n");
+			break;
+		}
+		strcat (td_queue, Cmd_Argv(i));
+		strcat (td_queue, " ");
+	}
+
+	td_restarting = true;
 	CL_PlayDemo_f ();
+	td_restarting = false;
+	if (!cls.demoplayback)
+	{
+		CL_NextTimeDemo ();
+		return;
+	}
+	Q_strncpy (td_demoname, Cmd_Argv(1), sizeof(td_demoname)-1);
 	
 // cls.td_starttime will be grabbed at the second frame of the demo, so
 // all the loading time doesn't get counted
@@ -370,3 +586,24 @@ void CL_TimeDemo_f (void)
 	cls.td_lastframe = -1;		// get a new message this frame
 }
 
+/*
+====================
+CL_InitBenchmark
+
+-benchmark <dir> makes every timedemo write its frame time percentiles and
+refresh stage breakdown to <dir>/<demoname>.json, and quits once the last
+demo given to timedemo is done
+====================
+*/
+void CL_InitBenchmark (void)
+{
+	int		i;
+
+	i = COM_CheckParm ("-benchmark");
+	if (!i || i >= com_argc-1)
+		return;
+
+	td_benchdir = com_argv[i+1];
+	Sys_mkdir (td_benchdir);
+	td_frametimes = Hunk_AllocName (MAX_TIMEDEMO_FRAMES * sizeof(float), "timedemo");
+}
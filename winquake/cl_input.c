@@ -381,6 +381,15 @@ void CL_SendMove (usercmd_t *cmd)
 	MSG_WriteByte (&buf, cmd->lightlevel);
 #endif
 
+//
+// tell the server which snapshot to delta from
+//
+	if (cl.protocol == PROTOCOL_DELTA)
+	{
+		MSG_WriteByte (&buf, clc_delta);
+		MSG_WriteLong (&buf, cl.snapshotsequence);
+	}
+
 //
 // deliver the message
 //
@@ -64,7 +64,8 @@ char *svc_strings[] =
 	"svc_finale",			// [string] music [string] text
 	"svc_cdtrack",			// [byte] track [byte] looptrack
 	"svc_sellscreen",
-	"svc_cutscene"
+	"svc_cutscene",
+	"svc_packetentities"	// [long] sequence [byte] delta <entities>
 };
 
 //=============================================================================
@@ -217,11 +218,12 @@ void CL_ParseServerInfo (void)
 
 // parse protocol version number
 	i = MSG_ReadLong ();
-	if (i != PROTOCOL_VERSION)
+	if (i != PROTOCOL_VERSION && i != PROTOCOL_DELTA)
 	{
-		Con_Printf ("Server returned version %i, not %i", i, PROTOCOL_VERSION);
+		Con_Printf ("Server returned version %i, not %i or %i", i, PROTOCOL_VERSION, PROTOCOL_DELTA);
 		return;
 	}
+	cl.protocol = i;
 
 // parse maxclients
 	cl.maxclients = MSG_ReadByte ();
@@ -231,6 +233,8 @@ void CL_ParseServerInfo (void)
 		return;
 	}
 	cl.scores = Hunk_AllocName (cl.maxclients*sizeof(*cl.scores), "scores");
+	if (cl.protocol == PROTOCOL_DELTA)
+		cl.snapshots = Hunk_AllocName (UPDATE_BACKUP*sizeof(snapshot_t), "snapshots");
 
 // parse gametype
 	cl.gametype = MSG_ReadByte ();
@@ -318,48 +322,22 @@ void CL_ParseServerInfo (void)
 
 /*
 ==================
-CL_ParseUpdate
+CL_SetEntityState
 
-Parse an entity update message from the server
+Moves an entity to the state the server sent for this frame.
 If an entities model or origin changes from frame to frame, it must be
 relinked.  Other attributes can change without relinking.
 ==================
 */
-int	bitcounts[16];
-
-void CL_ParseUpdate (int bits)
+void CL_SetEntityState (int num, entity_state_t *state, qboolean nolerp)
 {
 	int			i;
 	model_t		*model;
-	int			modnum;
 	qboolean	forcelink;
 	entity_t	*ent;
-	int			num;
-	int			skin;
-
-	if (cls.signon == SIGNONS - 1)
-	{	// first update is the final signon stage
-		cls.signon = SIGNONS;
-		CL_SignonReply ();
-	}
-
-	if (bits & U_MOREBITS)
-	{
-		i = MSG_ReadByte ();
-		bits |= (i<<8);
-	}
-
-	if (bits & U_LONGENTITY)	
-		num = MSG_ReadShort ();
-	else
-		num = MSG_ReadByte ();
 
 	ent = CL_EntityNum (num);
 
-for (i=0 ; i<16 ; i++)
-if (bits&(1<<i))
-	bitcounts[i]++;
-
 	if (ent->msgtime != cl.mtime[1])
 		forcelink = true;	// no previous frame to lerp from
 	else
@@ -367,16 +345,10 @@ if (bits&(1<<i))
 
 	ent->msgtime = cl.mtime[0];
 	
-	if (bits & U_MODEL)
-	{
-		modnum = MSG_ReadByte ();
-		if (modnum >= MAX_MODELS)
-			Host_Error ("CL_ParseModel: bad modnum");
-	}
-	else
-		modnum = ent->baseline.modelindex;
+	if (state->modelindex >= MAX_MODELS)
+		Host_Error ("CL_ParseModel: bad modnum");
 		
-	model = cl.model_precache[modnum];
+	model = cl.model_precache[state->modelindex];
 	if (model != ent->model)
 	{
 		ent->model = model;
@@ -397,15 +369,9 @@ if (bits&(1<<i))
 #endif
 	}
 	
-	if (bits & U_FRAME)
-		ent->frame = MSG_ReadByte ();
-	else
-		ent->frame = ent->baseline.frame;
+	ent->frame = state->frame;
 
-	if (bits & U_COLORMAP)
-		i = MSG_ReadByte();
-	else
-		i = ent->baseline.colormap;
+	i = state->colormap;
 	if (!i)
 		ent->colormap = vid.colormap;
 	else
@@ -416,61 +382,27 @@ if (bits&(1<<i))
 	}
 
 #ifdef GLQUAKE
-	if (bits & U_SKIN)
-		skin = MSG_ReadByte();
-	else
-		skin = ent->baseline.skin;
-	if (skin != ent->skinnum) {
-		ent->skinnum = skin;
+	if (state->skin != ent->skinnum) {
+		ent->skinnum = state->skin;
 		if (num > 0 && num <= cl.maxclients)
 			R_TranslatePlayerSkin (num - 1);
 	}
 
 #else
 
-	if (bits & U_SKIN)
-		ent->skinnum = MSG_ReadByte();
-	else
-		ent->skinnum = ent->baseline.skin;
+	ent->skinnum = state->skin;
 #endif
 
-	if (bits & U_EFFECTS)
-		ent->effects = MSG_ReadByte();
-	else
-		ent->effects = ent->baseline.effects;
+	ent->effects = state->effects;
 
 // shift the known values for interpolation
 	VectorCopy (ent->msg_origins[0], ent->msg_origins[1]);
 	VectorCopy (ent->msg_angles[0], ent->msg_angles[1]);
 
-	if (bits & U_ORIGIN1)
-		ent->msg_origins[0][0] = MSG_ReadCoord ();
-	else
-		ent->msg_origins[0][0] = ent->baseline.origin[0];
-	if (bits & U_ANGLE1)
-		ent->msg_angles[0][0] = MSG_ReadAngle();
-	else
-		ent->msg_angles[0][0] = ent->baseline.angles[0];
-
-	if (bits & U_ORIGIN2)
-		ent->msg_origins[0][1] = MSG_ReadCoord ();
-	else
-		ent->msg_origins[0][1] = ent->baseline.origin[1];
-	if (bits & U_ANGLE2)
-		ent->msg_angles[0][1] = MSG_ReadAngle();
-	else
-		ent->msg_angles[0][1] = ent->baseline.angles[1];
+	VectorCopy (state->origin, ent->msg_origins[0]);
+	VectorCopy (state->angles, ent->msg_angles[0]);
 
-	if (bits & U_ORIGIN3)
-		ent->msg_origins[0][2] = MSG_ReadCoord ();
-	else
-		ent->msg_origins[0][2] = ent->baseline.origin[2];
-	if (bits & U_ANGLE3)
-		ent->msg_angles[0][2] = MSG_ReadAngle();
-	else
-		ent->msg_angles[0][2] = ent->baseline.angles[2];
-
-	if ( bits & U_NOLERP )
+	if ( nolerp )
 		ent->forcelink = true;
 
 	if ( forcelink )
@@ -483,6 +415,267 @@ if (bits&(1<<i))
 	}
 }
 
+/*
+==================
+CL_ParseUpdate
+
+Parse an entity update message from the server.  Anything not sent is
+taken from the entity's baseline.
+==================
+*/
+int	bitcounts[16];
+
+void CL_ParseUpdate (int bits)
+{
+	int			i;
+	int			num;
+	entity_state_t	state;
+
+	if (cls.signon == SIGNONS - 1)
+	{	// first update is the final signon stage
+		cls.signon = SIGNONS;
+		CL_SignonReply ();
+	}
+
+	if (bits & U_MOREBITS)
+	{
+		i = MSG_ReadByte ();
+		bits |= (i<<8);
+	}
+
+	if (bits & U_LONGENTITY)	
+		num = MSG_ReadShort ();
+	else
+		num = MSG_ReadByte ();
+
+	state = CL_EntityNum (num)->baseline;
+
+for (i=0 ; i<16 ; i++)
+if (bits&(1<<i))
+	bitcounts[i]++;
+
+	if (bits & U_MODEL)
+		state.modelindex = MSG_ReadByte ();
+	if (bits & U_FRAME)
+		state.frame = MSG_ReadByte ();
+	if (bits & U_COLORMAP)
+		state.colormap = MSG_ReadByte();
+	if (bits & U_SKIN)
+		state.skin = MSG_ReadByte();
+	if (bits & U_EFFECTS)
+		state.effects = MSG_ReadByte();
+
+	if (bits & U_ORIGIN1)
+		state.origin[0] = MSG_ReadCoord ();
+	if (bits & U_ANGLE1)
+		state.angles[0] = MSG_ReadAngle();
+	if (bits & U_ORIGIN2)
+		state.origin[1] = MSG_ReadCoord ();
+	if (bits & U_ANGLE2)
+		state.angles[1] = MSG_ReadAngle();
+	if (bits & U_ORIGIN3)
+		state.origin[2] = MSG_ReadCoord ();
+	if (bits & U_ANGLE3)
+		state.angles[2] = MSG_ReadAngle();
+
+	CL_SetEntityState (num, &state, bits & U_NOLERP);
+}
+
+/*
+==================
+CL_PackBaseline
+
+The baseline back in the form the server sent it, which PROTOCOL_DELTA
+sends entities coming into view against
+==================
+*/
+void CL_PackBaseline (int num, packedentity_t *to)
+{
+	entity_state_t	*baseline;
+	int				i;
+
+	baseline = &CL_EntityNum (num)->baseline;
+	to->number = num;
+	for (i=0 ; i<3 ; i++)
+	{
+		to->origin[i] = (int)(baseline->origin[i]*8);
+		to->angles[i] = (int)(baseline->angles[i]*256/360);
+	}
+	to->modelindex = baseline->modelindex;
+	to->frame = baseline->frame;
+	to->colormap = baseline->colormap;
+	to->skin = baseline->skin;
+	to->effects = baseline->effects;
+	to->flags = 0;
+}
+
+/*
+==================
+CL_ParseDeltaEntity
+
+Reads the fields of an entity that changed since from
+==================
+*/
+void CL_ParseDeltaEntity (packedentity_t *from, packedentity_t *to, int num)
+{
+	int		bits;
+
+	*to = *from;
+	to->number = num;
+
+	bits = MSG_ReadByte ();
+	if (bits & U_MOREBITS)
+		bits |= MSG_ReadByte () << 8;
+
+	to->flags = bits & U_NOLERP;
+
+	if (bits & U_MODEL)
+		to->modelindex = MSG_ReadByte ();
+	if (bits & U_FRAME)
+		to->frame = MSG_ReadByte ();
+	if (bits & U_COLORMAP)
+		to->colormap = MSG_ReadByte ();
+	if (bits & U_SKIN)
+		to->skin = MSG_ReadByte ();
+	if (bits & U_EFFECTS)
+		to->effects = MSG_ReadByte ();
+	if (bits & U_ORIGIN1)
+		to->origin[0] = MSG_ReadShort ();
+	if (bits & U_ANGLE1)
+		to->angles[0] = MSG_ReadByte ();
+	if (bits & U_ORIGIN2)
+		to->origin[1] = MSG_ReadShort ();
+	if (bits & U_ANGLE2)
+		to->angles[1] = MSG_ReadByte ();
+	if (bits & U_ORIGIN3)
+		to->origin[2] = MSG_ReadShort ();
+	if (bits & U_ANGLE3)
+		to->angles[2] = MSG_ReadByte ();
+}
+
+/*
+==================
+CL_NewSnapshotEntity
+==================
+*/
+packedentity_t *CL_NewSnapshotEntity (snapshot_t *snap)
+{
+	if (snap->num_entities == MAX_PACKET_ENTITIES)
+		Host_Error ("CL_ParsePacketEntities: too many entities");
+	return &snap->entities[snap->num_entities++];
+}
+
+/*
+==================
+CL_ParsePacketEntities
+
+A PROTOCOL_DELTA snapshot.  Entities that are not mentioned are unchanged
+from the snapshot it was deltaed from, and every entity in the result is
+updated as if it had come in as a svc_update.
+==================
+*/
+void CL_ParsePacketEntities (void)
+{
+	int			sequence, delta;
+	int			word, num, oldindex, numold;
+	snapshot_t	*from, *to;
+	packedentity_t	base;
+	entity_state_t	state;
+	qboolean	valid;
+	int			i;
+
+	if (cls.signon == SIGNONS - 1)
+	{	// first update is the final signon stage
+		cls.signon = SIGNONS;
+		CL_SignonReply ();
+	}
+
+	if (!cl.snapshots)
+		Host_Error ("CL_ParsePacketEntities: not using delta snapshots");
+
+	sequence = MSG_ReadLong ();
+	delta = MSG_ReadByte ();
+
+	from = NULL;
+	numold = 0;
+	valid = true;
+	if (delta)
+	{
+		from = &cl.snapshots[(sequence - delta) & UPDATE_MASK];
+		if (delta < UPDATE_BACKUP && from->sequence == sequence - delta)
+			numold = from->num_entities;
+		else
+		{	// don't have it any more, read the message and throw it away
+			from = NULL;
+			valid = false;
+		}
+	}
+
+	to = &cl.snapshots[sequence & UPDATE_MASK];
+	to->num_entities = 0;
+	oldindex = 0;
+
+	while (1)
+	{
+		word = (unsigned short)MSG_ReadShort ();
+		if (msg_badread)
+			Host_Error ("CL_ParsePacketEntities: end of message");
+		if (!word)
+			break;
+
+		num = word & ~PE_REMOVE;
+		if (num >= MAX_EDICTS)
+			Host_Error ("CL_ParsePacketEntities: bad entity %i", num);
+
+	// entities in between didn't change
+		while (oldindex < numold && from->entities[oldindex].number < num)
+			*CL_NewSnapshotEntity (to) = from->entities[oldindex++];
+
+		if (oldindex < numold && from->entities[oldindex].number == num)
+		{
+			base = from->entities[oldindex++];
+			if (word & PE_REMOVE)
+				continue;
+		}
+		else
+		{
+			if (word & PE_REMOVE)
+				continue;
+			CL_PackBaseline (num, &base);
+		}
+
+		CL_ParseDeltaEntity (&base, CL_NewSnapshotEntity (to), num);
+	}
+
+	while (oldindex < numold)
+		*CL_NewSnapshotEntity (to) = from->entities[oldindex++];
+
+	if (!valid)
+	{	// ack nothing, so the server sends a full snapshot
+		to->sequence = 0;
+		cl.snapshotsequence = 0;
+		return;
+	}
+
+	to->sequence = sequence;
+	cl.snapshotsequence = sequence;
+
+	for (i=0 ; i<to->num_entities ; i++)
+	{
+		for (num=0 ; num<3 ; num++)
+		{
+			state.origin[num] = to->entities[i].origin[num] * (1.0/8);
+			state.angles[num] = (signed char)to->entities[i].angles[num] * (360.0/256);
+		}
+		state.modelindex = to->entities[i].modelindex;
+		state.frame = to->entities[i].frame;
+		state.colormap = to->entities[i].colormap;
+		state.skin = to->entities[i].skin;
+		state.effects = to->entities[i].effects;
+		CL_SetEntityState (to->entities[i].number, &state, to->entities[i].flags & U_NOLERP);
+	}
+}
+
 /*
 ==================
 CL_ParseBaseline
@@ -947,6 +1140,10 @@ void CL_ParseServerMessage (void)
 			SCR_CenterPrint (MSG_ReadString ());			
 			break;
 
+		case svc_packetentities:
+			CL_ParsePacketEntities ();
+			break;
+
 		case svc_cutscene:
 			cl.intermission = 3;
 			cl.completed_time = cl.time;
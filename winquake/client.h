@@ -130,6 +130,7 @@ typedef struct
 	int			td_lastframe;		// to meter out one message a frame
 	int			td_startframe;		// host_framecount at start
 	float		td_starttime;		// realtime at second frame of timedemo
+	double		td_lastframetime;	// realtime of the previous timedemo frame
 
 
 // connection information
@@ -226,6 +227,11 @@ typedef struct
 // frag scoreboard
 	scoreboard_t	*scores;		// [cl.maxclients]
 
+// delta compressed entities
+	int			protocol;		// from svc_serverinfo
+	snapshot_t	*snapshots;		// [UPDATE_BACKUP] if PROTOCOL_DELTA
+	int			snapshotsequence;	// last good snapshot, acked in clc_delta
+
 #ifdef QUAKE2
 // light level at player's position including dlights
 // this is sent back to the server each frame
@@ -348,6 +354,7 @@ void CL_Stop_f (void);
 void CL_Record_f (void);
 void CL_PlayDemo_f (void);
 void CL_TimeDemo_f (void);
+void CL_InitBenchmark (void);
 
 //
 // cl_parse.c
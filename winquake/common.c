@@ -746,6 +746,24 @@ void SZ_Free (sizebuf_t *buf)
 	buf->cursize = 0;
 }
 
+/*
+============
+SZ_View
+
+Makes buf hold the length bytes at data without allocating or copying
+anything.  The buffer is full, so it can be read with MSG_Read* but not
+written to; the data stays its owner's.
+============
+*/
+void SZ_View (sizebuf_t *buf, void *data, int length)
+{
+	buf->allowoverflow = false;
+	buf->overflowed = false;
+	buf->data = data;
+	buf->maxsize = length;
+	buf->cursize = length;
+}
+
 void SZ_Clear (sizebuf_t *buf)
 {
 	buf->cursize = 0;
@@ -1042,6 +1060,7 @@ void COM_CheckRegistered (void)
 	Cvar_Set ("cmdline", com_cmdline);
 	Cvar_Set ("registered", "1");
 	static_registered = 1;
+	COM_FlushFileIndex ();		// directories are searched deeper now
 	Con_Printf ("Playing registered version.\n");
 }
 
@@ -1217,6 +1236,7 @@ typedef struct pack_s
 	int             handle;
 	int             numfiles;
 	packfile_t      *files;
+	byte            *mapped;        // whole pack, NULL if it couldn't be mapped
 } pack_t;
 
 //
@@ -1249,6 +1269,214 @@ typedef struct searchpath_s
 
 searchpath_t    *com_searchpaths;
 
+/*
+=============================================================================
+
+FILE INDEX
+
+Every file name COM_OpenFile has been asked for maps to where the search
+path finds it: a pack entry, a directory, or nowhere.  The entries of all
+the packs go in when the search path is set up; directories can't be
+listed, so a name is only checked against the directories ahead of its
+pack (or all of them, if no pack has it) the first time it is opened.
+Names that aren't in any pack use one of a fixed number of spare entries,
+and the directory results are forgotten on every map load or file write,
+so the engine sees new files the same way it did before.
+
+=============================================================================
+*/
+
+#define	MAX_FILE_LOOKUPS	256		// names not in a pack that can be remembered
+
+typedef struct fileindex_s
+{
+	char				*name;
+	searchpath_t		*search;	// NULL if it is nowhere
+	packfile_t			*file;		// NULL if it is in a directory
+	qboolean			checked;	// directories ahead of the pack checked
+	struct fileindex_s	*next;
+} fileindex_t;
+
+static fileindex_t	**com_filehash;
+static int			com_filehashmask;
+static fileindex_t	*com_fileindex;
+static int			com_numfileindex, com_maxfileindex;
+static int			com_numpackindex;	// entries after these are spares
+static char			(*com_lookupnames)[MAX_QPATH];
+
+static unsigned COM_HashFileName (char *name)
+{
+	unsigned	hash;
+
+	hash = 0;
+	while (*name)
+		hash = hash * 31 + *name++;
+
+	return hash;
+}
+
+static fileindex_t *COM_FindFileIndex (char *name)
+{
+	fileindex_t	*e;
+
+	for (e = com_filehash[COM_HashFileName (name) & com_filehashmask] ; e
+		; e = e->next)
+		if (!strcmp (e->name, name))
+			return e;
+
+	return NULL;
+}
+
+static fileindex_t *COM_AddFileIndex (char *name)
+{
+	fileindex_t	*e;
+	int			hash;
+
+	e = &com_fileindex[com_numfileindex++];
+	e->name = name;
+	e->search = NULL;
+	e->file = NULL;
+	e->checked = false;
+
+	hash = COM_HashFileName (name) & com_filehashmask;
+	e->next = com_filehash[hash];
+	com_filehash[hash] = e;
+
+	return e;
+}
+
+/*
+============
+COM_FlushFileIndex
+
+Forgets everything learned about directories, for when files may have
+been written
+============
+*/
+void COM_FlushFileIndex (void)
+{
+	searchpath_t	*search;
+	fileindex_t		*e;
+	qboolean		dirahead;
+	int				i;
+
+	if (!com_filehash)
+		return;
+
+	memset (com_filehash, 0, (com_filehashmask + 1) * sizeof(*com_filehash));
+	com_numfileindex = 0;
+
+// the first pack on the search path that has a name is the one it opens
+	dirahead = false;
+	for (search = com_searchpaths ; search ; search = search->next)
+	{
+		if (!search->pack)
+		{
+			dirahead = true;
+			continue;
+		}
+
+		for (i=0 ; i<search->pack->numfiles ; i++)
+		{
+			if (COM_FindFileIndex (search->pack->files[i].name))
+				continue;
+			e = COM_AddFileIndex (search->pack->files[i].name);
+			e->search = search;
+			e->file = &search->pack->files[i];
+			e->checked = !dirahead;
+		}
+	}
+
+	com_numpackindex = com_numfileindex;
+}
+
+/*
+============
+COM_InitFileIndex
+============
+*/
+static void COM_InitFileIndex (void)
+{
+	searchpath_t	*search;
+	int				numfiles, size;
+
+	numfiles = 0;
+	for (search = com_searchpaths ; search ; search = search->next)
+		if (search->pack)
+			numfiles += search->pack->numfiles;
+
+	com_maxfileindex = numfiles + MAX_FILE_LOOKUPS;
+	for (size = 64 ; size < com_maxfileindex * 2 ; size <<= 1)
+		;
+	com_filehashmask = size - 1;
+
+	com_filehash = Hunk_AllocName (size * sizeof(*com_filehash), "fileidx");
+	com_fileindex = Hunk_AllocName (com_maxfileindex * sizeof(*com_fileindex),
+			"fileidx");
+	com_lookupnames = Hunk_AllocName (MAX_FILE_LOOKUPS * MAX_QPATH,
+			"fileidx");
+
+	COM_FlushFileIndex ();
+}
+
+/*
+============
+COM_LookupFile
+
+Finds where the search path opens filename, checking the directories
+only the first time
+============
+*/
+static fileindex_t *COM_LookupFile (char *filename)
+{
+	fileindex_t		*e;
+	searchpath_t	*search;
+	char			netpath[MAX_OSPATH];
+	char			*name;
+
+	e = COM_FindFileIndex (filename);
+	if (e && e->checked)
+		return e;
+
+	for (search = com_searchpaths ; search ; search = search->next)
+	{
+		if (e && search == e->search)
+			break;		// the pack it is in comes first
+		if (search->pack)
+			continue;	// the index holds every pack entry
+
+		if (!static_registered)
+		{       // if not a registered version, don't ever go beyond base
+			if ( strchr (filename, '/') || strchr (filename,'\\'))
+				continue;
+		}
+
+		sprintf (netpath, "%s/%s",search->filename, filename);
+		if (Sys_FileTime (netpath) != -1)
+			break;
+	}
+
+	if (!e)
+	{
+		if (strlen (filename) >= MAX_QPATH)
+			Sys_Error ("COM_LookupFile: %s is too long", filename);
+		if (com_numfileindex == com_maxfileindex)
+			COM_FlushFileIndex ();
+		name = com_lookupnames[com_numfileindex - com_numpackindex];
+		strcpy (name, filename);
+		e = COM_AddFileIndex (name);
+	}
+
+	if (search && search != e->search)
+	{
+		e->search = search;		// a loose file hides the pack entry
+		e->file = NULL;
+	}
+	e->checked = true;
+
+	return e;
+}
+
 /*
 ============
 COM_Path_f
@@ -1269,6 +1497,7 @@ void COM_Path_f (void)
 		else
 			Con_Printf ("%s\n", s->filename);
 	}
+	Con_Printf ("%i file names indexed\n", com_numfileindex);
 }
 
 /*
@@ -1295,6 +1524,8 @@ void COM_WriteFile (char *filename, void *data, int len)
 	Sys_Printf ("COM_WriteFile: %s\n", name);
 	Sys_FileWrite (handle, data, len);
 	Sys_FileClose (handle);
+
+	COM_FlushFileIndex ();
 }
 
 
@@ -1365,93 +1596,131 @@ it may actually be inside a pak file
 */
 int COM_OpenFile (char *filename, int *handle, qboolean reopen)
 {
+	fileindex_t     *e;
 	searchpath_t    *search;
 	char            netpath[MAX_OSPATH];
 	char            cachepath[MAX_OSPATH];
 	pack_t          *pak;
+	packfile_t      *file;
 	int                     i;
 	int                     findtime, cachetime;
 
 	if (!handle)
 		Sys_Error ("COM_FindFile: *handle is NULL");
 		
-//
-// search through the path, one element at a time
-//
-	search = com_searchpaths;
-	if (proghack)
+	if (proghack && !strcmp(filename, "progs.dat"))
 	{	// gross hack to use quake 1 progs with quake 2 maps
-		if (!strcmp(filename, "progs.dat"))
-			search = search->next;
-	}
-
-	for ( ; search ; search = search->next)
-	{
-	// is the element a pak file?
-		if (search->pack)
+		search = com_searchpaths->next;
+		file = NULL;
+		for ( ; search ; search = search->next)
 		{
-		// look through all the pak file elements
+			if (!search->pack)
+			{
+				sprintf (netpath, "%s/%s",search->filename, filename);
+				if (Sys_FileTime (netpath) != -1)
+					break;
+				continue;
+			}
 			pak = search->pack;
 			for (i=0 ; i<pak->numfiles ; i++)
 				if (!strcmp (pak->files[i].name, filename))
-				{       // found it!
-					Sys_Printf ("PackFile: %s : %s\n",pak->filename, filename);
-					if (reopen)
-						Sys_FileOpenRead(pak->filename, handle);
-					else
-						*handle = pak->handle;
-					Sys_FileSeek (*handle, pak->files[i].filepos);
-					com_filesize = pak->files[i].filelen;
-					return com_filesize;
-				}
+					break;
+			if (i < pak->numfiles)
+			{
+				file = &pak->files[i];
+				break;
+			}
 		}
+	}
+	else
+	{
+		e = COM_LookupFile (filename);
+		search = e->search;
+		file = e->file;
+	}
+
+	if (!search)
+	{
+		Sys_Printf ("FindFile: can't find %s\n", filename);
+	
+		*handle = -1;
+		com_filesize = -1;
+		return -1;
+	}
+
+	if (file)
+	{
+		pak = search->pack;
+		Sys_Printf ("PackFile: %s : %s\n",pak->filename, filename);
+		if (reopen)
+			Sys_FileOpenRead(pak->filename, handle);
 		else
-		{               
-	// check a file in the directory tree
-			if (!static_registered)
-			{       // if not a registered version, don't ever go beyond base
-				if ( strchr (filename, '/') || strchr (filename,'\\'))
-					continue;
-			}
-			
-			sprintf (netpath, "%s/%s",search->filename, filename);
+			*handle = pak->handle;
+		Sys_FileSeek (*handle, file->filepos);
+		com_filesize = file->filelen;
+		return com_filesize;
+	}
+
+// check a file in the directory tree
+	sprintf (netpath, "%s/%s",search->filename, filename);
 			
-			findtime = Sys_FileTime (netpath);
-			if (findtime == -1)
-				continue;
-				
-		// see if the file needs to be updated in the cache
-			if (!com_cachedir[0])
-				strcpy (cachepath, netpath);
-			else
-			{	
+// see if the file needs to be updated in the cache
+	if (com_cachedir[0])
+	{	
+		findtime = Sys_FileTime (netpath);
+
 #if defined(_WIN32)
-				if ((strlen(netpath) < 2) || (netpath[1] != ':'))
-					sprintf (cachepath,"%s%s", com_cachedir, netpath);
-				else
-					sprintf (cachepath,"%s%s", com_cachedir, netpath+2);
+		if ((strlen(netpath) < 2) || (netpath[1] != ':'))
+			sprintf (cachepath,"%s%s", com_cachedir, netpath);
+		else
+			sprintf (cachepath,"%s%s", com_cachedir, netpath+2);
 #else
-				sprintf (cachepath,"%s%s", com_cachedir, netpath);
+		sprintf (cachepath,"%s%s", com_cachedir, netpath);
 #endif
 
-				cachetime = Sys_FileTime (cachepath);
-			
-				if (cachetime < findtime)
-					COM_CopyFile (netpath, cachepath);
-				strcpy (netpath, cachepath);
-			}	
-
-			Sys_Printf ("FindFile: %s\n",netpath);
-			com_filesize = Sys_FileOpenRead (netpath, handle);
-			return com_filesize;
-		}
-		
-	}
-	
-	Sys_Printf ("FindFile: can't find %s\n", filename);
+		cachetime = Sys_FileTime (cachepath);
 	
-	com_filesize = -1;
-	return -1;
+		if (cachetime < findtime)
+			COM_CopyFile (netpath, cachepath);
+		strcpy (netpath, cachepath);
+	}	
+
+	Sys_Printf ("FindFile: %s\n",netpath);
+	com_filesize = Sys_FileOpenRead (netpath, handle);
+	if (com_filesize == -1)
+		COM_FlushFileIndex ();	// it went away, look again next time
+	return com_filesize;
+}
+
+/*
+===========
+COM_MapFile
+
+Returns a read only pointer to filename inside its mapped pak, or NULL if
+it isn't in one, so the caller should load it instead.  The data is only
+4 byte aligned and stays valid until exit
+===========
+*/
+byte *COM_MapFile (char *filename, int *length)
+{
+	fileindex_t     *e;
+	pack_t          *pak;
+
+	if (proghack && !strcmp(filename, "progs.dat"))
+		return NULL;
+
+	e = COM_LookupFile (filename);
+	if (!e->file)
+		return NULL;
+	pak = e->search->pack;
+	if (!pak->mapped || (e->file->filepos & 3))
+		return NULL;
+
+	Sys_Printf ("PackFile: %s : %s (mapped)\n",pak->filename, filename);
+	com_filesize = e->file->filelen;
+	if (length)
+		*length = com_filesize;
+	return pak->mapped + e->file->filepos;
 }
 
 /*
@@ -1577,11 +1846,12 @@ pack_t *COM_LoadPackFile (char *packfile)
 	packfile_t              *newfiles;
 	int                             numpackfiles;
 	pack_t                  *pack;
-	int                             packhandle;
+	int                             packhandle, packsize;
 	dpackfile_t             info[MAX_FILES_IN_PACK];
 	unsigned short          crc;
 
-	if (Sys_FileOpenRead (packfile, &packhandle) == -1)
+	packsize = Sys_FileOpenRead (packfile, &packhandle);
+	if (packsize == -1)
 	{
 //              Con_Printf ("Couldn't open %s\n", packfile);
 		return NULL;
@@ -1626,6 +1896,8 @@ pack_t *COM_LoadPackFile (char *packfile)
 	pack->handle = packhandle;
 	pack->numfiles = numpackfiles;
 	pack->files = newfiles;
+	if (!COM_CheckParm ("-nomap"))
+		pack->mapped = Sys_FileMap (packhandle, packsize);
 	
 	Con_Printf ("Added packfile %s (%i files)\n", packfile, numpackfiles);
 	return pack;
@@ -1776,6 +2048,8 @@ void COM_InitFilesystem (void)
 
 	if (COM_CheckParm ("-proghack"))
 		proghack = true;
+
+	COM_InitFileIndex ();
 }
 
 
@@ -44,6 +44,7 @@ void SZ_Clear (sizebuf_t *buf);
 void *SZ_GetSpace (sizebuf_t *buf, int length);
 void SZ_Write (sizebuf_t *buf, void *data, int length);
 void SZ_Print (sizebuf_t *buf, char *data);	// strcats onto the sizebuf
+void SZ_View (sizebuf_t *buf, void *data, int length);	// full, over data it doesn't own
 
 //============================================================================
 
@@ -151,6 +152,7 @@ void COM_InitArgv (int argc, char **argv);
 
 char *COM_SkipPath (char *pathname);
 void COM_StripExtension (char *in, char *out);
+char *COM_FileExtension (char *in);
 void COM_FileBase (char *in, char *out);
 void COM_DefaultExtension (char *path, char *extension);
 
@@ -168,6 +170,8 @@ extern	char	com_gamedir[MAX_OSPATH];
 void COM_WriteFile (char *filename, void *data, int len);
 int COM_OpenFile (char *filename, int *hndl, qboolean reopen);
 void COM_CloseFile (int h);
+byte *COM_MapFile (char *path, int *length);
+void COM_FlushFileIndex (void);
 
 byte *COM_LoadStackFile (char *path, void *buffer, int bufsize);
 byte *COM_LoadTempFile (char *path);
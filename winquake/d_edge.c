@@ -22,7 +22,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "quakedef.h"
 #include "d_local.h"
 
-static int	miplevel;
+static THREADLOCAL int	miplevel;
 
 float		scale_for_mip;
 extern int	screenwidth;
@@ -33,7 +33,7 @@ int			vstartscan;
 extern void			R_RotateBmodel (void);
 extern void			R_TransformFrustum (void);
 
-vec3_t		transformed_modelorg;
+THREADLOCAL vec3_t	transformed_modelorg;
 
 /*
 ==============
@@ -201,6 +201,9 @@ void D_DrawSurfaces (void)
 	}
 	else
 	{
+		if (!r_bandscan)
+			D_PrefillSurfaceCache ();
+
 		for (s = &surfaces[1] ; s<surface_p ; s++)
 		{
 			if (!s->spans)
@@ -238,7 +241,7 @@ void D_DrawSurfaces (void)
 				pface = s->data;
 				miplevel = 0;
 				cacheblock = (pixel_t *)
-						((byte *)pface->texinfo->texture +
+						(pface->texinfo->texture->pixels +
 						pface->texinfo->texture->offsets[0]);
 				cachewidth = 64;
 
@@ -297,17 +300,26 @@ void D_DrawSurfaces (void)
 				* pface->texinfo->mipadjust);
 
 			// FIXME: make this passed in to D_CacheSurface
-				pcurrentcache = D_CacheSurface (pface, miplevel);
+				if (r_bandscan)
+					pcurrentcache = D_CacheSurfaceBand (pface, miplevel);
+				else
+					pcurrentcache = D_CacheSurface (pface, miplevel);
 
 				cacheblock = (pixel_t *)pcurrentcache->data;
 				cachewidth = pcurrentcache->width;
 
 				D_CalcGradients (pface);
 
+				if (d_recordspans && !r_bandscan)
+					D_RecordSpans (s->spans, pcurrentcache);
+
 				(*d_drawspans) (s->spans);
 
 				D_DrawZSpans (s->spans);
 
+				if (r_bandscan)
+					D_ReleaseSurfaceCache ();
+
 				if (s->insubmodel)
 				{
 				//
@@ -201,7 +201,7 @@ typedef struct
 	int			surfheight;	// in mipmapped texels
 } drawsurf_t;
 
-extern drawsurf_t	r_drawsurf;
+extern THREADLOCAL drawsurf_t	r_drawsurf;
 
 void R_DrawSurface (void);
 void R_GenTile (msurface_t *psurf, void *pdest);
@@ -24,12 +24,12 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #define NUM_MIPS	4
 
-cvar_t	d_subdiv16 = {"d_subdiv16", "1"};
+cvar_t	d_subdiv16 = {"d_subdiv16", "0"};
 cvar_t	d_mipcap = {"d_mipcap", "0"};
 cvar_t	d_mipscale = {"d_mipscale", "1"};
+cvar_t	d_simd = {"d_simd", "1"};
+cvar_t	d_prefill = {"d_prefill", "1"};
 
-surfcache_t		*d_initial_rover;
-qboolean		d_roverwrapped;
 int				d_minmip;
 float			d_scalemip[NUM_MIPS-1];
 
@@ -53,6 +53,11 @@ void D_Init (void)
 	Cvar_RegisterVariable (&d_subdiv16);
 	Cvar_RegisterVariable (&d_mipcap);
 	Cvar_RegisterVariable (&d_mipscale);
+	Cvar_RegisterVariable (&d_simd);
+	Cvar_RegisterVariable (&d_prefill);
+
+	Cmd_AddCommand ("surfcachestats", D_SurfaceCacheStats_f);
+	Cmd_AddCommand ("timespans", D_TimeSpans_f);
 
 	r_drawpolys = false;
 	r_worldpolysbacktofront = false;
@@ -133,9 +138,6 @@ void D_SetupFrame (void)
 	else
 		screenwidth = vid.rowbytes;
 
-	d_roverwrapped = false;
-	d_initial_rover = sc_rover;
-
 	d_minmip = d_mipcap.value;
 	if (d_minmip > 3)
 		d_minmip = 3;
@@ -151,7 +153,19 @@ void D_SetupFrame (void)
 				else
 					d_drawspans = D_DrawSpans8;
 #else
-				d_drawspans = D_DrawSpans8;
+				if (d_subdiv16.value)
+					d_drawspans = D_DrawSpans16;
+				else
+					d_drawspans = D_DrawSpans8;
+#if	idsimd
+				if (d_simd.value)
+				{
+					if (d_subdiv16.value)
+						d_drawspans = D_DrawSpans16Vec;
+					else
+						d_drawspans = D_DrawSpans8Vec;
+				}
+#endif
 #endif
 
 	d_aflatcolor = 0;
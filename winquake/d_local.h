@@ -34,6 +34,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #define SURFCACHE_SIZE_AT_320X200	600*1024
 
+#define SURFCACHE_ALIGN			16
+#define SURFCACHE_MINCLASS		64		// smallest block of size class 1
+#define NUM_SURFCACHE_CLASSES	24
+
 typedef struct surfcache_s
 {
 	struct surfcache_s	*next;
@@ -45,6 +49,11 @@ typedef struct surfcache_s
 	unsigned			height;		// DEBUG only needed for debug
 	float				mipscale;
 	struct texture_s	*texture;	// checked for animating textures
+	int					framecount;	// r_framecount it was last built in
+	int					lastused;	// r_framecount it was last drawn in
+	struct surfcache_s	*prev;		// block before this one in memory
+	struct surfcache_s	*lnext, *lprev;	// size class list when free,
+										// eviction order when allocated
 	byte				data[4];	// width*height elements
 } surfcache_t;
 
@@ -55,23 +64,25 @@ typedef struct sspan_s
 } sspan_t;
 
 extern cvar_t	d_subdiv16;
+extern cvar_t	d_simd;
+extern cvar_t	d_prefill;
 
 extern float	scale_for_mip;
 
-extern qboolean		d_roverwrapped;
-extern surfcache_t	*sc_rover;
-extern surfcache_t	*d_initial_rover;
-
-extern float	d_sdivzstepu, d_tdivzstepu, d_zistepu;
-extern float	d_sdivzstepv, d_tdivzstepv, d_zistepv;
-extern float	d_sdivzorigin, d_tdivzorigin, d_ziorigin;
+extern THREADLOCAL float	d_sdivzstepu, d_tdivzstepu, d_zistepu;
+extern THREADLOCAL float	d_sdivzstepv, d_tdivzstepv, d_zistepv;
+extern THREADLOCAL float	d_sdivzorigin, d_tdivzorigin, d_ziorigin;
 
-extern fixed16_t	sadjust, tadjust;
-extern fixed16_t	bbextents, bbextentt;
+extern THREADLOCAL fixed16_t	sadjust, tadjust;
+extern THREADLOCAL fixed16_t	bbextents, bbextentt;
 
 
 void D_DrawSpans8 (espan_t *pspans);
 void D_DrawSpans16 (espan_t *pspans);
+#if	idsimd
+void D_DrawSpans8Vec (espan_t *pspans);
+void D_DrawSpans16Vec (espan_t *pspans);
+#endif
 void D_DrawZSpans (espan_t *pspans);
 void Turbulent8 (espan_t *pspan);
 void D_SpriteDrawSpans (sspan_t *pspan);
@@ -82,6 +93,15 @@ void D_DrawSkyScans16 (espan_t *pspan);
 void R_ShowSubDiv (void);
 extern void (*prealspandrawer)(void);
 surfcache_t	*D_CacheSurface (msurface_t *surface, int miplevel);
+surfcache_t	*D_FindCachedSurface (msurface_t *surface, int miplevel);
+surfcache_t	*D_CacheSurfaceBand (msurface_t *surface, int miplevel);
+void D_ReleaseSurfaceCache (void);
+void D_PrefillSurfaceCache (void);
+void D_SurfaceCacheStats_f (void);
+
+extern qboolean	d_recordspans;
+void D_RecordSpans (espan_t *pspan, surfcache_t *cache);
+void D_TimeSpans_f (void);
 
 extern int D_MipLevelForScale (float scale);
 
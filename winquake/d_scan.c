@@ -25,10 +25,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "r_local.h"
 #include "d_local.h"
 
-unsigned char	*r_turb_pbase, *r_turb_pdest;
-fixed16_t		r_turb_s, r_turb_t, r_turb_sstep, r_turb_tstep;
-int				*r_turb_turb;
-int				r_turb_spancount;
+THREADLOCAL unsigned char	*r_turb_pbase, *r_turb_pdest;
+THREADLOCAL fixed16_t	r_turb_s, r_turb_t, r_turb_sstep, r_turb_tstep;
+THREADLOCAL int			*r_turb_turb;
+THREADLOCAL int			r_turb_spancount;
 
 void D_DrawTurbulent8Span (void);
 
@@ -382,6 +382,335 @@ void D_DrawSpans8 (espan_t *pspan)
 	} while ((pspan = pspan->pnext) != NULL);
 }
 
+/*
+=============
+D_DrawSpans16
+
+D_DrawSpans8 with a perspective divide every 16 pixels
+=============
+*/
+void D_DrawSpans16 (espan_t *pspan)
+{
+	int				count, spancount;
+	unsigned char	*pbase, *pdest;
+	fixed16_t		s, t, snext, tnext, sstep, tstep;
+	float			sdivz, tdivz, zi, z, du, dv, spancountminus1;
+	float			sdivz16stepu, tdivz16stepu, zi16stepu;
+
+	sstep = 0;	// keep compiler happy
+	tstep = 0;	// ditto
+
+	pbase = (unsigned char *)cacheblock;
+
+	sdivz16stepu = d_sdivzstepu * 16;
+	tdivz16stepu = d_tdivzstepu * 16;
+	zi16stepu = d_zistepu * 16;
+
+	do
+	{
+		pdest = (unsigned char *)((byte *)d_viewbuffer +
+				(screenwidth * pspan->v) + pspan->u);
+
+		count = pspan->count;
+
+	// calculate the initial s/z, t/z, 1/z, s, and t and clamp
+		du = (float)pspan->u;
+		dv = (float)pspan->v;
+
+		sdivz = d_sdivzorigin + dv*d_sdivzstepv + du*d_sdivzstepu;
+		tdivz = d_tdivzorigin + dv*d_tdivzstepv + du*d_tdivzstepu;
+		zi = d_ziorigin + dv*d_zistepv + du*d_zistepu;
+		z = (float)0x10000 / zi;	// prescale to 16.16 fixed-point
+
+		s = (int)(sdivz * z) + sadjust;
+		if (s > bbextents)
+			s = bbextents;
+		else if (s < 0)
+			s = 0;
+
+		t = (int)(tdivz * z) + tadjust;
+		if (t > bbextentt)
+			t = bbextentt;
+		else if (t < 0)
+			t = 0;
+
+		do
+		{
+		// calculate s and t at the far end of the span
+			if (count >= 16)
+				spancount = 16;
+			else
+				spancount = count;
+
+			count -= spancount;
+
+			if (count)
+			{
+			// calculate s/z, t/z, zi->fixed s and t at far end of span,
+			// calculate s and t steps across span by shifting
+				sdivz += sdivz16stepu;
+				tdivz += tdivz16stepu;
+				zi += zi16stepu;
+				z = (float)0x10000 / zi;	// prescale to 16.16 fixed-point
+
+				snext = (int)(sdivz * z) + sadjust;
+				if (snext > bbextents)
+					snext = bbextents;
+				else if (snext < 16)
+					snext = 16;	// prevent round-off error on <0 steps from
+								//  from causing overstepping & running off the
+								//  edge of the texture
+
+				tnext = (int)(tdivz * z) + tadjust;
+				if (tnext > bbextentt)
+					tnext = bbextentt;
+				else if (tnext < 16)
+					tnext = 16;	// guard against round-off error on <0 steps
+
+				sstep = (snext - s) >> 4;
+				tstep = (tnext - t) >> 4;
+			}
+			else
+			{
+			// calculate s/z, t/z, zi->fixed s and t at last pixel in span (so
+			// can't step off polygon), clamp, calculate s and t steps across
+			// span by division, biasing steps low so we don't run off the
+			// texture
+				spancountminus1 = (float)(spancount - 1);
+				sdivz += d_sdivzstepu * spancountminus1;
+				tdivz += d_tdivzstepu * spancountminus1;
+				zi += d_zistepu * spancountminus1;
+				z = (float)0x10000 / zi;	// prescale to 16.16 fixed-point
+				snext = (int)(sdivz * z) + sadjust;
+				if (snext > bbextents)
+					snext = bbextents;
+				else if (snext < 16)
+					snext = 16;	// prevent round-off error on <0 steps from
+								//  from causing overstepping & running off the
+								//  edge of the texture
+
+				tnext = (int)(tdivz * z) + tadjust;
+				if (tnext > bbextentt)
+					tnext = bbextentt;
+				else if (tnext < 16)
+					tnext = 16;	// guard against round-off error on <0 steps
+
+				if (spancount > 1)
+				{
+					sstep = (snext - s) / (spancount - 1);
+					tstep = (tnext - t) / (spancount - 1);
+				}
+			}
+
+			do
+			{
+				*pdest++ = *(pbase + (s >> 16) + (t >> 16) * cachewidth);
+				s += sstep;
+				t += tstep;
+			} while (--spancount > 0);
+
+			s = snext;
+			t = tnext;
+
+		} while (count > 0);
+
+	} while ((pspan = pspan->pnext) != NULL);
+}
+
+#endif
+
+
+#if	idsimd
+
+/*
+=============
+D_DrawSpansVec
+
+D_DrawSpans8/16 with the texel offsets of a whole subdivision worked out
+four pixels at a time in vector registers, so only the texel fetches are
+left for the scalar loop.  subdivshift is 3 or 4 for a divide every 8 or
+16 pixels, the output is the same as the C versions
+=============
+*/
+static void D_DrawSpansVec (espan_t *pspan, int subdivshift)
+{
+	int				count, spancount, subdiv, width, i;
+	unsigned char	*pbase, *pdest;
+	fixed16_t		s, t, snext, tnext, sstep, tstep;
+	fixed16_t		sadj, tadj, smax, tmax;
+	float			sdivz, tdivz, zi, z, du, dv, spancountminus1;
+	float			sdivzstepu, tdivzstepu, zistepu;
+	float			sdivzsubstepu, tdivzsubstepu, zisubstepu;
+	vec4i_t			sv, tv;
+	int				offs[16] __attribute__ ((aligned (16)));
+	static const vec4i_t	lane = {0, 1, 2, 3};
+
+	sstep = 0;	// keep compiler happy
+	tstep = 0;	// ditto
+
+// the texel stores can alias any global, so keep the per surface values
+// in locals
+	pbase = (unsigned char *)cacheblock;
+	width = cachewidth;
+	sadj = sadjust;
+	tadj = tadjust;
+	smax = bbextents;
+	tmax = bbextentt;
+	sdivzstepu = d_sdivzstepu;
+	tdivzstepu = d_tdivzstepu;
+	zistepu = d_zistepu;
+
+	subdiv = 1 << subdivshift;
+	sdivzsubstepu = sdivzstepu * subdiv;
+	tdivzsubstepu = tdivzstepu * subdiv;
+	zisubstepu = zistepu * subdiv;
+
+	do
+	{
+		pdest = (unsigned char *)((byte *)d_viewbuffer +
+				(screenwidth * pspan->v) + pspan->u);
+
+		count = pspan->count;
+
+	// calculate the initial s/z, t/z, 1/z, s, and t and clamp
+		du = (float)pspan->u;
+		dv = (float)pspan->v;
+
+		sdivz = d_sdivzorigin + dv*d_sdivzstepv + du*sdivzstepu;
+		tdivz = d_tdivzorigin + dv*d_tdivzstepv + du*tdivzstepu;
+		zi = d_ziorigin + dv*d_zistepv + du*zistepu;
+		z = (float)0x10000 / zi;	// prescale to 16.16 fixed-point
+
+		s = (int)(sdivz * z) + sadj;
+		if (s > smax)
+			s = smax;
+		else if (s < 0)
+			s = 0;
+
+		t = (int)(tdivz * z) + tadj;
+		if (t > tmax)
+			t = tmax;
+		else if (t < 0)
+			t = 0;
+
+		do
+		{
+		// calculate s and t at the far end of the span, clamped the same
+		// way as in D_DrawSpans8/16
+			if (count >= subdiv)
+				spancount = subdiv;
+			else
+				spancount = count;
+
+			count -= spancount;
+
+			if (count)
+			{
+				sdivz += sdivzsubstepu;
+				tdivz += tdivzsubstepu;
+				zi += zisubstepu;
+				z = (float)0x10000 / zi;	// prescale to 16.16 fixed-point
+
+				snext = (int)(sdivz * z) + sadj;
+				if (snext > smax)
+					snext = smax;
+				else if (snext < subdiv)
+					snext = subdiv;
+
+				tnext = (int)(tdivz * z) + tadj;
+				if (tnext > tmax)
+					tnext = tmax;
+				else if (tnext < subdiv)
+					tnext = subdiv;
+
+				sstep = (snext - s) >> subdivshift;
+				tstep = (tnext - t) >> subdivshift;
+			}
+			else
+			{
+				spancountminus1 = (float)(spancount - 1);
+				sdivz += sdivzstepu * spancountminus1;
+				tdivz += tdivzstepu * spancountminus1;
+				zi += zistepu * spancountminus1;
+				z = (float)0x10000 / zi;	// prescale to 16.16 fixed-point
+
+				snext = (int)(sdivz * z) + sadj;
+				if (snext > smax)
+					snext = smax;
+				else if (snext < subdiv)
+					snext = subdiv;
+
+				tnext = (int)(tdivz * z) + tadj;
+				if (tnext > tmax)
+					tnext = tmax;
+				else if (tnext < subdiv)
+					tnext = subdiv;
+
+				if (spancount > 1)
+				{
+					sstep = (snext - s) / (spancount - 1);
+					tstep = (tnext - t) / (spancount - 1);
+				}
+			}
+
+		// texel offsets for the whole subdivision
+			sv = s + lane * sstep;
+			tv = t + lane * tstep;
+			for (i=0 ; i<spancount ; i+=4)
+			{
+				*(vec4i_t *)&offs[i] = (sv >> 16) + (tv >> 16) * width;
+				sv += sstep * 4;
+				tv += tstep * 4;
+			}
+
+			if (spancount == subdiv)
+			{
+				for (i=0 ; i<subdiv ; i+=4)
+				{
+					pdest[i] = pbase[offs[i]];
+					pdest[i+1] = pbase[offs[i+1]];
+					pdest[i+2] = pbase[offs[i+2]];
+					pdest[i+3] = pbase[offs[i+3]];
+				}
+			}
+			else
+			{
+				for (i=0 ; i<spancount ; i++)
+					pdest[i] = pbase[offs[i]];
+			}
+			pdest += spancount;
+
+			s = snext;
+			t = tnext;
+
+		} while (count > 0);
+
+	} while ((pspan = pspan->pnext) != NULL);
+}
+
+
+/*
+=============
+D_DrawSpans8Vec
+=============
+*/
+void D_DrawSpans8Vec (espan_t *pspan)
+{
+	D_DrawSpansVec (pspan, 3);
+}
+
+
+/*
+=============
+D_DrawSpans16Vec
+=============
+*/
+void D_DrawSpans16Vec (espan_t *pspan)
+{
+	D_DrawSpansVec (pspan, 4);
+}
+
+
 #endif
 
 
@@ -447,3 +776,232 @@ void D_DrawZSpans (espan_t *pspan)
 
 #endif
 
+
+
+/*
+==============================================================================
+
+SPAN REPLAY
+
+D_TimeSpans_f draws one frame with d_recordspans set, which makes
+D_DrawSurfaces hand every textured surface to D_RecordSpans.  Each record
+keeps the surface's gradients, a copy of its cache block and its spans, so
+the frame can be drawn again later by any of the span drawers.
+
+==============================================================================
+*/
+
+#define	SPANRECORD_SIZE		(1024*1024)
+
+typedef struct spanrecord_s
+{
+	int			size;			// including spans and texels
+	float		sdivzstepu, tdivzstepu, zistepu;
+	float		sdivzstepv, tdivzstepv, zistepv;
+	float		sdivzorigin, tdivzorigin, ziorigin;
+	fixed16_t	sadjust, tadjust;
+	fixed16_t	bbextents, bbextentt;
+	int			cachewidth;
+	espan_t		*spans;
+	pixel_t		*texels;
+} spanrecord_t;
+
+qboolean		d_recordspans;
+static byte		*spanrecords, *spanrecordsend, *spanrecordsp;
+static int		spanrecordsdropped;
+
+
+/*
+=============
+D_RecordSpans
+
+Keeps the spans that are about to be drawn from cache with the current
+gradients
+=============
+*/
+void D_RecordSpans (espan_t *pspan, surfcache_t *cache)
+{
+	spanrecord_t	*rec;
+	espan_t			*span, *out;
+	int				numspans, texels, size;
+
+	numspans = 0;
+	for (span=pspan ; span ; span=span->pnext)
+		numspans++;
+	texels = cache->width * cache->height;
+	size = (sizeof(*rec) + numspans * sizeof(espan_t) + texels * sizeof(pixel_t)
+			+ 15) & ~15;
+	if (!numspans || spanrecordsp + size > spanrecordsend)
+	{
+		spanrecordsdropped++;
+		return;
+	}
+
+	rec = (spanrecord_t *)spanrecordsp;
+	spanrecordsp += size;
+
+	rec->size = size;
+	rec->sdivzstepu = d_sdivzstepu;
+	rec->tdivzstepu = d_tdivzstepu;
+	rec->zistepu = d_zistepu;
+	rec->sdivzstepv = d_sdivzstepv;
+	rec->tdivzstepv = d_tdivzstepv;
+	rec->zistepv = d_zistepv;
+	rec->sdivzorigin = d_sdivzorigin;
+	rec->tdivzorigin = d_tdivzorigin;
+	rec->ziorigin = d_ziorigin;
+	rec->sadjust = sadjust;
+	rec->tadjust = tadjust;
+	rec->bbextents = bbextents;
+	rec->bbextentt = bbextentt;
+	rec->cachewidth = cache->width;
+
+	rec->spans = out = (espan_t *)(rec + 1);
+	for (span=pspan ; span ; span=span->pnext, out++)
+	{
+		out->u = span->u;
+		out->v = span->v;
+		out->count = span->count;
+		out->pnext = span->pnext ? out + 1 : NULL;
+	}
+
+	rec->texels = (pixel_t *)out;
+	Q_memcpy (rec->texels, cache->data, texels * sizeof(pixel_t));
+}
+
+
+/*
+=============
+D_ReplaySpans
+=============
+*/
+static double D_ReplaySpans (void (*drawer)(espan_t *pspan), pixel_t *dest,
+	int count)
+{
+	spanrecord_t	*rec;
+	byte			*p;
+	double			start;
+	int				i;
+
+	d_viewbuffer = dest;
+	start = Sys_FloatTime ();
+	for (i=0 ; i<count ; i++)
+	{
+		for (p=spanrecords ; p<spanrecordsp ; p+=rec->size)
+		{
+			rec = (spanrecord_t *)p;
+			d_sdivzstepu = rec->sdivzstepu;
+			d_tdivzstepu = rec->tdivzstepu;
+			d_zistepu = rec->zistepu;
+			d_sdivzstepv = rec->sdivzstepv;
+			d_tdivzstepv = rec->tdivzstepv;
+			d_zistepv = rec->zistepv;
+			d_sdivzorigin = rec->sdivzorigin;
+			d_tdivzorigin = rec->tdivzorigin;
+			d_ziorigin = rec->ziorigin;
+			sadjust = rec->sadjust;
+			tadjust = rec->tadjust;
+			bbextents = rec->bbextents;
+			bbextentt = rec->bbextentt;
+			cacheblock = rec->texels;
+			cachewidth = rec->cachewidth;
+			(*drawer) (rec->spans);
+		}
+	}
+	return Sys_FloatTime () - start;
+}
+
+
+/*
+=============
+D_TimeSpans_f
+
+For program optimization: records the textured spans of the current view,
+draws them again with the C and the vector span drawers at both
+subdivisions, and checks that both give the same pixels
+=============
+*/
+void D_TimeSpans_f (void)
+{
+	static const char	*names[2] = {"8", "16"};
+	void		(*cdrawers[2])(espan_t *pspan) = {D_DrawSpans8, D_DrawSpans16};
+#if	idsimd
+	void		(*vecdrawers[2])(espan_t *pspan) = {D_DrawSpans8Vec, D_DrawSpans16Vec};
+	pixel_t		*vec;
+	double		vectime;
+#endif
+	spanrecord_t	*rec;
+	espan_t		*span;
+	byte		*p;
+	pixel_t		*ref, *oldviewbuffer;
+	int			i, count, framebytes, numrecords, numspans, pixels;
+	double		time;
+
+	if (cls.state != ca_connected || !cl.worldmodel)
+	{
+		Con_Printf ("timespans: no map running\n");
+		return;
+	}
+	if (r_bands.value)
+	{
+		Con_Printf ("timespans: set r_bands 0 first\n");
+		return;
+	}
+
+	count = 20;
+	if (Cmd_Argc () > 1)
+		count = Q_atoi (Cmd_Argv (1));
+	if (count < 1)
+		count = 1;
+
+	framebytes = vid.rowbytes * vid.height;
+	spanrecords = Hunk_TempAlloc (SPANRECORD_SIZE + framebytes * 2);
+	spanrecordsend = spanrecords + SPANRECORD_SIZE;
+	spanrecordsp = spanrecords;
+	spanrecordsdropped = 0;
+	ref = (pixel_t *)spanrecordsend;
+
+	d_recordspans = true;
+	VID_LockBuffer ();
+	R_RenderView ();
+	VID_UnlockBuffer ();
+	d_recordspans = false;
+
+	numrecords = numspans = pixels = 0;
+	for (p=spanrecords ; p<spanrecordsp ; p+=rec->size)
+	{
+		rec = (spanrecord_t *)p;
+		numrecords++;
+		for (span=rec->spans ; span ; span=span->pnext)
+		{
+			numspans++;
+			pixels += span->count;
+		}
+	}
+	Con_Printf ("%i surfaces, %i spans, %i pixels", numrecords, numspans, pixels);
+	if (spanrecordsdropped)
+		Con_Printf (" (%i surfaces left out)", spanrecordsdropped);
+	Con_Printf ("\n");
+	if (!pixels)
+		return;
+
+	oldviewbuffer = d_viewbuffer;
+	for (i=0 ; i<2 ; i++)
+	{
+		Q_memset (ref, 0, framebytes);
+		time = D_ReplaySpans (cdrawers[i], ref, count);
+#if	idsimd
+		vec = ref + framebytes;
+		Q_memset (vec, 0, framebytes);
+		vectime = D_ReplaySpans (vecdrawers[i], vec, count);
+		Con_Printf ("subdiv %2s: C %6.1f Mpix/s, vector %6.1f Mpix/s (%4.2fx)%s\n",
+				names[i], (double)pixels * count / time / 1e6,
+				(double)pixels * count / vectime / 1e6, time / vectime,
+				Q_memcmp (ref, vec, framebytes) ? " MISMATCH" : "");
+#else
+		Con_Printf ("subdiv %2s: C %6.1f Mpix/s, no vector drawers in this build\n",
+				names[i], (double)pixels * count / time / 1e6);
+#endif
+	}
+	d_viewbuffer = oldviewbuffer;
+}
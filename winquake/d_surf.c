@@ -27,7 +27,14 @@ float           surfscale;
 qboolean        r_cache_thrash;         // set if surface cache is thrashing
 
 int                                     sc_size;
-surfcache_t                     *sc_rover, *sc_base;
+surfcache_t                     *sc_base;
+
+static surfcache_t              *sc_free[NUM_SURFCACHE_CLASSES];
+static surfcache_t              sc_used;        // ring of allocated blocks
+static int                      sc_numused;
+static surfcachestats_t         sc_stats;
+
+static void                     *sc_lock;       // held around band drawing
 
 #define GUARDSIZE       4
 
@@ -86,17 +93,189 @@ void D_InitCaches (void *buffer, int size)
 	if (!msg_suppress_1)
 		Con_Printf ("%ik surface cache\n", size/1024);
 
-	sc_size = size - GUARDSIZE;
+	if (!sc_lock)
+		sc_lock = Sys_LockCreate ();
+
+	sc_size = (size - GUARDSIZE) & ~(SURFCACHE_ALIGN - 1);
 	sc_base = (surfcache_t *)buffer;
-	sc_rover = sc_base;
-	
-	sc_base->next = NULL;
-	sc_base->owner = NULL;
-	sc_base->size = sc_size;
-	
+
 	D_ClearCacheGuard ();
+	D_FlushCaches ();
+}
+
+
+/*
+=============================================================================
+
+SURFACE CACHE ALLOCATOR
+
+Blocks tile the cache in address order through next / prev.  Free blocks
+are kept on one list per power of two size class, allocated blocks on a
+ring in the order they were allocated or last spared.  When nothing free
+is large enough, blocks are taken off the front of the ring and merged
+with their free neighbours until one is.  Blocks used in the last two
+frames are sent to the back of the ring instead, then only those used in
+this frame, so surfaces still on screen are only thrown out when the rest
+of the cache can't make room.
+
+=============================================================================
+*/
+
+static int D_SizeClass (int size)
+{
+	int		sizeclass;
+
+	sizeclass = 0;
+	while (size >= (SURFCACHE_MINCLASS << 1) << sizeclass
+		&& sizeclass < NUM_SURFCACHE_CLASSES - 1)
+		sizeclass++;
+
+	return sizeclass;
+}
+
+static void D_LinkFree (surfcache_t *c)
+{
+	surfcache_t		**head;
+
+	head = &sc_free[D_SizeClass (c->size)];
+	c->owner = NULL;
+	c->lprev = NULL;
+	c->lnext = *head;
+	if (*head)
+		(*head)->lprev = c;
+	*head = c;
+}
+
+static void D_UnlinkFree (surfcache_t *c)
+{
+	if (c->lprev)
+		c->lprev->lnext = c->lnext;
+	else
+		sc_free[D_SizeClass (c->size)] = c->lnext;
+	if (c->lnext)
+		c->lnext->lprev = c->lprev;
+}
+
+static void D_LinkUsed (surfcache_t *c)
+{
+	c->lnext = &sc_used;
+	c->lprev = sc_used.lprev;
+	sc_used.lprev->lnext = c;
+	sc_used.lprev = c;
+	sc_numused++;
+}
+
+static void D_UnlinkUsed (surfcache_t *c)
+{
+	c->lprev->lnext = c->lnext;
+	c->lnext->lprev = c->lprev;
+	sc_numused--;
+}
+
+/*
+=================
+D_FreeBlock
+
+Frees an allocated block and merges it with its free neighbours.  Returns
+the merged free block
+=================
+*/
+static surfcache_t *D_FreeBlock (surfcache_t *c)
+{
+	surfcache_t		*n;
+
+	if (c->owner)
+		*c->owner = NULL;
+	D_UnlinkUsed (c);
+
+	n = c->next;
+	if (n && !n->owner)
+	{
+		D_UnlinkFree (n);
+		c->size += n->size;
+		c->next = n->next;
+		if (c->next)
+			c->next->prev = c;
+	}
+
+	n = c->prev;
+	if (n && !n->owner)
+	{
+		D_UnlinkFree (n);
+		n->size += c->size;
+		n->next = c->next;
+		if (n->next)
+			n->next->prev = n;
+		c = n;
+	}
+
+	D_LinkFree (c);
+	return c;
+}
+
+/*
+=================
+D_FindFreeBlock
+
+First fit in the smallest size class that can hold size, any block of a
+larger class is big enough
+=================
+*/
+static surfcache_t *D_FindFreeBlock (int size)
+{
+	int				sizeclass;
+	surfcache_t		*c;
+
+	sizeclass = D_SizeClass (size);
+	for (c = sc_free[sizeclass] ; c ; c = c->lnext)
+		if (c->size >= size)
+			return c;
+
+	for (sizeclass++ ; sizeclass < NUM_SURFCACHE_CLASSES ; sizeclass++)
+		if (sc_free[sizeclass])
+			return sc_free[sizeclass];
+
+	return NULL;
 }
 
+/*
+=================
+D_EvictForBlock
+=================
+*/
+static surfcache_t *D_EvictForBlock (int size)
+{
+	int				spare, tries;
+	surfcache_t		*c;
+
+	for (spare = r_framecount - 1 ; spare <= r_framecount + 1 ; spare++)
+	{
+		for (tries = sc_numused ; tries > 0 && sc_numused ; tries--)
+		{
+			c = sc_used.lnext;
+			if (c->lastused >= spare)
+			{
+				D_UnlinkUsed (c);
+				D_LinkUsed (c);
+				continue;
+			}
+
+			sc_stats.evictions++;
+			if (c->lastused == r_framecount)
+			{
+				sc_stats.frameevictions++;
+				r_cache_thrash = true;
+			}
+
+			c = D_FreeBlock (c);
+			if (c->size >= size)
+				return c;
+		}
+	}
+
+	Sys_Error ("D_SCAlloc: no room for %i bytes", size);
+	return NULL;
+}
 
 /*
 ==================
@@ -110,16 +289,20 @@ void D_FlushCaches (void)
 	if (!sc_base)
 		return;
 
-	for (c = sc_base ; c ; c = c->next)
+	for (c = sc_used.lnext ; c && c != &sc_used ; c = c->lnext)
 	{
 		if (c->owner)
 			*c->owner = NULL;
 	}
-	
-	sc_rover = sc_base;
+
+	memset (sc_free, 0, sizeof(sc_free));
+	sc_used.lnext = sc_used.lprev = &sc_used;
+	sc_numused = 0;
+
 	sc_base->next = NULL;
-	sc_base->owner = NULL;
+	sc_base->prev = NULL;
 	sc_base->size = sc_size;
+	D_LinkFree (sc_base);
 }
 
 /*
@@ -129,8 +312,7 @@ D_SCAlloc
 */
 surfcache_t     *D_SCAlloc (int width, int size)
 {
-	surfcache_t             *new;
-	qboolean                wrapped_this_time;
+	surfcache_t             *new, *rest;
 
 	if ((width < 0) || (width > 256))
 		Sys_Error ("D_SCAlloc: bad cache width %d\n", width);
@@ -139,53 +321,29 @@ surfcache_t     *D_SCAlloc (int width, int size)
 		Sys_Error ("D_SCAlloc: bad cache size %d\n", size);
 	
 	size = (int)&((surfcache_t *)0)->data[size];
-	size = (size + 3) & ~3;
+	size = (size + SURFCACHE_ALIGN - 1) & ~(SURFCACHE_ALIGN - 1);
 	if (size > sc_size)
 		Sys_Error ("D_SCAlloc: %i > cache size",size);
 
-// if there is not size bytes after the rover, reset to the start
-	wrapped_this_time = false;
-
-	if ( !sc_rover || (byte *)sc_rover - (byte *)sc_base > sc_size - size)
-	{
-		if (sc_rover)
-		{
-			wrapped_this_time = true;
-		}
-		sc_rover = sc_base;
-	}
-		
-// colect and free surfcache_t blocks until the rover block is large enough
-	new = sc_rover;
-	if (sc_rover->owner)
-		*sc_rover->owner = NULL;
-	
-	while (new->size < size)
-	{
-	// free another
-		sc_rover = sc_rover->next;
-		if (!sc_rover)
-			Sys_Error ("D_SCAlloc: hit the end of memory");
-		if (sc_rover->owner)
-			*sc_rover->owner = NULL;
-			
-		new->size += sc_rover->size;
-		new->next = sc_rover->next;
-	}
+	new = D_FindFreeBlock (size);
+	if (!new)
+		new = D_EvictForBlock (size);
+	D_UnlinkFree (new);
 
 // create a fragment out of any leftovers
 	if (new->size - size > 256)
 	{
-		sc_rover = (surfcache_t *)( (byte *)new + size);
-		sc_rover->size = new->size - size;
-		sc_rover->next = new->next;
-		sc_rover->width = 0;
-		sc_rover->owner = NULL;
-		new->next = sc_rover;
+		rest = (surfcache_t *)( (byte *)new + size);
+		rest->size = new->size - size;
+		rest->width = 0;
+		rest->next = new->next;
+		rest->prev = new;
+		if (rest->next)
+			rest->next->prev = rest;
+		new->next = rest;
 		new->size = size;
+		D_LinkFree (rest);
 	}
-	else
-		sc_rover = new->next;
 	
 	new->width = width;
 // DEBUG
@@ -193,16 +351,8 @@ surfcache_t     *D_SCAlloc (int width, int size)
 		new->height = (size - sizeof(*new) + sizeof(new->data)) / width;
 
 	new->owner = NULL;              // should be set properly after return
-
-	if (d_roverwrapped)
-	{
-		if (wrapped_this_time || (sc_rover >= d_initial_rover))
-			r_cache_thrash = true;
-	}
-	else if (wrapped_this_time)
-	{       
-		d_roverwrapped = true;
-	}
+	new->lastused = r_framecount;
+	D_LinkUsed (new);
 
 D_CheckCacheGuard ();   // DEBUG
 	return new;
@@ -220,12 +370,64 @@ void D_SCDump (void)
 
 	for (test = sc_base ; test ; test = test->next)
 	{
-		if (test == sc_rover)
-			Sys_Printf ("ROVER:\n");
-		printf ("%p : %i bytes     %i width\n",test, test->size, test->width);
+		printf ("%p : %i bytes     %i width%s\n",test, test->size, test->width,
+				test->owner ? "" : " free");
 	}
 }
 
+
+/*
+=================
+D_SurfaceCacheStats
+
+Counters since startup, plus the current free space
+=================
+*/
+void D_SurfaceCacheStats (surfcachestats_t *stats)
+{
+	surfcache_t		*c;
+
+	*stats = sc_stats;
+	stats->size = sc_size;
+	stats->blocks = sc_numused;
+	stats->freebytes = stats->largestfree = stats->freeblocks = 0;
+
+	for (c = sc_base ; c ; c = c->next)
+	{
+		if (c->owner)
+			continue;
+		stats->freeblocks++;
+		stats->freebytes += c->size;
+		if (c->size > stats->largestfree)
+			stats->largestfree = c->size;
+	}
+}
+
+
+/*
+=================
+D_SurfaceCacheStats_f
+=================
+*/
+void D_SurfaceCacheStats_f (void)
+{
+	surfcachestats_t	stats;
+
+	D_SurfaceCacheStats (&stats);
+
+	Con_Printf ("%ik surface cache, %i blocks\n", stats.size / 1024,
+			stats.blocks);
+	Con_Printf ("%i lookups, %i builds, %.1f%% hit rate\n", stats.lookups,
+			stats.builds, stats.lookups ?
+			100.0 * (1.0 - (double)stats.builds / stats.lookups) : 0.0);
+	Con_Printf ("%i evictions, %i of them used in the same frame\n",
+			stats.evictions, stats.frameevictions);
+	Con_Printf ("%ik free in %i blocks, largest %ik, %.1f%% fragmented\n",
+			stats.freebytes / 1024, stats.freeblocks, stats.largestfree / 1024,
+			stats.freebytes ?
+			100.0 * (1.0 - (double)stats.largestfree / stats.freebytes) : 0.0);
+}
+
 //=============================================================================
 
 // if the num is not a power of 2, assume it will not repeat
@@ -258,21 +460,25 @@ int D_log2 (int num)
 
 /*
 ================
-D_CacheSurface
+D_PrepareSurface
+
+Fills in ds for building the surface and gives it a cache block.  Returns
+NULL if the cache already holds the surface as it should be drawn
 ================
 */
-surfcache_t *D_CacheSurface (msurface_t *surface, int miplevel)
+static surfcache_t *D_PrepareSurface (msurface_t *surface, int miplevel,
+	drawsurf_t *ds)
 {
 	surfcache_t     *cache;
 
 //
 // if the surface is animating or flashing, flush the cache
 //
-	r_drawsurf.texture = R_TextureAnimation (surface->texinfo->texture);
-	r_drawsurf.lightadj[0] = d_lightstylevalue[surface->styles[0]];
-	r_drawsurf.lightadj[1] = d_lightstylevalue[surface->styles[1]];
-	r_drawsurf.lightadj[2] = d_lightstylevalue[surface->styles[2]];
-	r_drawsurf.lightadj[3] = d_lightstylevalue[surface->styles[3]];
+	ds->texture = R_TextureAnimation (surface->texinfo->texture);
+	ds->lightadj[0] = d_lightstylevalue[surface->styles[0]];
+	ds->lightadj[1] = d_lightstylevalue[surface->styles[1]];
+	ds->lightadj[2] = d_lightstylevalue[surface->styles[2]];
+	ds->lightadj[3] = d_lightstylevalue[surface->styles[3]];
 	
 //
 // see if the cache holds apropriate data
@@ -280,29 +486,32 @@ surfcache_t *D_CacheSurface (msurface_t *surface, int miplevel)
 	cache = surface->cachespots[miplevel];
 
 	if (cache && !cache->dlight && surface->dlightframe != r_framecount
-			&& cache->texture == r_drawsurf.texture
-			&& cache->lightadj[0] == r_drawsurf.lightadj[0]
-			&& cache->lightadj[1] == r_drawsurf.lightadj[1]
-			&& cache->lightadj[2] == r_drawsurf.lightadj[2]
-			&& cache->lightadj[3] == r_drawsurf.lightadj[3] )
-		return cache;
+			&& cache->texture == ds->texture
+			&& cache->lightadj[0] == ds->lightadj[0]
+			&& cache->lightadj[1] == ds->lightadj[1]
+			&& cache->lightadj[2] == ds->lightadj[2]
+			&& cache->lightadj[3] == ds->lightadj[3] )
+	{
+		cache->lastused = r_framecount;
+		return NULL;
+	}
 
 //
 // determine shape of surface
 //
 	surfscale = 1.0 / (1<<miplevel);
-	r_drawsurf.surfmip = miplevel;
-	r_drawsurf.surfwidth = surface->extents[0] >> miplevel;
-	r_drawsurf.rowbytes = r_drawsurf.surfwidth;
-	r_drawsurf.surfheight = surface->extents[1] >> miplevel;
+	ds->surfmip = miplevel;
+	ds->surfwidth = surface->extents[0] >> miplevel;
+	ds->rowbytes = ds->surfwidth;
+	ds->surfheight = surface->extents[1] >> miplevel;
 	
 //
 // allocate memory if needed
 //
 	if (!cache)     // if a texture just animated, don't reallocate it
 	{
-		cache = D_SCAlloc (r_drawsurf.surfwidth,
-						   r_drawsurf.surfwidth * r_drawsurf.surfheight);
+		cache = D_SCAlloc (ds->surfwidth,
+						   ds->surfwidth * ds->surfheight);
 		surface->cachespots[miplevel] = cache;
 		cache->owner = &surface->cachespots[miplevel];
 		cache->mipscale = surfscale;
@@ -313,23 +522,206 @@ surfcache_t *D_CacheSurface (msurface_t *surface, int miplevel)
 	else
 		cache->dlight = 0;
 
-	r_drawsurf.surfdat = (pixel_t *)cache->data;
+	ds->surfdat = (pixel_t *)cache->data;
 	
-	cache->texture = r_drawsurf.texture;
-	cache->lightadj[0] = r_drawsurf.lightadj[0];
-	cache->lightadj[1] = r_drawsurf.lightadj[1];
-	cache->lightadj[2] = r_drawsurf.lightadj[2];
-	cache->lightadj[3] = r_drawsurf.lightadj[3];
+	cache->texture = ds->texture;
+	cache->lightadj[0] = ds->lightadj[0];
+	cache->lightadj[1] = ds->lightadj[1];
+	cache->lightadj[2] = ds->lightadj[2];
+	cache->lightadj[3] = ds->lightadj[3];
+
+	ds->surf = surface;
 
+	c_surf++;
+	sc_stats.builds++;
+	cache->framecount = r_framecount;
+	cache->lastused = r_framecount;
+
+	return cache;
+}
+
+
+/*
+================
+D_BuildSurface
+================
+*/
+static surfcache_t *D_BuildSurface (msurface_t *surface, int miplevel)
+{
 //
 // draw and light the surface texture
 //
-	r_drawsurf.surf = surface;
+	if (D_PrepareSurface (surface, miplevel, &r_drawsurf))
+		R_DrawSurface ();
 
-	c_surf++;
+	return surface->cachespots[miplevel];
+}
+
+
+/*
+================
+D_FindCachedSurface
+
+Returns the cached surface if it can be drawn this frame as it is, without
+touching any shared state but its use stamp
+================
+*/
+surfcache_t *D_FindCachedSurface (msurface_t *surface, int miplevel)
+{
+	surfcache_t     *cache;
+	int             i;
+
+	cache = surface->cachespots[miplevel];
+	if (!cache)
+		return NULL;
+
+	if (cache->texture != R_TextureAnimation (surface->texinfo->texture))
+		return NULL;
+
+	for (i=0 ; i<MAXLIGHTMAPS ; i++)
+		if (cache->lightadj[i] != d_lightstylevalue[surface->styles[i]])
+			return NULL;
+
+// D_BuildSurface relights dynamic lit surfaces every time, but their
+// lighting doesn't change within a frame
+	if ((cache->dlight || surface->dlightframe == r_framecount)
+			&& cache->framecount != r_framecount)
+		return NULL;
+
+	THREADSAFE_SET (cache->lastused, r_framecount);
+	return cache;
+}
+
+
+/*
+================
+D_CacheSurface
+================
+*/
+surfcache_t *D_CacheSurface (msurface_t *surface, int miplevel)
+{
+	surfcache_t     *cache;
+
+	sc_stats.lookups++;
+
+	cache = D_FindCachedSurface (surface, miplevel);
+	if (cache)
+		return cache;
+
+	return D_BuildSurface (surface, miplevel);
+}
+
+
+/*
+================
+D_CacheSurfaceBand
+
+D_CacheSurface for bands drawn on worker threads.  Returns with the surface
+cache locked, shared if the surface was already cached or exclusive if it
+had to be built, so no other band can evict or rebuild it while its spans
+are drawn.  D_ReleaseSurfaceCache unlocks it.
+================
+*/
+surfcache_t *D_CacheSurfaceBand (msurface_t *surface, int miplevel)
+{
+	surfcache_t     *cache;
+
+	THREADSAFE_INC (sc_stats.lookups);
+
+	Sys_LockShared (sc_lock);
+	cache = D_FindCachedSurface (surface, miplevel);
+	if (cache)
+		return cache;
+	Sys_Unlock (sc_lock);
+
+	Sys_LockExclusive (sc_lock);
+	cache = D_FindCachedSurface (surface, miplevel);
+	if (cache)
+		return cache;		// another band built it meanwhile
+
+	return D_BuildSurface (surface, miplevel);
+}
+
+
+/*
+================
+D_ReleaseSurfaceCache
+================
+*/
+void D_ReleaseSurfaceCache (void)
+{
+	Sys_Unlock (sc_lock);
+}
+
+
+/*
+================
+D_PrefillSurfaceCache
+
+Builds the surfaces that have spans waiting to be drawn but are missing or
+stale in the cache, spread over the worker threads, so D_DrawSurfaces finds
+them all cached.  The cache blocks are handed out up front, so the workers
+only light and write their own block.  Submodel surfaces are left to be
+built as they are drawn, as the same surface can show up once per entity
+================
+*/
+#define	MAX_PREFILL_SURFS	256
+
+static drawsurf_t	prefillsurfs[MAX_PREFILL_SURFS];
+
+static void D_PrefillSurface (int job, void *arg)
+{
+	r_drawsurf = prefillsurfs[job];
 	R_DrawSurface ();
+}
 
-	return surface->cachespots[miplevel];
+void D_PrefillSurfaceCache (void)
+{
+	surf_t			*s;
+	msurface_t		*pface;
+	surfcache_t		*cache;
+	int				i, count, miplevel, size, totalsize;
+
+	if (!d_prefill.value || Sys_NumWorkers () < 2)
+		return;
+
+	count = 0;
+	totalsize = 0;
+	for (s = &surfaces[1] ; s<surface_p && count<MAX_PREFILL_SURFS ; s++)
+	{
+		if (!s->spans || s->insubmodel ||
+			(s->flags & (SURF_DRAWSKY | SURF_DRAWBACKGROUND | SURF_DRAWTURB)))
+			continue;
+
+		pface = s->data;
+		miplevel = D_MipLevelForScale (s->nearzi * scale_for_mip
+				* pface->texinfo->mipadjust);
+
+		if (D_FindCachedSurface (pface, miplevel))
+			continue;
+
+	// don't let the batch evict its own blocks
+		size = (pface->extents[0] >> miplevel) * (pface->extents[1] >> miplevel);
+		totalsize += size + sizeof(surfcache_t);
+		if (totalsize > sc_size / 2)
+			break;
+
+		if (D_PrepareSurface (pface, miplevel, &prefillsurfs[count]))
+			count++;
+	}
+
+// a later allocation can still have evicted an earlier block, leave those
+// to be built again as they are drawn
+	for (i=0 ; i<count ; )
+	{
+		cache = prefillsurfs[i].surf->cachespots[prefillsurfs[i].surfmip];
+		if (!cache || (pixel_t *)cache->data != prefillsurfs[i].surfdat)
+			prefillsurfs[i] = prefillsurfs[--count];
+		else
+			i++;
+	}
+
+	Sys_RunWorkers (count, D_PrefillSurface, NULL);
 }
 
 
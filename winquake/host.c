@@ -134,6 +134,8 @@ void Host_Error (char *error, ...)
 	vsprintf (string,error,argptr);
 	va_end (argptr);
 	Con_Printf ("Host_Error: %s\n",string);
+
+	NET_EndBatch ();		// in case it was in the middle of a server frame
 	
 	if (sv.active)
 		Host_ShutdownServer (false);
@@ -201,6 +203,30 @@ void	Host_FindMaxClients (void)
 }
 
 
+/*
+=======================
+Host_CpuStats_f
+
+How much of the time since startup went into frames, as opposed to waiting
+for the next one
+======================
+*/
+static double	host_starttime;
+static double	host_busytime;
+static int		host_busyframes;
+
+void Host_CpuStats_f (void)
+{
+	double	elapsed;
+
+	elapsed = Sys_FloatTime () - host_starttime;
+	if (!host_busyframes || elapsed <= 0)
+		return;
+	Con_Printf ("%i frames in %.1f s\n", host_busyframes, elapsed);
+	Con_Printf ("%.3f ms per frame, busy %.1f%% of the time\n",
+		host_busytime * 1000 / host_busyframes, host_busytime * 100 / elapsed);
+}
+
 /*
 =======================
 Host_InitLocal
@@ -209,6 +235,7 @@ Host_InitLocal
 void Host_InitLocal (void)
 {
 	Host_InitCommands ();
+	Cmd_AddCommand ("cpustats", Host_CpuStats_f);
 	
 	Cvar_RegisterVariable (&host_framerate);
 	Cvar_RegisterVariable (&host_speeds);
@@ -233,6 +260,7 @@ void Host_InitLocal (void)
 	Host_FindMaxClients ();
 	
 	host_time = 1.0;		// so a think at time 0 won't get called
+	host_starttime = Sys_FloatTime ();
 }
 
 
@@ -479,6 +507,7 @@ void Host_ClearMemory (void)
 	Con_DPrintf ("Clearing memory\n");
 	D_FlushCaches ();
 	Mod_ClearAll ();
+	COM_FlushFileIndex ();
 	if (host_hunklevel)
 		Hunk_FreeToLowMark (host_hunklevel);
 
@@ -573,6 +602,9 @@ void Host_ServerFrame (void)
 // run the world state	
 	pr_global_struct->frametime = host_frametime;
 
+// hold on to the packets of this frame and write them out together
+	NET_BeginBatch ();
+
 // set the time and clear the general datagram
 	SV_ClearDatagram ();
 	
@@ -593,6 +625,8 @@ void Host_ServerFrame (void)
 
 // send all messages to the clients
 	SV_SendClientMessages ();
+
+	NET_EndBatch ();
 }
 
 #else
@@ -602,6 +636,9 @@ void Host_ServerFrame (void)
 // run the world state	
 	pr_global_struct->frametime = host_frametime;
 
+// hold on to the packets of this frame and write them out together
+	NET_BeginBatch ();
+
 // set the time and clear the general datagram
 	SV_ClearDatagram ();
 	
@@ -618,6 +655,8 @@ void Host_ServerFrame (void)
 
 // send all messages to the clients
 	SV_SendClientMessages ();
+
+	NET_EndBatch ();
 }
 
 #endif
@@ -733,15 +772,15 @@ void Host_Frame (float time)
 	static int		timecount;
 	int		i, c, m;
 
-	if (!serverprofile.value)
-	{
-		_Host_Frame (time);
-		return;
-	}
-	
 	time1 = Sys_FloatTime ();
 	_Host_Frame (time);
 	time2 = Sys_FloatTime ();	
+
+	host_busytime += time2 - time1;
+	host_busyframes++;
+
+	if (!serverprofile.value)
+		return;
 	
 	timetotal += time2 - time1;
 	timecount++;
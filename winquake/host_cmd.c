@@ -693,6 +693,7 @@ void Host_Loadgame_f (void)
 	
 	sv.num_edicts = entnum;
 	sv.time = time;
+	SV_WakeAllEdicts ();
 
 	fclose (f);
 
@@ -853,6 +854,7 @@ int LoadGamestate(char *level, char *startspot)
 	
 //	sv.num_edicts = entnum;
 	sv.time = time;
+	SV_WakeAllEdicts ();
 	fclose (f);
 
 //	for (i=0 ; i<NUM_SPAWN_PARMS ; i++)
@@ -1388,6 +1390,7 @@ void Host_Spawn_f (void)
 		MSG_WriteAngle (&host_client->message, ent->v.angles[i] );
 	MSG_WriteAngle (&host_client->message, 0 );
 
+	SV_SetIdealPitch ();		// how much to look up / down ideally
 	SV_WriteClientdataToMessage (sv_player, &host_client->message);
 
 	MSG_WriteByte (&host_client->message, svc_signonnum);
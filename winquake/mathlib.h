@@ -27,6 +27,20 @@ typedef	int	fixed4_t;
 typedef	int	fixed8_t;
 typedef	int	fixed16_t;
 
+#if idsimd
+typedef int	vec4i_t __attribute__ ((vector_size (16)));
+typedef float	vec4f_t __attribute__ ((vector_size (16)));
+typedef unsigned short	vec8us_t __attribute__ ((vector_size (16)));
+typedef unsigned char	vec16ub_t __attribute__ ((vector_size (16)));
+
+// lane i of the result is lane n of a:b, n taken from the constant indices
+#ifdef __clang__
+#define	VEC_SHUFFLE(a,b,...)	__builtin_shufflevector (a, b, __VA_ARGS__)
+#else
+#define	VEC_SHUFFLE(a,b,...)	__builtin_shuffle (a, b, (__typeof__ (a)){__VA_ARGS__})
+#endif
+#endif
+
 #ifndef M_PI
 #define M_PI		3.14159265358979323846	// matches value in gcc v2 math.h
 #endif
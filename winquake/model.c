@@ -27,13 +27,14 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 model_t	*loadmodel;
 char	loadname[32];	// for hunk tags
+qboolean	mod_mapped;		// the file is a mapped pak, read only
 
 void Mod_LoadSpriteModel (model_t *mod, void *buffer);
 void Mod_LoadBrushModel (model_t *mod, void *buffer);
 void Mod_LoadAliasModel (model_t *mod, void *buffer);
 model_t *Mod_LoadModel (model_t *mod, qboolean crash);
 
-byte	mod_novis[MAX_MAP_LEAFS/8];
+unsigned	mod_novis[MAX_MAP_LEAFS/32];	// words, so rows can be read a word at a time
 
 #define	MAX_MOD_KNOWN	256
 model_t	mod_known[MAX_MOD_KNOWN];
@@ -110,17 +111,19 @@ mleaf_t *Mod_PointInLeaf (vec3_t p, model_t *model)
 /*
 ===================
 Mod_DecompressVis
+
+The row is word aligned
 ===================
 */
 byte *Mod_DecompressVis (byte *in, model_t *model)
 {
-	static byte	decompressed[MAX_MAP_LEAFS/8];
+	static THREADLOCAL unsigned	decompressed[MAX_MAP_LEAFS/32];
 	int		c;
 	byte	*out;
 	int		row;
 
 	row = (model->numleafs+7)>>3;	
-	out = decompressed;
+	out = (byte *)decompressed;
 
 	if (!in)
 	{	// no vis info, so make all visible
@@ -129,7 +132,7 @@ byte *Mod_DecompressVis (byte *in, model_t *model)
 			*out++ = 0xff;
 			row--;
 		}
-		return decompressed;		
+		return (byte *)decompressed;		
 	}
 
 	do
@@ -147,15 +150,15 @@ byte *Mod_DecompressVis (byte *in, model_t *model)
 			*out++ = 0;
 			c--;
 		}
-	} while (out - decompressed < row);
+	} while (out - (byte *)decompressed < row);
 	
-	return decompressed;
+	return (byte *)decompressed;
 }
 
 byte *Mod_LeafPVS (mleaf_t *leaf, model_t *model)
 {
 	if (leaf == model->leafs)
-		return mod_novis;
+		return (byte *)mod_novis;
 	return Mod_DecompressVis (leaf->compressed_vis, model);
 }
 
@@ -279,7 +282,18 @@ model_t *Mod_LoadModel (model_t *mod, qboolean crash)
 //
 // load the file
 //
-	buf = (unsigned *)COM_LoadStackFile (mod->name, stackbuf, sizeof(stackbuf));
+// brush models can use a mapped pak in place, the rest are changed as
+// they are loaded
+	buf = NULL;
+	if (!strcmp (COM_FileExtension (mod->name), "bsp"))
+		buf = (unsigned *)COM_MapFile (mod->name, NULL);
+	if (buf && (LittleLong(*buf) == IDPOLYHEADER
+		|| LittleLong(*buf) == IDSPRITEHEADER))
+		buf = NULL;
+	mod_mapped = buf != NULL;
+
+	if (!buf)
+		buf = (unsigned *)COM_LoadStackFile (mod->name, stackbuf, sizeof(stackbuf));
 	if (!buf)
 	{
 		if (crash)
@@ -354,7 +368,7 @@ Mod_LoadTextures
 */
 void Mod_LoadTextures (lump_t *l)
 {
-	int		i, j, pixels, num, max, altmax;
+	int		i, j, pixels, num, max, altmax, nummiptex, dataofs;
 	miptex_t	*mt;
 	texture_t	*tx, *tx2;
 	texture_t	*anims[10];
@@ -368,35 +382,44 @@ void Mod_LoadTextures (lump_t *l)
 	}
 	m = (dmiptexlump_t *)(mod_base + l->fileofs);
 	
-	m->nummiptex = LittleLong (m->nummiptex);
+	nummiptex = LittleLong (m->nummiptex);
 	
-	loadmodel->numtextures = m->nummiptex;
-	loadmodel->textures = Hunk_AllocName (m->nummiptex * sizeof(*loadmodel->textures) , loadname);
+	loadmodel->numtextures = nummiptex;
+	loadmodel->textures = Hunk_AllocName (nummiptex * sizeof(*loadmodel->textures) , loadname);
 
-	for (i=0 ; i<m->nummiptex ; i++)
+	for (i=0 ; i<nummiptex ; i++)
 	{
-		m->dataofs[i] = LittleLong(m->dataofs[i]);
-		if (m->dataofs[i] == -1)
+		dataofs = LittleLong(m->dataofs[i]);
+		if (dataofs == -1)
 			continue;
-		mt = (miptex_t *)((byte *)m + m->dataofs[i]);
-		mt->width = LittleLong (mt->width);
-		mt->height = LittleLong (mt->height);
-		for (j=0 ; j<MIPLEVELS ; j++)
-			mt->offsets[j] = LittleLong (mt->offsets[j]);
+		mt = (miptex_t *)((byte *)m + dataofs);
 		
-		if ( (mt->width & 15) || (mt->height & 15) )
+		if ( (LittleLong (mt->width) & 15) || (LittleLong (mt->height) & 15) )
 			Sys_Error ("Texture %s is not 16 aligned", mt->name);
-		pixels = mt->width*mt->height/64*85;
-		tx = Hunk_AllocName (sizeof(texture_t) +pixels, loadname );
+		pixels = LittleLong (mt->width)*LittleLong (mt->height)/64*85;
+
+	// a mapped pak can hold the pixels for us
+		if (mod_mapped)
+		{
+			tx = Hunk_AllocName (sizeof(texture_t), loadname );
+			tx->pixels = (byte *)mt;
+			for (j=0 ; j<MIPLEVELS ; j++)
+				tx->offsets[j] = LittleLong (mt->offsets[j]);
+		}
+		else
+		{
+			tx = Hunk_AllocName (sizeof(texture_t) +pixels, loadname );
+			tx->pixels = (byte *)tx;
+			for (j=0 ; j<MIPLEVELS ; j++)
+				tx->offsets[j] = LittleLong (mt->offsets[j]) + sizeof(texture_t) - sizeof(miptex_t);
+			// the pixels immediately follow the structures
+			memcpy ( tx+1, mt+1, pixels);
+		}
 		loadmodel->textures[i] = tx;
 
 		memcpy (tx->name, mt->name, sizeof(tx->name));
-		tx->width = mt->width;
-		tx->height = mt->height;
-		for (j=0 ; j<MIPLEVELS ; j++)
-			tx->offsets[j] = mt->offsets[j] + sizeof(texture_t) - sizeof(miptex_t);
-		// the pixels immediately follow the structures
-		memcpy ( tx+1, mt+1, pixels);
+		tx->width = LittleLong (mt->width);
+		tx->height = LittleLong (mt->height);
 		
 		if (!Q_strncmp(mt->name,"sky",3))	
 			R_InitSky (tx);
@@ -405,7 +428,7 @@ void Mod_LoadTextures (lump_t *l)
 //
 // sequence the animations
 //
-	for (i=0 ; i<m->nummiptex ; i++)
+	for (i=0 ; i<nummiptex ; i++)
 	{
 		tx = loadmodel->textures[i];
 		if (!tx || tx->name[0] != '+')
@@ -438,7 +461,7 @@ void Mod_LoadTextures (lump_t *l)
 		else
 			Sys_Error ("Bad animating texture %s", tx->name);
 
-		for (j=i+1 ; j<m->nummiptex ; j++)
+		for (j=i+1 ; j<nummiptex ; j++)
 		{
 			tx2 = loadmodel->textures[j];
 			if (!tx2 || tx2->name[0] != '+')
@@ -508,6 +531,11 @@ void Mod_LoadLighting (lump_t *l)
 		loadmodel->lightdata = NULL;
 		return;
 	}
+	if (mod_mapped)
+	{
+		loadmodel->lightdata = mod_base + l->fileofs;
+		return;
+	}
 	loadmodel->lightdata = Hunk_AllocName ( l->filelen, loadname);	
 	memcpy (loadmodel->lightdata, mod_base + l->fileofs, l->filelen);
 }
@@ -525,6 +553,11 @@ void Mod_LoadVisibility (lump_t *l)
 		loadmodel->visdata = NULL;
 		return;
 	}
+	if (mod_mapped)
+	{
+		loadmodel->visdata = mod_base + l->fileofs;
+		return;
+	}
 	loadmodel->visdata = Hunk_AllocName ( l->filelen, loadname);	
 	memcpy (loadmodel->visdata, mod_base + l->fileofs, l->filelen);
 }
@@ -936,6 +969,37 @@ void Mod_LoadLeafs (lump_t *l)
 	}	
 }
 
+/*
+=================
+Mod_FlattenHull
+
+Copies the plane of every clipnode next to its children, one array per
+field, so the hull trace reads a few packed arrays instead of following
+each clipnode to its plane
+=================
+*/
+static void Mod_FlattenHull (hull_t *hull, int count)
+{
+	dclipnode_t	*in;
+	mplane_t	*plane;
+	int			i;
+
+	hull->node_children = Hunk_AllocName (count*sizeof(*hull->node_children), loadname);
+	hull->node_dist = Hunk_AllocName (count*sizeof(*hull->node_dist), loadname);
+	hull->node_normal = Hunk_AllocName (count*sizeof(*hull->node_normal), loadname);
+	hull->node_type = Hunk_AllocName (count*sizeof(*hull->node_type), loadname);
+
+	for (i=0, in=hull->clipnodes ; i<count ; i++, in++)
+	{
+		plane = hull->planes + in->planenum;
+		hull->node_children[i][0] = in->children[0];
+		hull->node_children[i][1] = in->children[1];
+		hull->node_dist[i] = plane->dist;
+		VectorCopy (plane->normal, hull->node_normal[i]);
+		hull->node_type[i] = plane->type;
+	}
+}
+
 /*
 =================
 Mod_LoadClipnodes
@@ -986,6 +1050,13 @@ void Mod_LoadClipnodes (lump_t *l)
 		out->children[0] = LittleShort(in->children[0]);
 		out->children[1] = LittleShort(in->children[1]);
 	}
+
+	hull = &loadmodel->hulls[1];
+	Mod_FlattenHull (hull, count);
+	loadmodel->hulls[2].node_children = hull->node_children;
+	loadmodel->hulls[2].node_dist = hull->node_dist;
+	loadmodel->hulls[2].node_normal = hull->node_normal;
+	loadmodel->hulls[2].node_type = hull->node_type;
 }
 
 /*
@@ -1025,6 +1096,8 @@ void Mod_MakeHull0 (void)
 				out->children[j] = child - loadmodel->nodes;
 		}
 	}
+
+	Mod_FlattenHull (hull, count);
 }
 
 /*
@@ -1143,22 +1216,21 @@ Mod_LoadBrushModel
 void Mod_LoadBrushModel (model_t *mod, void *buffer)
 {
 	int			i, j;
-	dheader_t	*header;
+	dheader_t	*header, swapped;
 	dmodel_t 	*bm;
 	
 	loadmodel->type = mod_brush;
 	
-	header = (dheader_t *)buffer;
-
-	i = LittleLong (header->version);
+	i = LittleLong (((dheader_t *)buffer)->version);
 	if (i != BSPVERSION)
 		Sys_Error ("Mod_LoadBrushModel: %s has wrong version number (%i should be %i)", mod->name, i, BSPVERSION);
 
-// swap all the lumps
-	mod_base = (byte *)header;
+// swap all the lumps, into a copy as the buffer may be read only
+	mod_base = (byte *)buffer;
+	header = &swapped;
 
 	for (i=0 ; i<sizeof(dheader_t)/4 ; i++)
-		((int *)header)[i] = LittleLong ( ((int *)header)[i]);
+		((int *)header)[i] = LittleLong ( ((int *)buffer)[i]);
 
 // load into heap
 	
@@ -74,6 +74,7 @@ typedef struct texture_s
 	struct texture_s *anim_next;		// in the animation sequence
 	struct texture_s *alternate_anims;	// bmodels in frmae 1 use these
 	unsigned	offsets[MIPLEVELS];		// four mip maps stored
+	byte		*pixels;				// offsets are from here
 } texture_t;
 
 
@@ -174,6 +175,13 @@ typedef struct
 	int			lastclipnode;
 	vec3_t		clip_mins;
 	vec3_t		clip_maxs;
+
+// the clipnodes again with their planes folded in, one array per field,
+// for the hull trace in world.c
+	short		(*node_children)[2];
+	float		*node_dist;
+	vec3_t		*node_normal;
+	byte		*node_type;
 } hull_t;
 
 /*
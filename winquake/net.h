@@ -44,6 +44,13 @@ struct qsockaddr
 
 #define NET_PROTOCOL_VERSION	3
 
+// extensions to the datagram protocol, offered by the client after the game
+// protocol in CCREQ_CONNECT and accepted by the server after the port in
+// CCREP_ACCEPT
+#define NETEXT_WINDOW		1		// all fragments of a reliable message in flight
+
+#define NET_WINDOW			(NET_MAXMESSAGE / MAX_DATAGRAM)	// fragments
+
 // This is the network info/connection protocol.  It is used to find Quake
 // servers, get info about them, and connect to them.  Once connected, the
 // Quake game protocol (documented elsewhere) is used.
@@ -56,6 +63,8 @@ struct qsockaddr
 // CCREQ_CONNECT
 //		string	game_name				"QUAKE"
 //		byte	net_protocol_version	NET_PROTOCOL_VERSION
+//		byte	max_game_protocol		optional
+//		byte	net_extensions			optional, NETEXT_* bits
 //
 // CCREQ_SERVER_INFO
 //		string	game_name				"QUAKE"
@@ -71,6 +80,7 @@ struct qsockaddr
 //
 // CCREP_ACCEPT
 //		long	port
+//		byte	net_extensions			optional, the NETEXT_* bits in use
 //
 // CCREP_REJECT
 //		string	reason
@@ -116,6 +126,13 @@ struct qsockaddr
 #define CCREP_PLAYER_INFO	0x84
 #define CCREP_RULE_INFO		0x85
 
+// packets waiting for a connection, see net_dgrm.c
+typedef struct
+{
+	struct demuxpacket_s	*head, *tail;
+	int						count;
+} demuxqueue_t;
+
 typedef struct qsocket_s
 {
 	struct qsocket_s	*next;
@@ -146,12 +163,51 @@ typedef struct qsocket_s
 	struct qsockaddr	addr;
 	char				address[NET_NAMELEN];
 
+	int				maxprotocol;	// highest game protocol the client offered
+
+// windowed reliable messages (NETEXT_WINDOW).  Every fragment of sendMessage
+// goes out at once and is acked and resent on its own; ackSequence is the
+// sequence of the first fragment and receiveSequence that of the first
+// fragment of the message being received.
+	qboolean		windowed;
+	int				sendFragments;
+	int				sendAcked;			// bit for each fragment acked
+	int				sendResent;			// bit for each fragment sent again
+	double			sendTime[NET_WINDOW];	// when each fragment was last sent
+	double			rtt, rttvar;		// smoothed round trip time, 0 until measured
+	double			rto;				// retransmit timeout
+	int				receiveHave;		// bit for each fragment held
+	int				receiveLast;		// fragment with NETFLAG_EOM, or -1
+
+// server connections that share the accept socket get their packets from
+// the datagram driver, which sorts what arrives on it by address
+	qboolean		shared;
+	struct qsocket_s	*hashNext;
+	demuxqueue_t	demux;
+
+// the loopback driver leaves messages in receiveMessage until they have been
+// read: the ones from receiveMessageStart to receiveMessageLength are still
+// in use, and the first receiveMessageHeld bytes of them are the message that
+// net_message is looking at
+	int				receiveMessageStart;
+	int				receiveMessageHeld;
+
 } qsocket_t;
 
 extern qsocket_t	*net_activeSockets;
 extern qsocket_t	*net_freeSockets;
 extern int			net_numsockets;
 
+#define	MAX_NET_BATCH	32
+
+// one datagram of a batch read or written by a lan driver
+typedef struct
+{
+	struct qsockaddr	addr;
+	int					length;
+	byte				*data;		// NET_DATAGRAMSIZE bytes
+} netpacket_t;
+
 typedef struct
 {
 	char		*name;
@@ -175,6 +231,9 @@ typedef struct
 	int			(*AddrCompare) (struct qsockaddr *addr1, struct qsockaddr *addr2);
 	int			(*GetSocketPort) (struct qsockaddr *addr);
 	int			(*SetSocketPort) (struct qsockaddr *addr, int port);
+	int			(*ReadBatch) (int socket, netpacket_t *packets, int count);
+	int			(*WriteBatch) (int socket, netpacket_t *packets, int count);
+	int			(*Wait) (double seconds);
 } net_landriver_t;
 
 #define	MAX_NET_DRIVERS		8
@@ -197,6 +256,8 @@ typedef struct
 	qboolean	(*CanSendUnreliableMessage) (qsocket_t *sock);
 	void		(*Close) (qsocket_t *sock);
 	void		(*Shutdown) (void);
+	void		(*Flush) (void);
+	qboolean	(*Sleep) (double seconds);
 	int			controlSock;
 } net_driver_t;
 
@@ -297,6 +358,25 @@ int			NET_SendUnreliableMessage (struct qsocket_s *sock, sizebuf_t *data);
 int			NET_SendToAll(sizebuf_t *data, int blocktime);
 // This is a reliable *blocking* send to all attached clients.
 
+void		NET_ViewMessage (void *data, int length);
+void		NET_ReleaseMessage (void);
+// A driver can hand out a message by making net_message a view of it.  The
+// view lasts until the next call that reads into net_message, or until the
+// driver releases it.
+
+extern	qboolean	net_batching;
+
+void		NET_BeginBatch (void);
+void		NET_EndBatch (void);
+// Between these, drivers may hold on to the packets they are given and
+// write them out together from NET_EndBatch.  The server brackets each
+// frame with them.
+
+qboolean	NET_Sleep (double seconds);
+// Waits for up to seconds, or until packets arrive for the server, which
+// are then read and kept for the next frame.  Returns false if there was
+// nothing to wait on.
+
 
 void		NET_Close (struct qsocket_s *sock);
 // if a dead connection is returned by a get or send function, this function
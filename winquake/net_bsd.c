@@ -55,7 +55,9 @@ net_driver_t net_drivers[MAX_NET_DRIVERS] =
 	Datagram_CanSendMessage,
 	Datagram_CanSendUnreliableMessage,
 	Datagram_Close,
-	Datagram_Shutdown
+	Datagram_Shutdown,
+	Datagram_Flush,
+	Datagram_Sleep
 	}
 };
 
@@ -86,7 +88,10 @@ net_landriver_t	net_landrivers[MAX_NET_DRIVERS] =
 	UDP_GetAddrFromName,
 	UDP_AddrCompare,
 	UDP_GetSocketPort,
-	UDP_SetSocketPort
+	UDP_SetSocketPort,
+	UDP_ReadBatch,
+	UDP_WriteBatch,
+	UDP_Wait
 	}
 };
 
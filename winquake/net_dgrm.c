@@ -68,9 +68,16 @@ int packetsReceived = 0;
 int receivedDuplicateCount = 0;
 int shortPacketCount = 0;
 int droppedDatagrams;
+int socketCalls = 0;
 
 static int myDriverLevel;
 
+cvar_t	net_window = {"net_window", "1"};
+cvar_t	net_fakeloss = {"net_fakeloss", "0"};
+cvar_t	net_fakelag = {"net_fakelag", "0"};
+cvar_t	net_batch = {"net_batch", "1"};
+cvar_t	net_sharedsocket = {"net_sharedsocket", "1"};
+
 struct
 {
 	unsigned int	length;
@@ -158,6 +165,705 @@ void NET_Ban_f (void)
 #endif
 
 
+/*
+===============================================================================
+
+BATCHED SOCKET I/O
+
+A connected socket is read through a batch that the lan driver fills with
+everything waiting on it in one call.  A batch that comes back short means
+the socket was drained, so the read after its last packet returns nothing
+without asking again.  Between NET_BeginBatch and NET_EndBatch, packets
+written to connected sockets are queued, and each socket's are written out
+together in one call.
+
+===============================================================================
+*/
+
+static byte			readData[MAX_NET_BATCH][NET_DATAGRAMSIZE];
+static netpacket_t	readBatch[MAX_NET_BATCH];
+static qsocket_t	*readSock;		// whose packets are in readBatch
+static int			readCount;
+static int			readNext;
+static qboolean		readDrained;
+static qboolean		demuxDrained;	// shared socket read this frame
+
+static byte			writeData[MAX_NET_BATCH][NET_DATAGRAMSIZE];
+static netpacket_t	writeBatch[MAX_NET_BATCH];
+static qsocket_t	*writeSock[MAX_NET_BATCH];
+static int			writeCount;
+
+static int			batchFrames;
+static int			frameCalls;		// socketCalls made in them
+
+static void Datagram_CountCall (void)
+{
+	socketCalls++;
+	if (net_batching)
+		frameCalls++;
+}
+
+static void Datagram_Drain (int landriver, int socket);
+static int Datagram_Dequeue (demuxqueue_t *queue, byte *buf, int len, struct qsockaddr *addr);
+
+static int Datagram_ReadSocket (qsocket_t *sock, byte *buf, int len, struct qsockaddr *addr)
+{
+	netpacket_t	*p;
+	int			ret;
+
+	if (sock->shared)
+	{
+		if (!sock->demux.head && (!net_batching || !demuxDrained))
+			Datagram_Drain (sock->landriver, sock->socket);
+		return Datagram_Dequeue (&sock->demux, buf, len, addr);
+	}
+
+	if (!net_batch.value || !sfunc.ReadBatch)
+	{
+		Datagram_CountCall ();
+		return sfunc.Read (sock->socket, buf, len, addr);
+	}
+
+	if (readSock != sock)
+	{	// anything left for another socket is lost
+		readSock = sock;
+		readCount = readNext = 0;
+		readDrained = false;
+	}
+
+	if (readNext == readCount)
+	{
+		if (readDrained)
+		{
+			readDrained = false;
+			return 0;
+		}
+		Datagram_CountCall ();
+		ret = sfunc.ReadBatch (sock->socket, readBatch, MAX_NET_BATCH);
+		readNext = readCount = 0;
+		if (ret <= 0)
+			return ret;
+		readCount = ret;
+		readDrained = readCount < MAX_NET_BATCH;
+	}
+
+	p = &readBatch[readNext++];
+	if (p->length > len)
+		p->length = len;
+	Q_memcpy (buf, p->data, p->length);
+	*addr = p->addr;
+	return p->length;
+}
+
+static void Datagram_WriteQueue (void)
+{
+	netpacket_t	packets[MAX_NET_BATCH];
+	qsocket_t	*sock;
+	int			i, j, count, sent, ret;
+
+	for (i = 0; i < writeCount; i++)
+	{
+		sock = writeSock[i];
+		if (!sock)
+			continue;
+
+		count = 0;
+		for (j = i; j < writeCount; j++)
+			if (writeSock[j] && writeSock[j]->socket == sock->socket && writeSock[j]->landriver == sock->landriver)
+			{
+				packets[count++] = writeBatch[j];
+				writeSock[j] = NULL;
+			}
+
+		for (sent = 0; sent < count; sent += ret)
+		{
+			Datagram_CountCall ();
+			ret = sfunc.WriteBatch (sock->socket, packets + sent, count - sent);
+			if (ret <= 0)
+				break;	// the rest are lost
+		}
+	}
+	writeCount = 0;
+}
+
+static int Datagram_Write (qsocket_t *sock, byte *buf, int len, struct qsockaddr *addr)
+{
+	netpacket_t	*p;
+
+	if (!net_batching || !net_batch.value || !sfunc.WriteBatch)
+	{
+		Datagram_CountCall ();
+		return sfunc.Write (sock->socket, buf, len, addr);
+	}
+
+	if (writeCount == MAX_NET_BATCH)
+		Datagram_WriteQueue ();
+	p = &writeBatch[writeCount];
+	writeSock[writeCount] = sock;
+	writeCount++;
+	p->addr = *addr;
+	p->length = len;
+	Q_memcpy (p->data, buf, len);
+	return len;
+}
+
+void Datagram_Flush (void)
+{
+	int		calls;
+
+	calls = socketCalls;
+	Datagram_WriteQueue ();
+	frameCalls += socketCalls - calls;
+	batchFrames++;
+	demuxDrained = false;
+}
+
+/*
+===============================================================================
+
+SHARED SERVER SOCKET
+
+With net_sharedsocket, the server answers every client on its accept socket
+instead of opening a socket for each of them.  Whatever arrives on it is
+read in batches once a server frame and sorted by address, through a hash
+table of the connections, onto a queue for each connection and one for
+connection requests.  A packet from an address that isn't connected is
+dropped, and so is the oldest packet on a queue that is full, which keeps
+a connection that isn't being read from using up the others' room.
+Clients just use the port in the accept reply, so they can't tell the
+difference.  The accept socket is kept open for as long as any of them is
+connected, so turning listening off, or changing the port, only closes or
+moves it once the last of them has gone.
+
+===============================================================================
+*/
+
+#define	MAX_DEMUX_QUEUE		16
+#define	MAX_DEMUX_PACKETS	((MAX_SCOREBOARD + 1) * MAX_DEMUX_QUEUE)
+#define	DEMUX_HASH			64		// must be a power of two
+
+typedef struct demuxpacket_s
+{
+	struct demuxpacket_s	*next;
+	int						length;
+	struct qsockaddr		addr;
+	byte					data[NET_DATAGRAMSIZE];
+} demuxpacket_t;
+
+static demuxpacket_t	demuxPackets[MAX_DEMUX_PACKETS];
+static demuxpacket_t	*demuxFree;
+static int				demuxNumFree;
+static demuxqueue_t		controlQueue;	// connection requests
+
+static qsocket_t		*demuxHash[DEMUX_HASH];
+static int				demuxSocket[MAX_NET_DRIVERS];	// accept socket once known
+static int				numShared;
+static int				landShared[MAX_NET_DRIVERS];	// shared connections on each
+static qboolean			acceptOpen[MAX_NET_DRIVERS];
+static int				acceptPort[MAX_NET_DRIVERS];	// net_hostport when opened
+static qboolean			datagramListening;
+int						strayPackets;
+int						demuxOverflows;
+int						sleepWakeups;
+
+static int Datagram_HashAddr (struct qsockaddr *addr)
+{
+	unsigned	hash;
+	int			i;
+
+	// the port and address of an internet socket
+	hash = 0;
+	for (i = 0; i < 6; i++)
+		hash = hash * 31 + addr->sa_data[i];
+	return hash & (DEMUX_HASH - 1);
+}
+
+static void Datagram_InitDemux (void)
+{
+	int		i;
+
+	for (i = 0; i < MAX_DEMUX_PACKETS - 1; i++)
+		demuxPackets[i].next = &demuxPackets[i + 1];
+	demuxFree = demuxPackets;
+	demuxNumFree = MAX_DEMUX_PACKETS;
+	for (i = 0; i < MAX_NET_DRIVERS; i++)
+		demuxSocket[i] = -1;
+}
+
+static void Datagram_FreePackets (demuxpacket_t *p)
+{
+	demuxpacket_t	*next;
+
+	for ( ; p; p = next)
+	{
+		next = p->next;
+		p->next = demuxFree;
+		demuxFree = p;
+		demuxNumFree++;
+	}
+}
+
+static void Datagram_FreeQueue (demuxqueue_t *queue)
+{
+	Datagram_FreePackets (queue->head);
+	queue->head = queue->tail = NULL;
+	queue->count = 0;
+}
+
+static void Datagram_UpdateListen (int landriver);
+
+static void Datagram_AddShared (qsocket_t *sock)
+{
+	int		hash;
+
+	hash = Datagram_HashAddr (&sock->addr);
+	sock->shared = true;
+	sock->hashNext = demuxHash[hash];
+	demuxHash[hash] = sock;
+	numShared++;
+	landShared[sock->landriver]++;
+}
+
+static void Datagram_RemoveShared (qsocket_t *sock)
+{
+	qsocket_t	**link;
+
+	for (link = &demuxHash[Datagram_HashAddr (&sock->addr)]; *link; link = &(*link)->hashNext)
+		if (*link == sock)
+		{
+			*link = sock->hashNext;
+			break;
+		}
+	Datagram_FreeQueue (&sock->demux);
+	sock->shared = false;
+	numShared--;
+	if (!--landShared[sock->landriver])
+		Datagram_UpdateListen (sock->landriver);
+}
+
+static qsocket_t *Datagram_FindShared (int landriver, struct qsockaddr *addr)
+{
+	qsocket_t	*s;
+
+	for (s = demuxHash[Datagram_HashAddr (addr)]; s; s = s->hashNext)
+		if (s->landriver == landriver && net_landrivers[landriver].AddrCompare (addr, &s->addr) == 0)
+			return s;
+	return NULL;
+}
+
+/*
+Reads what is waiting on the accept socket onto the queues, until it is
+drained or there is no room left
+*/
+static void Datagram_Drain (int landriver, int socket)
+{
+	net_landriver_t	*driver;
+	netpacket_t		*p;
+	demuxpacket_t	*d;
+	demuxqueue_t	*queue;
+	qsocket_t		*s;
+	int				i, count, want, control;
+
+	driver = &net_landrivers[landriver];
+	readSock = NULL;	// readBatch is used here
+
+	while (demuxNumFree)
+	{
+		Datagram_CountCall ();
+		if (net_batch.value && driver->ReadBatch)
+		{
+			want = demuxNumFree < MAX_NET_BATCH ? demuxNumFree : MAX_NET_BATCH;
+			count = driver->ReadBatch (socket, readBatch, want);
+		}
+		else
+		{
+			want = 1;
+			count = driver->Read (socket, readBatch[0].data, NET_DATAGRAMSIZE, &readBatch[0].addr);
+			if (count > 0)
+			{
+				readBatch[0].length = count;
+				count = 1;
+			}
+		}
+		if (count <= 0)
+		{
+			demuxDrained = true;
+			return;
+		}
+
+		for (i = 0, p = readBatch; i < count; i++, p++)
+		{
+			if (p->length < sizeof(int))
+				continue;
+			control = BigLong(*((int *)p->data));
+			if (control != -1 && (control & (~NETFLAG_LENGTH_MASK)) != NETFLAG_CTL)
+			{
+				s = Datagram_FindShared (landriver, &p->addr);
+				if (!s)
+				{
+					strayPackets++;
+					continue;
+				}
+				queue = &s->demux;
+			}
+			else
+				queue = &controlQueue;
+
+			if (queue->count == MAX_DEMUX_QUEUE)
+			{
+				d = queue->head;
+				queue->head = d->next;
+				queue->count--;
+				d->next = NULL;
+				Datagram_FreePackets (d);
+				demuxOverflows++;
+			}
+
+			d = demuxFree;
+			demuxFree = d->next;
+			demuxNumFree--;
+			d->next = NULL;
+			d->length = p->length;
+			d->addr = p->addr;
+			Q_memcpy (d->data, p->data, p->length);
+			if (queue->head)
+				queue->tail->next = d;
+			else
+				queue->head = d;
+			queue->tail = d;
+			queue->count++;
+		}
+
+		if (count < want)
+		{
+			demuxDrained = true;
+			return;
+		}
+	}
+}
+
+/*
+Sleeps on the accept socket of the first lan driver, and reads what wakes
+it onto the queues.  Connections with sockets of their own are left until
+the frame.
+*/
+qboolean Datagram_Sleep (double seconds)
+{
+	net_landriver_t	*driver;
+	int				socket;
+
+	if (!net_numlandrivers || !(net_sharedsocket.value || numShared))
+		return false;
+	driver = &net_landrivers[0];
+	if (!driver->initialized || !driver->Wait)
+		return false;
+
+	switch (driver->Wait (seconds))
+	{
+	case 0:
+		return true;
+	case 1:
+		break;
+	default:
+		return false;
+	}
+
+	socket = demuxSocket[0];
+	if (socket == -1)
+	{
+		socket = driver->CheckNewConnections ();
+		if (socket == -1)
+			return false;
+		demuxSocket[0] = socket;
+	}
+	Datagram_Drain (0, socket);
+	if (!demuxDrained)
+		return false;	// no room left, so the rest waits for the frame
+	demuxDrained = false;
+	sleepWakeups++;
+	return true;
+}
+
+static int Datagram_Dequeue (demuxqueue_t *queue, byte *buf, int len, struct qsockaddr *addr)
+{
+	demuxpacket_t	*d;
+
+	d = queue->head;
+	if (!d)
+		return 0;
+	queue->head = d->next;
+	queue->count--;
+	d->next = NULL;
+
+	if (d->length < len)
+		len = d->length;
+	Q_memcpy (buf, d->data, len);
+	*addr = d->addr;
+	Datagram_FreePackets (d);
+	return len;
+}
+
+/*
+===============================================================================
+
+WINDOWED RELIABLE MESSAGES
+
+With NETEXT_WINDOW, every fragment of a reliable message is sent at once
+instead of one per round trip.  The receiver acks each fragment it gets and
+puts it in place in receiveMessage, and only a fragment that isn't acked
+within the retransmit timeout is sent again.  The timeout follows the
+measured round trip time, leaving out fragments that were sent more than
+once, and doubles each time it runs out.
+
+===============================================================================
+*/
+
+#define	NET_MINRTO	0.05
+#define	NET_MAXRTO	1.0
+
+static int Window_SendFragment (qsocket_t *sock, int fragment)
+{
+	unsigned int	packetLen;
+	unsigned int	dataLen;
+	unsigned int	eom;
+
+	dataLen = sock->sendMessageLength - fragment*MAX_DATAGRAM;
+	if (dataLen > MAX_DATAGRAM)
+		dataLen = MAX_DATAGRAM;
+	eom = fragment == sock->sendFragments - 1 ? NETFLAG_EOM : 0;
+	packetLen = NET_HEADERSIZE + dataLen;
+
+	packetBuffer.length = BigLong(packetLen | (NETFLAG_DATA | eom));
+	packetBuffer.sequence = BigLong(sock->ackSequence + fragment);
+	Q_memcpy (packetBuffer.data, sock->sendMessage + fragment*MAX_DATAGRAM, dataLen);
+
+	if (Datagram_Write (sock, (byte *)&packetBuffer, packetLen, &sock->addr) == -1)
+		return -1;
+
+	sock->sendTime[fragment] = net_time;
+	sock->lastSendTime = net_time;
+	return 1;
+}
+
+static int Window_SendMessage (qsocket_t *sock)
+{
+	int		i;
+
+	sock->sendFragments = (sock->sendMessageLength + MAX_DATAGRAM - 1) / MAX_DATAGRAM;
+	sock->sendAcked = 0;
+	sock->sendResent = 0;
+	sock->ackSequence = sock->sendSequence;
+	sock->sendSequence += sock->sendFragments;
+	sock->canSend = false;
+
+	for (i = 0; i < sock->sendFragments; i++)
+	{
+		if (Window_SendFragment (sock, i) == -1)
+			return -1;
+		packetsSent++;
+	}
+	return 1;
+}
+
+static void Window_Resend (qsocket_t *sock)
+{
+	int		i;
+	qboolean	timedout;
+
+	timedout = false;
+	for (i = 0; i < sock->sendFragments; i++)
+	{
+		if (sock->sendAcked & (1 << i))
+			continue;
+		if (net_time - sock->sendTime[i] <= sock->rto)
+			continue;
+		Window_SendFragment (sock, i);
+		sock->sendResent |= 1 << i;
+		packetsReSent++;
+		timedout = true;
+	}
+
+	if (timedout)
+	{
+		sock->rto *= 2;
+		if (sock->rto > NET_MAXRTO)
+			sock->rto = NET_MAXRTO;
+	}
+}
+
+static void Window_Ack (qsocket_t *sock, unsigned int sequence)
+{
+	unsigned int	fragment;
+	double			sample;
+
+	fragment = sequence - sock->ackSequence;
+	if (sock->canSend || fragment >= sock->sendFragments || (sock->sendAcked & (1 << fragment)))
+	{
+		Con_DPrintf("Stale ACK received\n");
+		return;
+	}
+	sock->sendAcked |= 1 << fragment;
+
+	// only time fragments that were sent once, since an ack for one that was
+	// sent again could be for either
+	if (!(sock->sendResent & (1 << fragment)))
+	{
+		sample = net_time - sock->sendTime[fragment];
+		if (!sock->rtt)
+		{
+			sock->rtt = sample;
+			sock->rttvar = sample / 2;
+		}
+		else
+		{
+			sock->rttvar += (fabs(sample - sock->rtt) - sock->rttvar) / 4;
+			sock->rtt += (sample - sock->rtt) / 8;
+		}
+		sock->rto = sock->rtt + 4 * sock->rttvar;
+		if (sock->rto < NET_MINRTO)
+			sock->rto = NET_MINRTO;
+		if (sock->rto > NET_MAXRTO)
+			sock->rto = NET_MAXRTO;
+	}
+
+	if (sock->sendAcked == (1 << sock->sendFragments) - 1)
+	{
+		sock->sendMessageLength = 0;
+		sock->canSend = true;
+	}
+}
+
+/*
+Returns true when the fragment completes a message, which is then in
+net_message
+*/
+static qboolean Window_Receive (qsocket_t *sock, unsigned int sequence, unsigned int flags, unsigned int length, struct qsockaddr *readaddr)
+{
+	unsigned int	fragment;
+
+	fragment = sequence - sock->receiveSequence;
+	if (fragment >= NET_WINDOW && (int)fragment > 0)
+		return false;	// too far ahead to be from this message
+	if (length > MAX_DATAGRAM || (!(flags & NETFLAG_EOM) && length != MAX_DATAGRAM))
+		return false;
+
+	packetBuffer.length = BigLong(NET_HEADERSIZE | NETFLAG_ACK);
+	packetBuffer.sequence = BigLong(sequence);
+	Datagram_Write (sock, (byte *)&packetBuffer, NET_HEADERSIZE, readaddr);
+
+	if (fragment >= NET_WINDOW || (sock->receiveHave & (1 << fragment)))
+	{	// from an earlier message, or got twice
+		receivedDuplicateCount++;
+		return false;
+	}
+
+	Q_memcpy(sock->receiveMessage + fragment*MAX_DATAGRAM, packetBuffer.data, length);
+	sock->receiveHave |= 1 << fragment;
+	if (flags & NETFLAG_EOM)
+	{
+		sock->receiveLast = fragment;
+		sock->receiveMessageLength = fragment*MAX_DATAGRAM + length;
+	}
+
+	if (sock->receiveLast == -1 || sock->receiveHave != (1 << (sock->receiveLast + 1)) - 1)
+		return false;
+
+	SZ_Clear(&net_message);
+	SZ_Write(&net_message, sock->receiveMessage, sock->receiveMessageLength);
+	sock->receiveSequence += sock->receiveLast + 1;
+	sock->receiveHave = 0;
+	sock->receiveLast = -1;
+	sock->receiveMessageLength = 0;
+	return true;
+}
+
+/*
+===============================================================================
+
+SIMULATED LOSS AND LATENCY
+
+net_fakeloss drops that percentage of the packets read on connected
+sockets, and net_fakelag holds the rest back for that many milliseconds.
+Use them on both ends to slow down both directions.
+
+===============================================================================
+*/
+
+#define	MAX_FAKELAG	32
+
+typedef struct
+{
+	qsocket_t			*sock;		// NULL if the slot is free
+	double				time;		// when it can be read
+	int					length;
+	struct qsockaddr	addr;
+	byte				data[NET_DATAGRAMSIZE];
+} fakepacket_t;
+
+static fakepacket_t	fakelag[MAX_FAKELAG];
+static int			numfakelag;
+
+static int Datagram_Read (qsocket_t *sock, byte *buf, int len, struct qsockaddr *addr)
+{
+	int				i, length;
+	fakepacket_t	*p, *first;
+
+	if (!net_fakeloss.value && !net_fakelag.value && !numfakelag)
+		return Datagram_ReadSocket (sock, buf, len, addr);
+
+	while (1)
+	{
+		length = Datagram_ReadSocket (sock, buf, len, addr);
+		if (length <= 0)
+			break;
+		if ((rand() % 100) < net_fakeloss.value)
+			continue;
+		if (!net_fakelag.value && !numfakelag)
+			return length;
+
+		for (i = 0, p = fakelag; i < MAX_FAKELAG; i++, p++)
+			if (!p->sock)
+				break;
+		if (i == MAX_FAKELAG)
+			continue;	// lost in the queue
+		p->sock = sock;
+		p->time = net_time + net_fakelag.value / 1000;
+		p->length = length;
+		p->addr = *addr;
+		Q_memcpy (p->data, buf, length);
+		numfakelag++;
+	}
+	if (length == -1)
+		return -1;
+
+	first = NULL;
+	for (i = 0, p = fakelag; i < MAX_FAKELAG; i++, p++)
+		if (p->sock == sock && p->time <= net_time && (!first || p->time < first->time))
+			first = p;
+	if (!first)
+		return 0;
+
+	Q_memcpy (buf, first->data, first->length);
+	*addr = first->addr;
+	first->sock = NULL;
+	numfakelag--;
+	return first->length;
+}
+
+static void Datagram_ForgetFakeLag (qsocket_t *sock)
+{
+	int		i;
+
+	for (i = 0; i < MAX_FAKELAG; i++)
+		if (fakelag[i].sock == sock)
+		{
+			fakelag[i].sock = NULL;
+			numfakelag--;
+		}
+}
+
+//============================================================================
+
 int Datagram_SendMessage (qsocket_t *sock, sizebuf_t *data)
 {
 	unsigned int	packetLen;
@@ -178,6 +884,9 @@ int Datagram_SendMessage (qsocket_t *sock, sizebuf_t *data)
 	Q_memcpy(sock->sendMessage, data->data, data->cursize);
 	sock->sendMessageLength = data->cursize;
 
+	if (sock->windowed)
+		return Window_SendMessage (sock);
+
 	if (data->cursize <= MAX_DATAGRAM)
 	{
 		dataLen = data->cursize;
@@ -196,7 +905,7 @@ int Datagram_SendMessage (qsocket_t *sock, sizebuf_t *data)
 
 	sock->canSend = false;
 
-	if (sfunc.Write (sock->socket, (byte *)&packetBuffer, packetLen, &sock->addr) == -1)
+	if (Datagram_Write (sock, (byte *)&packetBuffer, packetLen, &sock->addr) == -1)
 		return -1;
 
 	sock->lastSendTime = net_time;
@@ -229,7 +938,7 @@ int SendMessageNext (qsocket_t *sock)
 
 	sock->sendNext = false;
 
-	if (sfunc.Write (sock->socket, (byte *)&packetBuffer, packetLen, &sock->addr) == -1)
+	if (Datagram_Write (sock, (byte *)&packetBuffer, packetLen, &sock->addr) == -1)
 		return -1;
 
 	sock->lastSendTime = net_time;
@@ -262,7 +971,7 @@ int ReSendMessage (qsocket_t *sock)
 
 	sock->sendNext = false;
 
-	if (sfunc.Write (sock->socket, (byte *)&packetBuffer, packetLen, &sock->addr) == -1)
+	if (Datagram_Write (sock, (byte *)&packetBuffer, packetLen, &sock->addr) == -1)
 		return -1;
 
 	sock->lastSendTime = net_time;
@@ -304,7 +1013,7 @@ int Datagram_SendUnreliableMessage (qsocket_t *sock, sizebuf_t *data)
 	packetBuffer.sequence = BigLong(sock->unreliableSendSequence++);
 	Q_memcpy (packetBuffer.data, data->data, data->cursize);
 
-	if (sfunc.Write (sock->socket, (byte *)&packetBuffer, packetLen, &sock->addr) == -1)
+	if (Datagram_Write (sock, (byte *)&packetBuffer, packetLen, &sock->addr) == -1)
 		return -1;
 
 	packetsSent++;
@@ -322,15 +1031,16 @@ int	Datagram_GetMessage (qsocket_t *sock)
 	unsigned int	count;
 
 	if (!sock->canSend)
-		if ((net_time - sock->lastSendTime) > 1.0)
+	{
+		if (sock->windowed)
+			Window_Resend (sock);
+		else if ((net_time - sock->lastSendTime) > 1.0)
 			ReSendMessage (sock);
+	}
 
 	while(1)
 	{	
-		length = sfunc.Read (sock->socket, (byte *)&packetBuffer, NET_DATAGRAMSIZE, &readaddr);
-
-//	if ((rand() & 255) > 220)
-//		continue;
+		length = Datagram_Read (sock, (byte *)&packetBuffer, NET_DATAGRAMSIZE, &readaddr);
 
 		if (length == 0)
 			break;
@@ -394,6 +1104,11 @@ int	Datagram_GetMessage (qsocket_t *sock)
 
 		if (flags & NETFLAG_ACK)
 		{
+			if (sock->windowed)
+			{
+				Window_Ack (sock, sequence);
+				continue;
+			}
 			if (sequence != (sock->sendSequence - 1))
 			{
 				Con_DPrintf("Stale ACK received\n");
@@ -426,9 +1141,19 @@ int	Datagram_GetMessage (qsocket_t *sock)
 
 		if (flags & NETFLAG_DATA)
 		{
+			if (sock->windowed)
+			{
+				if (Window_Receive (sock, sequence, flags, length - NET_HEADERSIZE, &readaddr))
+				{
+					ret = 1;
+					break;
+				}
+				continue;
+			}
+
 			packetBuffer.length = BigLong(NET_HEADERSIZE | NETFLAG_ACK);
 			packetBuffer.sequence = BigLong(sequence);
-			sfunc.Write (sock->socket, (byte *)&packetBuffer, NET_HEADERSIZE, &readaddr);
+			Datagram_Write (sock, (byte *)&packetBuffer, NET_HEADERSIZE, &readaddr);
 
 			if (sequence != sock->receiveSequence)
 			{
@@ -468,6 +1193,8 @@ void PrintStats(qsocket_t *s)
 	Con_Printf("canSend = %4u   \n", s->canSend);
 	Con_Printf("sendSeq = %4u   ", s->sendSequence);
 	Con_Printf("recvSeq = %4u   \n", s->receiveSequence);
+	if (s->windowed)
+		Con_Printf("windowed  rtt = %4.0f ms  rto = %4.0f ms\n", s->rtt * 1000, s->rto * 1000);
 	Con_Printf("\n");
 }
 
@@ -487,6 +1214,12 @@ void NET_Stats_f (void)
 		Con_Printf("receivedDuplicateCount     = %i\n", receivedDuplicateCount);
 		Con_Printf("shortPacketCount           = %i\n", shortPacketCount);
 		Con_Printf("droppedDatagrams           = %i\n", droppedDatagrams);
+		Con_Printf("socketCalls                = %i\n", socketCalls);
+		if (batchFrames)
+			Con_Printf("socketCalls per frame      = %.1f\n", (float)frameCalls / batchFrames);
+		Con_Printf("strayPackets               = %i\n", strayPackets);
+		Con_Printf("demuxOverflows             = %i\n", demuxOverflows);
+		Con_Printf("sleepWakeups               = %i\n", sleepWakeups);
 	}
 	else if (Q_strcmp(Cmd_Argv(1), "*") == 0)
 	{
@@ -763,6 +1496,116 @@ JustDoIt:
 }
 
 
+/*
+====================
+NetTest_f
+
+nettest <host> [count] [size]
+
+Connects to host and waits for the server's first reliable message (the
+server info), then sends count reliable messages of size bytes of clc_nop
+as fast as the connection takes them.  Prints how long it took to connect
+and get that message, and the reliable throughput.  Run it with net_fakeloss and
+net_fakelag set on both ends to see what the window does on a bad link.
+====================
+*/
+static void NetTest_f (void)
+{
+	static byte	data[MAX_MSGLEN];
+	static byte	disconnect[1] = {clc_disconnect};
+	qsocket_t	*sock;
+	sizebuf_t	msg;
+	double		start, connecttime, time;
+	int			count, size, sent, ret;
+
+	if (Cmd_Argc () < 2)
+	{
+		Con_Printf ("nettest <host> [count] [size]\n");
+		return;
+	}
+
+	count = 20;
+	size = MAX_MSGLEN;
+	if (Cmd_Argc () > 2)
+		count = Q_atoi (Cmd_Argv (2));
+	if (Cmd_Argc () > 3)
+		size = Q_atoi (Cmd_Argv (3));
+	if (count < 1)
+		count = 1;
+	if (size < 1)
+		size = 1;
+	if (size > MAX_MSGLEN)
+		size = MAX_MSGLEN;
+
+	net_driverlevel = myDriverLevel;
+	start = Sys_FloatTime ();
+	sock = Datagram_Connect (Cmd_Argv (1));
+	if (!sock)
+	{
+		Con_Printf ("nettest: couldn't connect\n");
+		return;
+	}
+	while ((ret = NET_GetMessage (sock)) != 1)
+	{
+		if (ret == -1 || Sys_FloatTime () - start > 60)
+		{
+			Con_Printf ("nettest: no server info\n");
+			NET_Close (sock);
+			return;
+		}
+	}
+	connecttime = Sys_FloatTime () - start;
+
+	Q_memset (data, clc_nop, size);
+	SZ_View (&msg, data, size);
+
+	start = Sys_FloatTime ();
+	sent = 0;
+	while (1)
+	{
+		if (Sys_FloatTime () - start > 60)
+		{
+			Con_Printf ("nettest: gave up after 60 seconds\n");
+			break;
+		}
+
+	// reading takes in the acks and sends again what has timed out
+		while ((ret = NET_GetMessage (sock)) > 0)
+			;
+		if (ret == -1)
+		{
+			Con_Printf ("nettest: connection lost\n");
+			NET_Close (sock);
+			return;
+		}
+
+		if (!NET_CanSendMessage (sock))
+			continue;
+		if (sent == count)
+			break;
+		if (NET_SendMessage (sock, &msg) == -1)
+		{
+			Con_Printf ("nettest: connection lost\n");
+			NET_Close (sock);
+			return;
+		}
+		sent++;
+	}
+	time = Sys_FloatTime () - start;
+
+	Con_Printf ("connect %.3f s, %i reliable messages of %i bytes in %.3f s, %.1f KB/s\n",
+		connecttime, sent, size, time, sent * size / time / 1024);
+	if (sock->windowed)
+		Con_Printf ("window on, rtt %.0f ms, rto %.0f ms\n", sock->rtt * 1000, sock->rto * 1000);
+	else
+		Con_Printf ("window off\n");
+
+	SZ_View (&msg, disconnect, sizeof(disconnect));
+	NET_SendUnreliableMessage (sock, &msg);
+	NET_Close (sock);
+}
+
+
 int Datagram_Init (void)
 {
 	int i;
@@ -770,6 +1613,18 @@ int Datagram_Init (void)
 
 	myDriverLevel = net_driverlevel;
 	Cmd_AddCommand ("net_stats", NET_Stats_f);
+	Cvar_RegisterVariable (&net_window);
+	Cvar_RegisterVariable (&net_fakeloss);
+	Cvar_RegisterVariable (&net_fakelag);
+	Cvar_RegisterVariable (&net_batch);
+	Cvar_RegisterVariable (&net_sharedsocket);
+	Datagram_InitDemux ();
+
+	for (i = 0; i < MAX_NET_BATCH; i++)
+	{
+		readBatch[i].data = readData[i];
+		writeBatch[i].data = writeData[i];
+	}
 
 	if (COM_CheckParm("-nolan"))
 		return -1;
@@ -788,6 +1643,7 @@ int Datagram_Init (void)
 #endif
 	Cmd_AddCommand ("test", Test_f);
 	Cmd_AddCommand ("test2", Test2_f);
+	Cmd_AddCommand ("nettest", NetTest_f);
 
 	return 0;
 }
@@ -813,7 +1669,43 @@ void Datagram_Shutdown (void)
 
 void Datagram_Close (qsocket_t *sock)
 {
-	sfunc.CloseSocket(sock->socket);
+	Datagram_WriteQueue ();
+	if (readSock == sock)
+		readSock = NULL;
+	Datagram_ForgetFakeLag (sock);
+	if (sock->shared)
+		Datagram_RemoveShared (sock);
+	else
+		sfunc.CloseSocket(sock->socket);
+}
+
+
+/*
+Opens, closes or moves the accept socket of a lan driver to match
+datagramListening and net_hostport, unless shared connections are still
+using it
+*/
+static void Datagram_UpdateListen (int landriver)
+{
+	if (!net_landrivers[landriver].initialized)
+		return;
+	if (acceptOpen[landriver])
+	{
+		if (datagramListening && acceptPort[landriver] == net_hostport)
+			return;
+		if (landShared[landriver])
+			return;		// done when the last of them closes
+		net_landrivers[landriver].Listen (false);
+		acceptOpen[landriver] = false;
+		demuxSocket[landriver] = -1;
+		Datagram_FreeQueue (&controlQueue);
+	}
+	if (datagramListening)
+	{
+		net_landrivers[landriver].Listen (true);
+		acceptOpen[landriver] = true;
+		acceptPort[landriver] = net_hostport;
+	}
 }
 
 
@@ -821,9 +1713,9 @@ void Datagram_Listen (qboolean state)
 {
 	int i;
 
+	datagramListening = state;
 	for (i = 0; i < net_numlandrivers; i++)
-		if (net_landrivers[i].initialized)
-			net_landrivers[i].Listen (state);
+		Datagram_UpdateListen (i);
 }
 
 
@@ -839,14 +1731,34 @@ static qsocket_t *_Datagram_CheckNewConnections (void)
 	int			command;
 	int			control;
 	int			ret;
+	int			maxprotocol;
+	int			extensions;
 
-	acceptsock = dfunc.CheckNewConnections();
-	if (acceptsock == -1)
-		return NULL;
+	if (net_sharedsocket.value || numShared)
+	{	// everything that arrives on the accept socket goes through the queues
+		acceptsock = demuxSocket[net_landriverlevel];
+		if (acceptsock == -1)
+		{
+			acceptsock = dfunc.CheckNewConnections();
+			if (acceptsock == -1)
+				return NULL;
+			demuxSocket[net_landriverlevel] = acceptsock;
+		}
+		if (!controlQueue.head && (!net_batching || !demuxDrained))
+			Datagram_Drain (net_landriverlevel, acceptsock);
 
-	SZ_Clear(&net_message);
+		SZ_Clear(&net_message);
+		len = Datagram_Dequeue (&controlQueue, net_message.data, net_message.maxsize, &clientaddr);
+	}
+	else
+	{
+		acceptsock = dfunc.CheckNewConnections();
+		if (acceptsock == -1)
+			return NULL;
 
-	len = dfunc.Read (acceptsock, net_message.data, net_message.maxsize, &clientaddr);
+		SZ_Clear(&net_message);
+		len = dfunc.Read (acceptsock, net_message.data, net_message.maxsize, &clientaddr);
+	}
 	if (len < sizeof(int))
 		return NULL;
 	net_message.cursize = len;
@@ -984,6 +1896,16 @@ static qsocket_t *_Datagram_CheckNewConnections (void)
 		return NULL;
 	}
 
+	// newer clients say which game protocols they can take, and which
+	// extensions to this protocol
+	maxprotocol = MSG_ReadByte();
+	if (maxprotocol == -1)
+		maxprotocol = PROTOCOL_VERSION;
+	extensions = MSG_ReadByte();
+	if (extensions == -1 || !net_window.value)
+		extensions = 0;
+	extensions &= NETEXT_WINDOW;
+
 #ifdef BAN_TEST
 	// check for a ban
 	if (clientaddr.sa_family == AF_INET)
@@ -1023,6 +1945,7 @@ static qsocket_t *_Datagram_CheckNewConnections (void)
 				MSG_WriteByte(&net_message, CCREP_ACCEPT);
 				dfunc.GetSocketAddr(s->socket, &newaddr);
 				MSG_WriteLong(&net_message, dfunc.GetSocketPort(&newaddr));
+				MSG_WriteByte(&net_message, s->windowed ? NETEXT_WINDOW : 0);
 				*((int *)net_message.data) = BigLong(NETFLAG_CTL | (net_message.cursize & NETFLAG_LENGTH_MASK));
 				dfunc.Write (acceptsock, net_message.data, net_message.cursize, &clientaddr);
 				SZ_Clear(&net_message);
@@ -1051,20 +1974,25 @@ static qsocket_t *_Datagram_CheckNewConnections (void)
 		return NULL;
 	}
 
-	// allocate a network socket
-	newsock = dfunc.OpenSocket(0);
-	if (newsock == -1)
+	if (net_sharedsocket.value)
+		newsock = acceptsock;
+	else
 	{
-		NET_FreeQSocket(sock);
-		return NULL;
-	}
+		// allocate a network socket
+		newsock = dfunc.OpenSocket(0);
+		if (newsock == -1)
+		{
+			NET_FreeQSocket(sock);
+			return NULL;
+		}
 
-	// connect to the client
-	if (dfunc.Connect (newsock, &clientaddr) == -1)
-	{
-		dfunc.CloseSocket(newsock);
-		NET_FreeQSocket(sock);
-		return NULL;
+		// connect to the client
+		if (dfunc.Connect (newsock, &clientaddr) == -1)
+		{
+			dfunc.CloseSocket(newsock);
+			NET_FreeQSocket(sock);
+			return NULL;
+		}
 	}
 
 	// everything is allocated, just fill in the details	
@@ -1072,6 +2000,10 @@ static qsocket_t *_Datagram_CheckNewConnections (void)
 	sock->landriver = net_landriverlevel;
 	sock->addr = clientaddr;
 	Q_strcpy(sock->address, dfunc.AddrToString(&clientaddr));
+	sock->maxprotocol = maxprotocol;
+	sock->windowed = (extensions & NETEXT_WINDOW) != 0;
+	if (newsock == acceptsock)
+		Datagram_AddShared (sock);
 
 	// send him back the info about the server connection he has been allocated
 	SZ_Clear(&net_message);
@@ -1081,6 +2013,8 @@ static qsocket_t *_Datagram_CheckNewConnections (void)
 	dfunc.GetSocketAddr(newsock, &newaddr);
 	MSG_WriteLong(&net_message, dfunc.GetSocketPort(&newaddr));
 //	MSG_WriteString(&net_message, dfunc.AddrToString(&newaddr));
+	// older clients ignore the rest of the reply
+	MSG_WriteByte(&net_message, sock->windowed ? NETEXT_WINDOW : 0);
 	*((int *)net_message.data) = BigLong(NETFLAG_CTL | (net_message.cursize & NETFLAG_LENGTH_MASK));
 	dfunc.Write (acceptsock, net_message.data, net_message.cursize, &clientaddr);
 	SZ_Clear(&net_message);
@@ -1253,6 +2187,9 @@ static qsocket_t *_Datagram_Connect (char *host)
 		MSG_WriteByte(&net_message, CCREQ_CONNECT);
 		MSG_WriteString(&net_message, "QUAKE");
 		MSG_WriteByte(&net_message, NET_PROTOCOL_VERSION);
+		// older servers ignore the rest of the request
+		MSG_WriteByte(&net_message, PROTOCOL_DELTA);
+		MSG_WriteByte(&net_message, net_window.value ? NETEXT_WINDOW : 0);
 		*((int *)net_message.data) = BigLong(NETFLAG_CTL | (net_message.cursize & NETFLAG_LENGTH_MASK));
 		dfunc.Write (newsock, net_message.data, net_message.cursize, &sendaddr);
 		SZ_Clear(&net_message);
@@ -1339,6 +2276,8 @@ static qsocket_t *_Datagram_Connect (char *host)
 	{
 		Q_memcpy(&sock->addr, &sendaddr, sizeof(struct qsockaddr));
 		dfunc.SetSocketPort (&sock->addr, MSG_ReadLong());
+		ret = MSG_ReadByte();
+		sock->windowed = ret != -1 && (ret & NETEXT_WINDOW);
 	}
 	else
 	{
@@ -32,3 +32,5 @@ qboolean	Datagram_CanSendMessage (qsocket_t *sock);
 qboolean	Datagram_CanSendUnreliableMessage (qsocket_t *sock);
 void		Datagram_Close (qsocket_t *sock);
 void		Datagram_Shutdown (void);
+void		Datagram_Flush (void);
+qboolean	Datagram_Sleep (double seconds);
@@ -26,6 +26,8 @@ qboolean	localconnectpending = false;
 qsocket_t	*loop_client = NULL;
 qsocket_t	*loop_server = NULL;
 
+static void Loop_ClearMessages (qsocket_t *sock);
+
 int Loop_Init (void)
 {
 	if (cls.state == ca_dedicated)
@@ -78,9 +80,7 @@ qsocket_t *Loop_Connect (char *host)
 		}
 		Q_strcpy (loop_client->address, "localhost");
 	}
-	loop_client->receiveMessageLength = 0;
-	loop_client->sendMessageLength = 0;
-	loop_client->canSend = true;
+	Loop_ClearMessages (loop_client);
 
 	if (!loop_server)
 	{
@@ -91,9 +91,7 @@ qsocket_t *Loop_Connect (char *host)
 		}
 		Q_strcpy (loop_server->address, "LOCAL");
 	}
-	loop_server->receiveMessageLength = 0;
-	loop_server->sendMessageLength = 0;
-	loop_server->canSend = true;
+	Loop_ClearMessages (loop_server);
 
 	loop_client->driverdata = (void *)loop_server;
 	loop_server->driverdata = (void *)loop_client;
@@ -108,12 +106,8 @@ qsocket_t *Loop_CheckNewConnections (void)
 		return NULL;
 
 	localconnectpending = false;
-	loop_server->sendMessageLength = 0;
-	loop_server->receiveMessageLength = 0;
-	loop_server->canSend = true;
-	loop_client->sendMessageLength = 0;
-	loop_client->receiveMessageLength = 0;
-	loop_client->canSend = true;
+	Loop_ClearMessages (loop_server);
+	Loop_ClearMessages (loop_client);
 	return loop_server;
 }
 
@@ -124,25 +118,114 @@ static int IntAlign(int value)
 }
 
 
+/*
+===============================================================================
+
+MESSAGES READ IN PLACE
+
+Each message is written once, into the receiveMessage of the socket at the
+other end, as a four byte header (type, length, alignment) followed by the
+data.  Loop_GetMessage doesn't copy it out: net_message is made a view of
+the data, and the message stays where it is until the next Loop_GetMessage
+on that socket, which gives its space back.  Messages behind it are never
+moved up; once everything has been read the buffer starts over at the
+beginning, which both ends do every frame.  Only when a message doesn't fit
+at the end, and the reader isn't looking at anything, is what is left moved
+down to make room.
+
+===============================================================================
+*/
+
+/*
+====================
+Loop_ClearMessages
+====================
+*/
+static void Loop_ClearMessages (qsocket_t *sock)
+{
+	if (net_message.data >= sock->receiveMessage && net_message.data < sock->receiveMessage + NET_MAXMESSAGE)
+		NET_ReleaseMessage ();
+	sock->receiveMessageLength = 0;
+	sock->receiveMessageStart = 0;
+	sock->receiveMessageHeld = 0;
+	sock->sendMessageLength = 0;
+	sock->canSend = true;
+}
+
+/*
+====================
+Loop_GetSpace
+
+Returns room for a message of length bytes at the end of sock's messages,
+or NULL if there isn't any
+====================
+*/
+static byte *Loop_GetSpace (qsocket_t *sock, int length)
+{
+	byte	*buffer;
+	int		waiting;
+
+	length = IntAlign(length + 4);
+	if (sock->receiveMessageLength + length > NET_MAXMESSAGE)
+	{
+		if (sock->receiveMessageHeld || !sock->receiveMessageStart)
+			return NULL;
+		waiting = sock->receiveMessageLength - sock->receiveMessageStart;
+		if (waiting + length > NET_MAXMESSAGE)
+			return NULL;
+		memmove (sock->receiveMessage, sock->receiveMessage + sock->receiveMessageStart, waiting);
+		sock->receiveMessageStart = 0;
+		sock->receiveMessageLength = waiting;
+	}
+
+	buffer = sock->receiveMessage + sock->receiveMessageLength;
+	sock->receiveMessageLength += length;
+	return buffer;
+}
+
+/*
+====================
+Loop_WriteMessage
+====================
+*/
+static void Loop_WriteMessage (byte *buffer, int type, sizebuf_t *data)
+{
+	// message type
+	*buffer++ = type;
+
+	// length
+	*buffer++ = data->cursize & 0xff;
+	*buffer++ = data->cursize >> 8;
+
+	// align
+	buffer++;
+
+	// message
+	Q_memcpy(buffer, data->data, data->cursize);
+}
+
+
 int Loop_GetMessage (qsocket_t *sock)
 {
 	int		ret;
 	int		length;
+	byte	*message;
+
+	// the message handed out last time is done with
+	sock->receiveMessageStart += sock->receiveMessageHeld;
+	sock->receiveMessageHeld = 0;
+	if (sock->receiveMessageStart == sock->receiveMessageLength)
+		sock->receiveMessageStart = sock->receiveMessageLength = 0;
 
 	if (sock->receiveMessageLength == 0)
 		return 0;
 
-	ret = sock->receiveMessage[0];
-	length = sock->receiveMessage[1] + (sock->receiveMessage[2] << 8);
+	message = sock->receiveMessage + sock->receiveMessageStart;
+	ret = message[0];
+	length = message[1] + (message[2] << 8);
 	// alignment byte skipped here
-	SZ_Clear (&net_message);
-	SZ_Write (&net_message, &sock->receiveMessage[4], length);
-
-	length = IntAlign(length + 4);
-	sock->receiveMessageLength -= length;
-
-	if (sock->receiveMessageLength)
-		Q_memcpy(sock->receiveMessage, &sock->receiveMessage[length], sock->receiveMessageLength);
+	NET_ViewMessage (message + 4, length);
+	sock->receiveMessageHeld = IntAlign(length + 4);
 
 	if (sock->driverdata && ret == 1)
 		((qsocket_t *)sock->driverdata)->canSend = true;
@@ -154,31 +237,14 @@ int Loop_GetMessage (qsocket_t *sock)
 int Loop_SendMessage (qsocket_t *sock, sizebuf_t *data)
 {
 	byte *buffer;
-	int  *bufferLength;
 
 	if (!sock->driverdata)
 		return -1;
 
-	bufferLength = &((qsocket_t *)sock->driverdata)->receiveMessageLength;
-
-	if ((*bufferLength + data->cursize + 4) > NET_MAXMESSAGE)
+	buffer = Loop_GetSpace ((qsocket_t *)sock->driverdata, data->cursize);
+	if (!buffer)
 		Sys_Error("Loop_SendMessage: overflow\n");
-
-	buffer = ((qsocket_t *)sock->driverdata)->receiveMessage + *bufferLength;
-
-	// message type
-	*buffer++ = 1;
-
-	// length
-	*buffer++ = data->cursize & 0xff;
-	*buffer++ = data->cursize >> 8;
-
-	// align
-	buffer++;
-
-	// message
-	Q_memcpy(buffer, data->data, data->cursize);
-	*bufferLength = IntAlign(*bufferLength + data->cursize + 4);
+	Loop_WriteMessage (buffer, 1, data);
 
 	sock->canSend = false;
 	return 1;
@@ -188,31 +254,14 @@ int Loop_SendMessage (qsocket_t *sock, sizebuf_t *data)
 int Loop_SendUnreliableMessage (qsocket_t *sock, sizebuf_t *data)
 {
 	byte *buffer;
-	int  *bufferLength;
 
 	if (!sock->driverdata)
 		return -1;
 
-	bufferLength = &((qsocket_t *)sock->driverdata)->receiveMessageLength;
-
-	if ((*bufferLength + data->cursize + sizeof(byte) + sizeof(short)) > NET_MAXMESSAGE)
+	buffer = Loop_GetSpace ((qsocket_t *)sock->driverdata, data->cursize);
+	if (!buffer)
 		return 0;
-
-	buffer = ((qsocket_t *)sock->driverdata)->receiveMessage + *bufferLength;
-
-	// message type
-	*buffer++ = 2;
-
-	// length
-	*buffer++ = data->cursize & 0xff;
-	*buffer++ = data->cursize >> 8;
-
-	// align
-	buffer++;
-
-	// message
-	Q_memcpy(buffer, data->data, data->cursize);
-	*bufferLength = IntAlign(*bufferLength + data->cursize + 4);
+	Loop_WriteMessage (buffer, 2, data);
 	return 1;
 }
 
@@ -235,9 +284,7 @@ void Loop_Close (qsocket_t *sock)
 {
 	if (sock->driverdata)
 		((qsocket_t *)sock->driverdata)->driverdata = NULL;
-	sock->receiveMessageLength = 0;
-	sock->sendMessageLength = 0;
-	sock->canSend = true;
+	Loop_ClearMessages (sock);
 	if (sock == loop_client)
 		loop_client = NULL;
 	else
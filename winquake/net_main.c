@@ -56,7 +56,9 @@ PollProcedure	slistPollProcedure = {NULL, 0.0, Slist_Poll};
 
 
 sizebuf_t		net_message;
+static byte		*net_messagebuffer;	// net_message's own data
 int				net_activeconnections = 0;
+qboolean		net_batching = false;
 
 int messagesSent = 0;
 int messagesReceived = 0;
@@ -141,6 +143,17 @@ qsocket_t *NET_NewQSocket (void)
 	sock->receiveSequence = 0;
 	sock->unreliableReceiveSequence = 0;
 	sock->receiveMessageLength = 0;
+	sock->maxprotocol = PROTOCOL_VERSION;
+	sock->windowed = false;
+	sock->rtt = sock->rttvar = 0;
+	sock->rto = 1.0;
+	sock->receiveHave = 0;
+	sock->receiveLast = -1;
+	sock->shared = false;
+	sock->demux.head = sock->demux.tail = NULL;
+	sock->demux.count = 0;
+	sock->receiveMessageStart = 0;
+	sock->receiveMessageHeld = 0;
 
 	return sock;
 }
@@ -372,6 +385,7 @@ qsocket_t *NET_Connect (char *host)
 	int				numdrivers = net_numdrivers;
 
 	SetNetTime();
+	NET_ReleaseMessage ();
 
 	if (host && *host == 0)
 		host = NULL;
@@ -459,6 +473,7 @@ qsocket_t *NET_CheckNewConnections (void)
 	qsocket_t	*ret;
 
 	SetNetTime();
+	NET_ReleaseMessage ();
 
 	for (net_driverlevel=0 ; net_driverlevel<net_numdrivers; net_driverlevel++)
 	{
@@ -551,6 +566,7 @@ int	NET_GetMessage (qsocket_t *sock)
 	}
 
 	SetNetTime();
+	NET_ReleaseMessage ();
 
 	ret = sfunc.QGetMessage(sock);
 
@@ -793,6 +809,78 @@ int NET_SendToAll(sizebuf_t *data, int blocktime)
 }
 
 
+/*
+====================
+NET_ViewMessage
+
+Makes net_message a view of a message that a driver keeps in its own
+buffer, so it is read where it lies instead of being copied
+====================
+*/
+void NET_ViewMessage (void *data, int length)
+{
+	SZ_View (&net_message, data, length);
+}
+
+/*
+====================
+NET_ReleaseMessage
+
+Gives net_message its own buffer back, empty, if it was a view.  Every
+network call that can read into net_message or build a packet in it does
+this first.
+====================
+*/
+void NET_ReleaseMessage (void)
+{
+	if (net_message.data == net_messagebuffer)
+		return;
+	net_message.data = net_messagebuffer;
+	net_message.maxsize = NET_MAXMESSAGE;
+	net_message.cursize = 0;
+}
+
+/*
+====================
+NET_BeginBatch
+====================
+*/
+void NET_BeginBatch (void)
+{
+	net_batching = true;
+}
+
+/*
+====================
+NET_EndBatch
+
+Writes out what the drivers held on to since NET_BeginBatch
+====================
+*/
+void NET_EndBatch (void)
+{
+	net_batching = false;
+	for (net_driverlevel=0 ; net_driverlevel<net_numdrivers; net_driverlevel++)
+		if (net_drivers[net_driverlevel].initialized && net_drivers[net_driverlevel].Flush)
+			net_drivers[net_driverlevel].Flush ();
+}
+
+/*
+====================
+NET_Sleep
+
+Only the first driver that can wait is waited on
+====================
+*/
+qboolean NET_Sleep (double seconds)
+{
+	for (net_driverlevel=0 ; net_driverlevel<net_numdrivers; net_driverlevel++)
+		if (net_drivers[net_driverlevel].initialized && net_drivers[net_driverlevel].Sleep)
+			return net_drivers[net_driverlevel].Sleep (seconds);
+	return false;
+}
+
+
 //=============================================================================
 
 /*
@@ -849,6 +937,7 @@ void NET_Init (void)
 
 	// allocate space for network message buffer
 	SZ_Alloc (&net_message, NET_MAXMESSAGE);
+	net_messagebuffer = net_message.data;
 
 	Cvar_RegisterVariable (&net_messagetimeout);
 	Cvar_RegisterVariable (&hostname);
@@ -944,6 +1033,7 @@ void NET_Poll(void)
 	}
 
 	SetNetTime();
+	NET_ReleaseMessage ();
 
 	for (pp = pollProcedureList; pp; pp = pp->next)
 	{
@@ -19,6 +19,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 // net_udp.c
 
+#ifdef __linux__
+#define _GNU_SOURCE		// for recvmmsg and sendmmsg
+#endif
+
 #include "quakedef.h"
 
 #include <sys/types.h>
@@ -27,6 +31,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <netdb.h>
 #include <sys/param.h>
 #include <sys/ioctl.h>
+#include <poll.h>
 #include <errno.h>
 
 #ifdef __sun__
@@ -41,7 +46,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <arpa/inet.h>
 #endif
 
+#ifndef _GNU_SOURCE		// unistd.h has it then
 extern int gethostname (char *, int);
+#endif
 extern int close (int);
 
 extern cvar_t hostname;
@@ -306,6 +313,119 @@ int UDP_Write (int socket, byte *buf, int len, struct qsockaddr *addr)
 
 //=============================================================================
 
+/*
+Reads as many of the datagrams waiting on the socket as fit in packets with
+one recvmmsg, or one at a time where there is no recvmmsg.  Returns how many
+were read.
+*/
+int UDP_ReadBatch (int socket, netpacket_t *packets, int count)
+{
+#ifdef __linux__
+	struct mmsghdr	msgs[MAX_NET_BATCH];
+	struct iovec	iov[MAX_NET_BATCH];
+	int				i, ret;
+
+	if (count > MAX_NET_BATCH)
+		count = MAX_NET_BATCH;
+	Q_memset (msgs, 0, count * sizeof(msgs[0]));
+	for (i = 0; i < count; i++)
+	{
+		iov[i].iov_base = packets[i].data;
+		iov[i].iov_len = NET_DATAGRAMSIZE;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = &packets[i].addr;
+		msgs[i].msg_hdr.msg_namelen = sizeof (struct qsockaddr);
+	}
+
+	ret = recvmmsg (socket, msgs, count, 0, NULL);
+	if (ret == -1 && (errno == EWOULDBLOCK || errno == ECONNREFUSED))
+		return 0;
+	for (i = 0; i < ret; i++)
+		packets[i].length = msgs[i].msg_len;
+	return ret;
+#else
+	int		i, ret;
+
+	for (i = 0; i < count; i++)
+	{
+		ret = UDP_Read (socket, packets[i].data, NET_DATAGRAMSIZE, &packets[i].addr);
+		if (ret == -1)
+			return i ? i : -1;
+		if (ret == 0)
+			break;
+		packets[i].length = ret;
+	}
+	return i;
+#endif
+}
+
+//=============================================================================
+
+/*
+Writes the packets with one sendmmsg, or one at a time where there is no
+sendmmsg.  Returns how many were written.
+*/
+int UDP_WriteBatch (int socket, netpacket_t *packets, int count)
+{
+#ifdef __linux__
+	struct mmsghdr	msgs[MAX_NET_BATCH];
+	struct iovec	iov[MAX_NET_BATCH];
+	int				i, ret;
+
+	if (count > MAX_NET_BATCH)
+		count = MAX_NET_BATCH;
+	Q_memset (msgs, 0, count * sizeof(msgs[0]));
+	for (i = 0; i < count; i++)
+	{
+		iov[i].iov_base = packets[i].data;
+		iov[i].iov_len = packets[i].length;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = &packets[i].addr;
+		msgs[i].msg_hdr.msg_namelen = sizeof (struct qsockaddr);
+	}
+
+	ret = sendmmsg (socket, msgs, count, 0);
+	if (ret == -1 && errno == EWOULDBLOCK)
+		return 0;
+	return ret;
+#else
+	int		i;
+
+	for (i = 0; i < count; i++)
+		if (UDP_Write (socket, packets[i].data, packets[i].length, &packets[i].addr) == -1)
+			return i ? i : -1;
+	return count;
+#endif
+}
+
+//=============================================================================
+
+/*
+Waits for the accept socket to become readable.  Returns 1 if it did, 0 if
+the time ran out and -1 if there is no accept socket.
+*/
+int UDP_Wait (double seconds)
+{
+	struct pollfd	fd;
+	int				ret;
+
+	if (net_acceptsocket == -1)
+		return -1;
+
+	fd.fd = net_acceptsocket;
+	fd.events = POLLIN;
+	fd.revents = 0;
+	// round up, so it doesn't wake just before the time and spin
+	ret = poll (&fd, 1, (int)(seconds * 1000) + 1);
+	if (ret == -1)
+		return errno == EINTR ? 0 : -1;
+	return ret > 0;
+}
+
+//=============================================================================
+
 char *UDP_AddrToString (struct qsockaddr *addr)
 {
 	static char buffer[22];
@@ -28,6 +28,9 @@ int  UDP_Connect (int socket, struct qsockaddr *addr);
 int  UDP_CheckNewConnections (void);
 int  UDP_Read (int socket, byte *buf, int len, struct qsockaddr *addr);
 int  UDP_Write (int socket, byte *buf, int len, struct qsockaddr *addr);
+int  UDP_ReadBatch (int socket, netpacket_t *packets, int count);
+int  UDP_WriteBatch (int socket, netpacket_t *packets, int count);
+int  UDP_Wait (double seconds);
 int  UDP_Broadcast (int socket, byte *buf, int len);
 char *UDP_AddrToString (struct qsockaddr *addr);
 int  UDP_StringToAddr (char *string, struct qsockaddr *addr);
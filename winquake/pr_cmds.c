@@ -727,8 +727,12 @@ int PF_newcheckclient (int check)
 // get the PVS for the entity
 	VectorAdd (ent->v.origin, ent->v.view_ofs, org);
 	leaf = Mod_PointInLeaf (org, sv.worldmodel);
-	pvs = Mod_LeafPVS (leaf, sv.worldmodel);
-	memcpy (checkpvs, pvs, (sv.worldmodel->numleafs+7)>>3 );
+	if (leaf != sv.checkleaf)
+	{	// checkpvs still holds the PVS if the leaf is the same
+		pvs = Mod_LeafPVS (leaf, sv.worldmodel);
+		memcpy (checkpvs, pvs, (sv.worldmodel->numleafs+7)>>3 );
+		sv.checkleaf = leaf;
+	}
 
 	return i;
 }
@@ -998,7 +1002,7 @@ void PF_Find (void)
 		t = E_STRING(ed,f);
 		if (!t)
 			continue;
-		if (!strcmp(t,s))
+		if (t == s || !strcmp(t,s))	// interned strings are the same
 		{
 			if (first == (edict_t *)sv.edicts)
 				first = ed;
@@ -1042,7 +1046,7 @@ void PF_Find (void)
 		t = E_STRING(ed,f);
 		if (!t)
 			continue;
-		if (!strcmp(t,s))
+		if (t == s || !strcmp(t,s))	// interned strings are the same
 		{
 			RETURN_EDICT(ed);
 			return;
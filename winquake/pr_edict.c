@@ -50,15 +50,39 @@ cvar_t	saved2 = {"saved2", "0", true};
 cvar_t	saved3 = {"saved3", "0", true};
 cvar_t	saved4 = {"saved4", "0", true};
 
-#define	MAX_FIELD_LEN	64
-#define GEFV_CACHESIZE	2
+extern	cvar_t	pr_threaded, pr_superops;
 
-typedef struct {
-	ddef_t	*pcache;
-	char	field[MAX_FIELD_LEN];
-} gefv_cache;
+/*
+Names of fields, globals and functions are found through hash tables built
+when progs.dat is loaded.  Each chain lists the defs in the order they come
+in progs.dat, so a name that is defined twice finds the same def as a
+search from the start would.
+*/
+typedef struct
+{
+	int		*heads;			// [mask+1], first def with that hash or -1
+	int		*next;			// [count], next def with the same hash or -1
+	int		mask;
+} prhash_t;
+
+static prhash_t	pr_fieldhash, pr_globalhash, pr_functionhash;
+
+/*
+Strings from entity and saved game text are interned: ED_NewString hands
+out one copy of each distinct value per map, or the progs' own copy when
+the value is the name of a function, as classnames are.  Equal interned
+strings are then the same pointer.
+*/
+#define	ED_STRINGHASH	1024
 
-static gefv_cache	gefvCache[GEFV_CACHESIZE] = {{NULL, ""}, {NULL, ""}};
+typedef struct edstring_s
+{
+	struct edstring_s	*next;
+	char				string[4];	// variable sized
+} edstring_t;
+
+static edstring_t	**ed_strings;	// [ED_STRINGHASH], cleared with the progs
+static int			ed_numshared, ed_sharedbytes;
 
 /*
 =================
@@ -71,6 +95,7 @@ void ED_ClearEdict (edict_t *e)
 {
 	memset (&e->v, 0, progs->entityfields * 4);
 	e->free = false;
+	SV_WakeEdict (e);
 }
 
 /*
@@ -178,6 +203,52 @@ ddef_t *ED_FieldAtOfs (int ofs)
 	return NULL;
 }
 
+/*
+============
+PR_HashName
+============
+*/
+static unsigned PR_HashName (char *name)
+{
+	unsigned	hash;
+
+	hash = 0;
+	while (*name)
+		hash = hash * 31 + *name++;
+
+	return hash;
+}
+
+/*
+============
+PR_BuildHash
+
+Hashes the names of count defs, the first of which is at names, that are
+size bytes apart
+============
+*/
+static void PR_BuildHash (prhash_t *hash, string_t *names, int size, int count, char *name)
+{
+	int		i, h, tablesize;
+	string_t	s_name;
+
+	for (tablesize=64 ; tablesize < count*2 ; tablesize<<=1)
+		;
+	hash->mask = tablesize - 1;
+	hash->heads = Hunk_AllocName (tablesize*sizeof(int), name);
+	hash->next = Hunk_AllocName ((count ? count : 1)*sizeof(int), name);
+	memset (hash->heads, 0xff, tablesize*sizeof(int));
+
+// link from the back so each chain runs in progs.dat order
+	for (i=count-1 ; i>=0 ; i--)
+	{
+		s_name = *(string_t *)((byte *)names + i*size);
+		h = PR_HashName (pr_strings + s_name) & hash->mask;
+		hash->next[i] = hash->heads[h];
+		hash->heads[h] = i;
+	}
+}
+
 /*
 ============
 ED_FindField
@@ -188,7 +259,8 @@ ddef_t *ED_FindField (char *name)
 	ddef_t		*def;
 	int			i;
 	
-	for (i=0 ; i<progs->numfielddefs ; i++)
+	for (i = pr_fieldhash.heads[PR_HashName (name) & pr_fieldhash.mask] ; i != -1
+		; i = pr_fieldhash.next[i])
 	{
 		def = &pr_fielddefs[i];
 		if (!strcmp(pr_strings + def->s_name,name) )
@@ -208,7 +280,8 @@ ddef_t *ED_FindGlobal (char *name)
 	ddef_t		*def;
 	int			i;
 	
-	for (i=0 ; i<progs->numglobaldefs ; i++)
+	for (i = pr_globalhash.heads[PR_HashName (name) & pr_globalhash.mask] ; i != -1
+		; i = pr_globalhash.next[i])
 	{
 		def = &pr_globaldefs[i];
 		if (!strcmp(pr_strings + def->s_name,name) )
@@ -228,7 +301,8 @@ dfunction_t *ED_FindFunction (char *name)
 	dfunction_t		*func;
 	int				i;
 	
-	for (i=0 ; i<progs->numfunctions ; i++)
+	for (i = pr_functionhash.heads[PR_HashName (name) & pr_functionhash.mask] ; i != -1
+		; i = pr_functionhash.next[i])
 	{
 		func = &pr_functions[i];
 		if (!strcmp(pr_strings + func->s_name,name) )
@@ -238,31 +312,122 @@ dfunction_t *ED_FindFunction (char *name)
 }
 
 
-eval_t *GetEdictFieldValue(edict_t *ed, char *field)
+#if idtiming
+static void		**time_found;
+
+/*
+============
+PR_TimeFindRun
+
+Looks up the name of every field, global and function by searching the
+defs from the start, as ED_Find* used to, or through the hash tables
+============
+*/
+static int PR_TimeFindRun (int pass, qboolean check)
 {
-	ddef_t			*def = NULL;
-	int				i;
-	static int		rep = 0;
+	int		i, n, diffs, lookups;
+	char	*name;
+	void	*found;
 
-	for (i=0 ; i<GEFV_CACHESIZE ; i++)
+	diffs = 0;
+	lookups = progs->numfielddefs + progs->numglobaldefs + progs->numfunctions;
+	for (i=0 ; i<lookups ; i++)
 	{
-		if (!strcmp(field, gefvCache[i].field))
+		if (i < progs->numfielddefs)
 		{
-			def = gefvCache[i].pcache;
-			goto Done;
+			name = pr_strings + pr_fielddefs[i].s_name;
+			if (pass)
+				found = ED_FindField (name);
+			else
+			{
+				for (n=0 ; n<progs->numfielddefs ; n++)
+					if (!strcmp(pr_strings + pr_fielddefs[n].s_name, name))
+						break;
+				found = &pr_fielddefs[n];
+			}
 		}
+		else if (i < progs->numfielddefs + progs->numglobaldefs)
+		{
+			name = pr_strings + pr_globaldefs[i - progs->numfielddefs].s_name;
+			if (pass)
+				found = ED_FindGlobal (name);
+			else
+			{
+				for (n=0 ; n<progs->numglobaldefs ; n++)
+					if (!strcmp(pr_strings + pr_globaldefs[n].s_name, name))
+						break;
+				found = &pr_globaldefs[n];
+			}
+		}
+		else
+		{
+			name = pr_strings + pr_functions[i - progs->numfielddefs - progs->numglobaldefs].s_name;
+			if (pass)
+				found = ED_FindFunction (name);
+			else
+			{
+				for (n=0 ; n<progs->numfunctions ; n++)
+					if (!strcmp(pr_strings + pr_functions[n].s_name, name))
+						break;
+				found = &pr_functions[n];
+			}
+		}
+
+		if (!check)
+			continue;
+		if (!pass)
+			time_found[i] = found;
+		else if (found != time_found[i])
+			diffs++;
 	}
+	return diffs;
+}
 
-	def = ED_FindField (field);
+/*
+============
+PR_TimeFind_f
+
+timefind [count]
+Looks up every field, global and function name both ways, and checks they
+find the same defs
+============
+*/
+void PR_TimeFind_f (void)
+{
+	timing_t	t;
+	int		count, lookups;
 
-	if (strlen(field) < MAX_FIELD_LEN)
+	if (!progs)
 	{
-		gefvCache[rep].pcache = def;
-		strcpy (gefvCache[rep].field, field);
-		rep ^= 1;
+		Con_Printf ("No progs loaded\n");
+		return;
 	}
+	count = Timing_Count (1, 100);
+
+	lookups = progs->numfielddefs + progs->numglobaldefs + progs->numfunctions;
+	time_found = Hunk_TempAlloc (lookups * sizeof(*time_found));
+
+	memset (&t, 0, sizeof(t));
+	t.numpasses = 2;
+	t.names[0] = "search";
+	t.names[1] = "hash";
+	t.unit = "lookup";
+	t.results = "lookups";
+	t.run = PR_TimeFindRun;
+	Timing_Run (&t, count);
+
+	Con_Printf ("%i fields, %i globals, %i functions\n", progs->numfielddefs,
+		progs->numglobaldefs, progs->numfunctions);
+	Timing_Print (&t, count * lookups);
+}
+#endif
+
+
+eval_t *GetEdictFieldValue(edict_t *ed, char *field)
+{
+	ddef_t			*def;
 
-Done:
+	def = ED_FindField (field);
 	if (!def)
 		return NULL;
 
@@ -596,6 +761,7 @@ void ED_Count (void)
 	Con_Printf ("view      :%3i\n", models);
 	Con_Printf ("touch     :%3i\n", solid);
 	Con_Printf ("step      :%3i\n", step);
+	Con_Printf ("awake     :%3i\n", SV_NumAwakeEdicts ());
 
 }
 
@@ -687,33 +853,92 @@ void ED_ParseGlobals (char *data)
 
 /*
 =============
-ED_NewString
+ED_Unescape
+
+Copies the l bytes of string to out with \n escapes turned into newlines,
+and returns how many bytes were written
 =============
 */
-char *ED_NewString (char *string)
+static int ED_Unescape (char *out, char *string, int l)
 {
-	char	*new, *new_p;
-	int		i,l;
-	
-	l = strlen(string) + 1;
-	new = Hunk_Alloc (l);
-	new_p = new;
+	char	*out_p;
+	int		i;
 
+	out_p = out;
 	for (i=0 ; i< l ; i++)
 	{
 		if (string[i] == '\\' && i < l-1)
 		{
 			i++;
 			if (string[i] == 'n')
-				*new_p++ = '\n';
+				*out_p++ = '\n';
 			else
-				*new_p++ = '\\';
+				*out_p++ = '\\';
 		}
 		else
-			*new_p++ = string[i];
+			*out_p++ = string[i];
 	}
+
+	return out_p - out;
+}
+
+/*
+=============
+ED_NewString
+
+Returns the interned copy of string, with \n escapes turned into newlines
+=============
+*/
+char *ED_NewString (char *string)
+{
+	char		buf[1024], *new;
+	int			l, h;
+	edstring_t	*e;
+	dfunction_t	*func;
 	
-	return new;
+	l = strlen(string) + 1;
+	if (l > sizeof(buf))
+	{	// too long to be worth sharing
+		new = Hunk_Alloc (l);
+		ED_Unescape (new, string, l);
+		return new;
+	}
+
+	l = ED_Unescape (buf, string, l);
+	func = ED_FindFunction (buf);
+	if (func)
+	{
+		ed_numshared++;
+		ed_sharedbytes += l;
+		return pr_strings + func->s_name;
+	}
+
+	h = PR_HashName (buf) & (ED_STRINGHASH-1);
+	for (e = ed_strings[h] ; e ; e = e->next)
+		if (!strcmp (e->string, buf))
+		{
+			ed_numshared++;
+			ed_sharedbytes += l;
+			return e->string;
+		}
+
+	e = Hunk_Alloc (sizeof(edstring_t) - sizeof(e->string) + l);
+	memcpy (e->string, buf, l);
+	e->next = ed_strings[h];
+	ed_strings[h] = e;
+	return e->string;
+}
+
+/*
+=============
+ED_PrintStringStats
+
+For debugging, prints how many entity strings were shared this map
+=============
+*/
+static void ED_PrintStringStats (void)
+{
+	Con_Printf ("%i entity strings shared, %i bytes saved\n", ed_numshared, ed_sharedbytes);
 }
 
 
@@ -986,10 +1211,6 @@ void PR_LoadProgs (void)
 {
 	int		i;
 
-// flush the non-C variable lookup cache
-	for (i=0 ; i<GEFV_CACHESIZE ; i++)
-		gefvCache[i].field[0] = 0;
-
 	CRC_Init (&pr_crc);
 
 	progs = (dprograms_t *)COM_LoadHunkFile ("progs.dat");
@@ -1057,6 +1278,18 @@ void PR_LoadProgs (void)
 
 	for (i=0 ; i<progs->numglobals ; i++)
 		((int *)pr_globals)[i] = LittleLong (((int *)pr_globals)[i]);
+
+	ed_strings = Hunk_AllocName (ED_STRINGHASH*sizeof(edstring_t *), "edstring");
+	ed_numshared = ed_sharedbytes = 0;
+
+	PR_BuildHash (&pr_fieldhash, &pr_fielddefs->s_name, sizeof(ddef_t),
+		progs->numfielddefs, "fieldhash");
+	PR_BuildHash (&pr_globalhash, &pr_globaldefs->s_name, sizeof(ddef_t),
+		progs->numglobaldefs, "globalhash");
+	PR_BuildHash (&pr_functionhash, &pr_functions->s_name, sizeof(dfunction_t),
+		progs->numfunctions, "funchash");
+
+	PR_DecodeProgs ();
 }
 
 
@@ -1070,7 +1303,14 @@ void PR_Init (void)
 	Cmd_AddCommand ("edict", ED_PrintEdict_f);
 	Cmd_AddCommand ("edicts", ED_PrintEdicts);
 	Cmd_AddCommand ("edictcount", ED_Count);
+	Cmd_AddCommand ("edstrings", ED_PrintStringStats);
 	Cmd_AddCommand ("profile", PR_Profile_f);
+#if idtiming
+	Cmd_AddCommand ("timeprogs", PR_TimeProgs_f);
+	Cmd_AddCommand ("timefind", PR_TimeFind_f);
+#endif
+	Cvar_RegisterVariable (&pr_threaded);
+	Cvar_RegisterVariable (&pr_superops);
 	Cvar_RegisterVariable (&nomonsters);
 	Cvar_RegisterVariable (&gamecfg);
 	Cvar_RegisterVariable (&scratch1);
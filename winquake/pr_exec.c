@@ -47,6 +47,68 @@ int			pr_xstatement;
 
 int		pr_argc;
 
+cvar_t	pr_threaded = {"pr_threaded", "1"};
+cvar_t	pr_superops = {"pr_superops", "1"};
+
+/*
+The threaded engine runs a copy of pr_statements decoded at load time, with
+the operands resolved to pointers into pr_globals and the branch targets to
+pointers into the copy.  With idthreaded each statement also carries the
+address of its handler, so every handler jumps straight to the next one.
+*/
+typedef struct prcode_s
+{
+#if idthreaded
+	void			*handler;		// label in PR_ExecuteThreaded
+#else
+	int				op;
+#endif
+	eval_t			*a, *b, *c;
+	struct prcode_s	*jump;			// OP_IF, OP_IFNOT and OP_GOTO target
+} prcode_t;
+
+prcode_t	*pr_code;
+
+/*
+Superinstructions run a few consecutive statements that qcc emits together
+from a single dispatch.  Only the first statement of the run is rewritten;
+the ones after it keep their own handlers for anything that branches into
+them, and the runaway and profile counts still advance once per statement.
+*/
+enum
+{
+	OPS_LOAD_IF = OP_BITOR + 1,	// field load, branch on it
+	OPS_LOAD_IFNOT,
+	OPS_LOAD_STORE,				// field load, copied to a global
+	OPS_LOAD_STORE_V,
+	OPS_ADDRESS_STOREP,			// field store
+	OPS_ADDRESS_STOREP_V,
+	OPS_EQ_F_IFNOT,				// compare, branch on it
+	OPS_NE_F_IFNOT,
+	OPS_LE_IFNOT,
+	OPS_GE_IFNOT,
+	OPS_LT_IFNOT,
+	OPS_GT_IFNOT,
+	OPS_LOAD_EQ_F_IFNOT,		// field load, compare, branch on it
+	OPS_LOAD_NE_F_IFNOT,
+	OPS_LOAD_LE_IFNOT,
+	OPS_LOAD_GE_IFNOT,
+	OPS_LOAD_LT_IFNOT,
+	OPS_LOAD_GT_IFNOT,
+	OPS_IF_GOTO,				// conditional jump over a goto
+	OPS_IFNOT_GOTO,
+	OPS_STORE_LOAD,				// entity stored to a local, field loaded through it
+	OPS_STORE_LOAD_V,
+	OPS_BAD,
+	NUM_PR_OPS
+};
+
+int		pr_fusedstatements;		// statements run without their own dispatch
+
+#if idthreaded
+static void	**pr_handlers;
+#endif
+
 char *pr_opnames[] =
 {
 "DONE",
@@ -355,38 +417,21 @@ int PR_LeaveFunction (void)
 
 /*
 ====================
-PR_ExecuteProgram
+PR_ExecuteSwitch
+
+Interprets pr_statements directly, starting after statement s.  Used when
+pr_threaded is off, and by the threaded engine once pr_trace is set.
 ====================
 */
-void PR_ExecuteProgram (func_t fnum)
+void PR_ExecuteSwitch (int s, int exitdepth, int runaway)
 {
 	eval_t	*a, *b, *c;
-	int			s;
 	dstatement_t	*st;
-	dfunction_t	*f, *newf;
-	int		runaway;
+	dfunction_t	*newf;
 	int		i;
 	edict_t	*ed;
-	int		exitdepth;
 	eval_t	*ptr;
 
-	if (!fnum || fnum >= progs->numfunctions)
-	{
-		if (pr_global_struct->self)
-			ED_Print (PROG_TO_EDICT(pr_global_struct->self));
-		Host_Error ("PR_ExecuteProgram: NULL function");
-	}
-	
-	f = &pr_functions[fnum];
-
-	runaway = 100000;
-	pr_trace = false;
-
-// make a stack frame
-	exitdepth = pr_depth;
-
-	s = PR_EnterFunction (f);
-	
 while (1)
 {
 	s++;	// next statement
@@ -565,6 +610,10 @@ while (1)
 #endif
 		if (ed == (edict_t *)sv.edicts && sv.state == ss_active)
 			PR_RunError ("assignment to world entity");
+		if (ed->asleep)
+			SV_WakeEdict (ed);
+		if (SV_TRACEFIELD(b->_int))
+			SV_InvalidateTraces ();
 		c->_int = (byte *)((int *)&ed->v + b->_int) - (byte *)sv.edicts;
 		break;
 		
@@ -648,6 +697,8 @@ while (1)
 		
 	case OP_STATE:
 		ed = PROG_TO_EDICT(pr_global_struct->self);
+		if (ed->asleep)
+			SV_WakeEdict (ed);
 #ifdef FPS_20
 		ed->v.nextthink = pr_global_struct->time + 0.05;
 #else
@@ -666,3 +717,870 @@ while (1)
 }
 
 }
+
+
+/*
+====================
+PR_ExecuteThreaded
+
+Runs the decoded statements from st on.  Called with a NULL st, it stores
+the handler address of every statement in pr_code instead.
+
+The profile counts are kept as runaway ticks and added to pr_xfunction only
+when it changes or something can look at them, and pr_xstatement is only
+stored before calls and errors.
+====================
+*/
+#if idthreaded
+#define	PR_OP(op)		L_##op:
+#define	PR_DISPATCH		goto *st->handler
+#define	PR_PLAIN		goto *handlers[pr_statements[st - pr_code].op]
+#else
+#define	PR_OP(op)		case op:
+#define	PR_DISPATCH		goto dispatch
+#define	PR_PLAIN		{ op = pr_statements[st - pr_code].op; goto redispatch; }
+#endif
+
+#define	PR_NEXT			{ if (!--runaway) goto runaway; st++; PR_DISPATCH; }
+#define	PR_JUMP(target)	{ if (!--runaway) goto runaway; st = (target); PR_DISPATCH; }
+#define	PR_PROFILE		{ pr_xfunction->profile += profilestart - runaway; profilestart = runaway; \
+						  pr_fusedstatements += fused; fused = 0; }
+
+// a superinstruction of n statements, run plainly when the runaway
+// check could trip inside it
+#define	PR_FUSED(n)		{ if (runaway <= (n)) PR_PLAIN; runaway -= (n) - 1; fused += (n) - 1; }
+
+#define	PR_CMP_IFNOT(cmp)	\
+		st->c->_float = st->a->_float cmp st->b->_float;	\
+		st++;	\
+		if (!st->a->_int)	\
+			PR_JUMP(st->jump);	\
+		PR_NEXT;
+
+#define	PR_LOAD_CMP_IFNOT(cmp)	\
+		PR_FUSED(3);	\
+		ed = PROG_TO_EDICT(st->a->edict);	\
+		st->c->_int = ((int *)&ed->v)[st->b->_int];	\
+		st++;	\
+		PR_CMP_IFNOT(cmp)
+
+void PR_ExecuteThreaded (prcode_t *st, int exitdepth)
+{
+	eval_t	*a, *b, *c;
+	dfunction_t	*newf;
+	int		runaway, profilestart, fused;
+	int		i, s;
+	edict_t	*ed;
+	eval_t	*ptr;
+#if !idthreaded
+	int		op;
+#endif
+
+#if idthreaded
+	static void *handlers[] =
+	{
+		&&L_OP_DONE, &&L_OP_MUL_F, &&L_OP_MUL_V, &&L_OP_MUL_FV, &&L_OP_MUL_VF,
+		&&L_OP_DIV_F, &&L_OP_ADD_F, &&L_OP_ADD_V, &&L_OP_SUB_F, &&L_OP_SUB_V,
+		&&L_OP_EQ_F, &&L_OP_EQ_V, &&L_OP_EQ_S, &&L_OP_EQ_E, &&L_OP_EQ_FNC,
+		&&L_OP_NE_F, &&L_OP_NE_V, &&L_OP_NE_S, &&L_OP_NE_E, &&L_OP_NE_FNC,
+		&&L_OP_LE, &&L_OP_GE, &&L_OP_LT, &&L_OP_GT,
+		&&L_OP_LOAD_F, &&L_OP_LOAD_V, &&L_OP_LOAD_S, &&L_OP_LOAD_ENT,
+		&&L_OP_LOAD_FLD, &&L_OP_LOAD_FNC, &&L_OP_ADDRESS,
+		&&L_OP_STORE_F, &&L_OP_STORE_V, &&L_OP_STORE_S, &&L_OP_STORE_ENT,
+		&&L_OP_STORE_FLD, &&L_OP_STORE_FNC,
+		&&L_OP_STOREP_F, &&L_OP_STOREP_V, &&L_OP_STOREP_S, &&L_OP_STOREP_ENT,
+		&&L_OP_STOREP_FLD, &&L_OP_STOREP_FNC,
+		&&L_OP_RETURN, &&L_OP_NOT_F, &&L_OP_NOT_V, &&L_OP_NOT_S, &&L_OP_NOT_ENT,
+		&&L_OP_NOT_FNC, &&L_OP_IF, &&L_OP_IFNOT,
+		&&L_OP_CALL0, &&L_OP_CALL1, &&L_OP_CALL2, &&L_OP_CALL3, &&L_OP_CALL4,
+		&&L_OP_CALL5, &&L_OP_CALL6, &&L_OP_CALL7, &&L_OP_CALL8,
+		&&L_OP_STATE, &&L_OP_GOTO, &&L_OP_AND, &&L_OP_OR,
+		&&L_OP_BITAND, &&L_OP_BITOR,
+		&&L_OPS_LOAD_IF, &&L_OPS_LOAD_IFNOT, &&L_OPS_LOAD_STORE, &&L_OPS_LOAD_STORE_V,
+		&&L_OPS_ADDRESS_STOREP, &&L_OPS_ADDRESS_STOREP_V,
+		&&L_OPS_EQ_F_IFNOT, &&L_OPS_NE_F_IFNOT, &&L_OPS_LE_IFNOT, &&L_OPS_GE_IFNOT,
+		&&L_OPS_LT_IFNOT, &&L_OPS_GT_IFNOT,
+		&&L_OPS_LOAD_EQ_F_IFNOT, &&L_OPS_LOAD_NE_F_IFNOT, &&L_OPS_LOAD_LE_IFNOT,
+		&&L_OPS_LOAD_GE_IFNOT, &&L_OPS_LOAD_LT_IFNOT, &&L_OPS_LOAD_GT_IFNOT,
+		&&L_OPS_IF_GOTO, &&L_OPS_IFNOT_GOTO,
+		&&L_OPS_STORE_LOAD, &&L_OPS_STORE_LOAD_V,
+		&&L_OPS_BAD
+	};
+
+	if (!st)
+	{	// hand the labels to PR_DecodeProgs
+		pr_handlers = handlers;
+		return;
+	}
+#endif
+
+	runaway = 100000;
+	profilestart = runaway;
+	fused = 0;
+
+	runaway--;
+	PR_DISPATCH;
+
+#if !idthreaded
+dispatch:
+	op = st->op;
+redispatch:
+	switch (op)
+	{
+	default:
+		goto badop;
+#endif
+
+	PR_OP(OP_ADD_F)
+		st->c->_float = st->a->_float + st->b->_float;
+		PR_NEXT;
+	PR_OP(OP_ADD_V)
+		a = st->a; b = st->b; c = st->c;
+		c->vector[0] = a->vector[0] + b->vector[0];
+		c->vector[1] = a->vector[1] + b->vector[1];
+		c->vector[2] = a->vector[2] + b->vector[2];
+		PR_NEXT;
+
+	PR_OP(OP_SUB_F)
+		st->c->_float = st->a->_float - st->b->_float;
+		PR_NEXT;
+	PR_OP(OP_SUB_V)
+		a = st->a; b = st->b; c = st->c;
+		c->vector[0] = a->vector[0] - b->vector[0];
+		c->vector[1] = a->vector[1] - b->vector[1];
+		c->vector[2] = a->vector[2] - b->vector[2];
+		PR_NEXT;
+
+	PR_OP(OP_MUL_F)
+		st->c->_float = st->a->_float * st->b->_float;
+		PR_NEXT;
+	PR_OP(OP_MUL_V)
+		a = st->a; b = st->b;
+		st->c->_float = a->vector[0]*b->vector[0]
+				+ a->vector[1]*b->vector[1]
+				+ a->vector[2]*b->vector[2];
+		PR_NEXT;
+	PR_OP(OP_MUL_FV)
+		a = st->a; b = st->b; c = st->c;
+		c->vector[0] = a->_float * b->vector[0];
+		c->vector[1] = a->_float * b->vector[1];
+		c->vector[2] = a->_float * b->vector[2];
+		PR_NEXT;
+	PR_OP(OP_MUL_VF)
+		a = st->a; b = st->b; c = st->c;
+		c->vector[0] = b->_float * a->vector[0];
+		c->vector[1] = b->_float * a->vector[1];
+		c->vector[2] = b->_float * a->vector[2];
+		PR_NEXT;
+
+	PR_OP(OP_DIV_F)
+		st->c->_float = st->a->_float / st->b->_float;
+		PR_NEXT;
+
+	PR_OP(OP_BITAND)
+		st->c->_float = (int)st->a->_float & (int)st->b->_float;
+		PR_NEXT;
+	PR_OP(OP_BITOR)
+		st->c->_float = (int)st->a->_float | (int)st->b->_float;
+		PR_NEXT;
+
+	PR_OP(OP_GE)
+		st->c->_float = st->a->_float >= st->b->_float;
+		PR_NEXT;
+	PR_OP(OP_LE)
+		st->c->_float = st->a->_float <= st->b->_float;
+		PR_NEXT;
+	PR_OP(OP_GT)
+		st->c->_float = st->a->_float > st->b->_float;
+		PR_NEXT;
+	PR_OP(OP_LT)
+		st->c->_float = st->a->_float < st->b->_float;
+		PR_NEXT;
+	PR_OP(OP_AND)
+		st->c->_float = st->a->_float && st->b->_float;
+		PR_NEXT;
+	PR_OP(OP_OR)
+		st->c->_float = st->a->_float || st->b->_float;
+		PR_NEXT;
+
+	PR_OP(OP_NOT_F)
+		st->c->_float = !st->a->_float;
+		PR_NEXT;
+	PR_OP(OP_NOT_V)
+		a = st->a;
+		st->c->_float = !a->vector[0] && !a->vector[1] && !a->vector[2];
+		PR_NEXT;
+	PR_OP(OP_NOT_S)
+		a = st->a;
+		st->c->_float = !a->string || !pr_strings[a->string];
+		PR_NEXT;
+	PR_OP(OP_NOT_FNC)
+		st->c->_float = !st->a->function;
+		PR_NEXT;
+	PR_OP(OP_NOT_ENT)
+		st->c->_float = (PROG_TO_EDICT(st->a->edict) == sv.edicts);
+		PR_NEXT;
+
+	PR_OP(OP_EQ_F)
+		st->c->_float = st->a->_float == st->b->_float;
+		PR_NEXT;
+	PR_OP(OP_EQ_V)
+		a = st->a; b = st->b;
+		st->c->_float = (a->vector[0] == b->vector[0]) &&
+					(a->vector[1] == b->vector[1]) &&
+					(a->vector[2] == b->vector[2]);
+		PR_NEXT;
+	PR_OP(OP_EQ_S)
+		st->c->_float = !strcmp(pr_strings+st->a->string,pr_strings+st->b->string);
+		PR_NEXT;
+	PR_OP(OP_EQ_E)
+		st->c->_float = st->a->_int == st->b->_int;
+		PR_NEXT;
+	PR_OP(OP_EQ_FNC)
+		st->c->_float = st->a->function == st->b->function;
+		PR_NEXT;
+
+	PR_OP(OP_NE_F)
+		st->c->_float = st->a->_float != st->b->_float;
+		PR_NEXT;
+	PR_OP(OP_NE_V)
+		a = st->a; b = st->b;
+		st->c->_float = (a->vector[0] != b->vector[0]) ||
+					(a->vector[1] != b->vector[1]) ||
+					(a->vector[2] != b->vector[2]);
+		PR_NEXT;
+	PR_OP(OP_NE_S)
+		st->c->_float = strcmp(pr_strings+st->a->string,pr_strings+st->b->string);
+		PR_NEXT;
+	PR_OP(OP_NE_E)
+		st->c->_float = st->a->_int != st->b->_int;
+		PR_NEXT;
+	PR_OP(OP_NE_FNC)
+		st->c->_float = st->a->function != st->b->function;
+		PR_NEXT;
+
+//==================
+	PR_OP(OP_STORE_F)
+	PR_OP(OP_STORE_ENT)
+	PR_OP(OP_STORE_FLD)		// integers
+	PR_OP(OP_STORE_S)
+	PR_OP(OP_STORE_FNC)		// pointers
+		st->b->_int = st->a->_int;
+		PR_NEXT;
+	PR_OP(OP_STORE_V)
+		a = st->a; b = st->b;
+		b->vector[0] = a->vector[0];
+		b->vector[1] = a->vector[1];
+		b->vector[2] = a->vector[2];
+		PR_NEXT;
+
+	PR_OP(OP_STOREP_F)
+	PR_OP(OP_STOREP_ENT)
+	PR_OP(OP_STOREP_FLD)		// integers
+	PR_OP(OP_STOREP_S)
+	PR_OP(OP_STOREP_FNC)		// pointers
+		ptr = (eval_t *)((byte *)sv.edicts + st->b->_int);
+		ptr->_int = st->a->_int;
+		PR_NEXT;
+	PR_OP(OP_STOREP_V)
+		a = st->a;
+		ptr = (eval_t *)((byte *)sv.edicts + st->b->_int);
+		ptr->vector[0] = a->vector[0];
+		ptr->vector[1] = a->vector[1];
+		ptr->vector[2] = a->vector[2];
+		PR_NEXT;
+
+	PR_OP(OP_ADDRESS)
+		ed = PROG_TO_EDICT(st->a->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);		// make sure it's in range
+#endif
+		if (ed == (edict_t *)sv.edicts && sv.state == ss_active)
+		{
+			pr_xstatement = st - pr_code;
+			PR_PROFILE;
+			PR_RunError ("assignment to world entity");
+		}
+		if (ed->asleep)
+			SV_WakeEdict (ed);
+		if (SV_TRACEFIELD(st->b->_int))
+			SV_InvalidateTraces ();
+		st->c->_int = (byte *)((int *)&ed->v + st->b->_int) - (byte *)sv.edicts;
+		PR_NEXT;
+
+	PR_OP(OP_LOAD_F)
+	PR_OP(OP_LOAD_FLD)
+	PR_OP(OP_LOAD_ENT)
+	PR_OP(OP_LOAD_S)
+	PR_OP(OP_LOAD_FNC)
+		ed = PROG_TO_EDICT(st->a->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);		// make sure it's in range
+#endif
+		a = (eval_t *)((int *)&ed->v + st->b->_int);
+		st->c->_int = a->_int;
+		PR_NEXT;
+
+	PR_OP(OP_LOAD_V)
+		ed = PROG_TO_EDICT(st->a->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);		// make sure it's in range
+#endif
+		a = (eval_t *)((int *)&ed->v + st->b->_int);
+		c = st->c;
+		c->vector[0] = a->vector[0];
+		c->vector[1] = a->vector[1];
+		c->vector[2] = a->vector[2];
+		PR_NEXT;
+
+//==================
+
+	PR_OP(OP_IFNOT)
+		if (!st->a->_int)
+			PR_JUMP(st->jump);
+		PR_NEXT;
+
+	PR_OP(OP_IF)
+		if (st->a->_int)
+			PR_JUMP(st->jump);
+		PR_NEXT;
+
+	PR_OP(OP_GOTO)
+		PR_JUMP(st->jump);
+
+	PR_OP(OP_CALL0)
+		pr_argc = 0;
+		goto call;
+	PR_OP(OP_CALL1)
+		pr_argc = 1;
+		goto call;
+	PR_OP(OP_CALL2)
+		pr_argc = 2;
+		goto call;
+	PR_OP(OP_CALL3)
+		pr_argc = 3;
+		goto call;
+	PR_OP(OP_CALL4)
+		pr_argc = 4;
+		goto call;
+	PR_OP(OP_CALL5)
+		pr_argc = 5;
+		goto call;
+	PR_OP(OP_CALL6)
+		pr_argc = 6;
+		goto call;
+	PR_OP(OP_CALL7)
+		pr_argc = 7;
+		goto call;
+	PR_OP(OP_CALL8)
+		pr_argc = 8;
+call:
+		pr_xstatement = st - pr_code;
+		PR_PROFILE;
+		if (!st->a->function)
+			PR_RunError ("NULL function");
+
+		newf = &pr_functions[st->a->function];
+
+		if (newf->first_statement < 0)
+		{	// negative statements are built in functions
+			i = -newf->first_statement;
+			if (i >= pr_numbuiltins)
+				PR_RunError ("Bad builtin call number");
+			pr_builtins[i] ();
+			if (pr_trace)
+			{	// finish in the engine that prints statements
+				PR_ExecuteSwitch (st - pr_code, exitdepth, runaway);
+				return;
+			}
+			PR_NEXT;
+		}
+
+		s = PR_EnterFunction (newf);
+		PR_JUMP(pr_code + s + 1);
+
+	PR_OP(OP_DONE)
+	PR_OP(OP_RETURN)
+		a = st->a;
+		pr_globals[OFS_RETURN] = a->vector[0];
+		pr_globals[OFS_RETURN+1] = a->vector[1];
+		pr_globals[OFS_RETURN+2] = a->vector[2];
+
+		PR_PROFILE;
+		s = PR_LeaveFunction ();
+		if (pr_depth == exitdepth)
+			return;		// all done
+		PR_JUMP(pr_code + s + 1);
+
+	PR_OP(OP_STATE)
+		ed = PROG_TO_EDICT(pr_global_struct->self);
+		if (ed->asleep)
+			SV_WakeEdict (ed);
+#ifdef FPS_20
+		ed->v.nextthink = pr_global_struct->time + 0.05;
+#else
+		ed->v.nextthink = pr_global_struct->time + 0.1;
+#endif
+		if (st->a->_float != ed->v.frame)
+		{
+			ed->v.frame = st->a->_float;
+		}
+		ed->v.think = st->b->function;
+		PR_NEXT;
+
+//==================
+
+	PR_OP(OPS_LOAD_IF)
+		PR_FUSED(2);
+		ed = PROG_TO_EDICT(st->a->edict);
+		st->c->_int = ((int *)&ed->v)[st->b->_int];
+		st++;
+		if (st->a->_int)
+			PR_JUMP(st->jump);
+		PR_NEXT;
+
+	PR_OP(OPS_LOAD_IFNOT)
+		PR_FUSED(2);
+		ed = PROG_TO_EDICT(st->a->edict);
+		st->c->_int = ((int *)&ed->v)[st->b->_int];
+		st++;
+		if (!st->a->_int)
+			PR_JUMP(st->jump);
+		PR_NEXT;
+
+	PR_OP(OPS_LOAD_STORE)
+		PR_FUSED(2);
+		ed = PROG_TO_EDICT(st->a->edict);
+		st->c->_int = ((int *)&ed->v)[st->b->_int];
+		st++;
+		st->b->_int = st->a->_int;
+		PR_NEXT;
+
+	PR_OP(OPS_LOAD_STORE_V)
+		PR_FUSED(2);
+		ed = PROG_TO_EDICT(st->a->edict);
+		a = (eval_t *)((int *)&ed->v + st->b->_int);
+		c = st->c;
+		c->vector[0] = a->vector[0];
+		c->vector[1] = a->vector[1];
+		c->vector[2] = a->vector[2];
+		st++;
+		a = st->a; b = st->b;
+		b->vector[0] = a->vector[0];
+		b->vector[1] = a->vector[1];
+		b->vector[2] = a->vector[2];
+		PR_NEXT;
+
+	PR_OP(OPS_ADDRESS_STOREP)
+		ed = PROG_TO_EDICT(st->a->edict);
+		if (ed == (edict_t *)sv.edicts && sv.state == ss_active)
+			PR_PLAIN;		// let OP_ADDRESS raise the error
+		PR_FUSED(2);
+		if (ed->asleep)
+			SV_WakeEdict (ed);
+		if (SV_TRACEFIELD(st->b->_int))
+			SV_InvalidateTraces ();
+		st->c->_int = (byte *)((int *)&ed->v + st->b->_int) - (byte *)sv.edicts;
+		st++;
+		ptr = (eval_t *)((byte *)sv.edicts + st->b->_int);
+		ptr->_int = st->a->_int;
+		PR_NEXT;
+
+	PR_OP(OPS_ADDRESS_STOREP_V)
+		ed = PROG_TO_EDICT(st->a->edict);
+		if (ed == (edict_t *)sv.edicts && sv.state == ss_active)
+			PR_PLAIN;
+		PR_FUSED(2);
+		if (ed->asleep)
+			SV_WakeEdict (ed);
+		if (SV_TRACEFIELD(st->b->_int))
+			SV_InvalidateTraces ();
+		st->c->_int = (byte *)((int *)&ed->v + st->b->_int) - (byte *)sv.edicts;
+		st++;
+		a = st->a;
+		ptr = (eval_t *)((byte *)sv.edicts + st->b->_int);
+		ptr->vector[0] = a->vector[0];
+		ptr->vector[1] = a->vector[1];
+		ptr->vector[2] = a->vector[2];
+		PR_NEXT;
+
+	PR_OP(OPS_EQ_F_IFNOT)
+		PR_FUSED(2);
+		PR_CMP_IFNOT(==)
+	PR_OP(OPS_NE_F_IFNOT)
+		PR_FUSED(2);
+		PR_CMP_IFNOT(!=)
+	PR_OP(OPS_LE_IFNOT)
+		PR_FUSED(2);
+		PR_CMP_IFNOT(<=)
+	PR_OP(OPS_GE_IFNOT)
+		PR_FUSED(2);
+		PR_CMP_IFNOT(>=)
+	PR_OP(OPS_LT_IFNOT)
+		PR_FUSED(2);
+		PR_CMP_IFNOT(<)
+	PR_OP(OPS_GT_IFNOT)
+		PR_FUSED(2);
+		PR_CMP_IFNOT(>)
+
+	PR_OP(OPS_LOAD_EQ_F_IFNOT)
+		PR_LOAD_CMP_IFNOT(==)
+	PR_OP(OPS_LOAD_NE_F_IFNOT)
+		PR_LOAD_CMP_IFNOT(!=)
+	PR_OP(OPS_LOAD_LE_IFNOT)
+		PR_LOAD_CMP_IFNOT(<=)
+	PR_OP(OPS_LOAD_GE_IFNOT)
+		PR_LOAD_CMP_IFNOT(>=)
+	PR_OP(OPS_LOAD_LT_IFNOT)
+		PR_LOAD_CMP_IFNOT(<)
+	PR_OP(OPS_LOAD_GT_IFNOT)
+		PR_LOAD_CMP_IFNOT(>)
+
+	PR_OP(OPS_IF_GOTO)
+		if (st->a->_int)
+			PR_JUMP(st->jump);
+		PR_FUSED(2);
+		st++;
+		PR_JUMP(st->jump);
+
+	PR_OP(OPS_IFNOT_GOTO)
+		if (!st->a->_int)
+			PR_JUMP(st->jump);
+		PR_FUSED(2);
+		st++;
+		PR_JUMP(st->jump);
+
+	PR_OP(OPS_STORE_LOAD)
+		PR_FUSED(2);
+		st->b->_int = st->a->_int;
+		ed = PROG_TO_EDICT(st->a->edict);
+		st++;
+		st->c->_int = ((int *)&ed->v)[st->b->_int];
+		PR_NEXT;
+
+	PR_OP(OPS_STORE_LOAD_V)
+		PR_FUSED(2);
+		st->b->_int = st->a->_int;
+		ed = PROG_TO_EDICT(st->a->edict);
+		st++;
+		a = (eval_t *)((int *)&ed->v + st->b->_int);
+		c = st->c;
+		c->vector[0] = a->vector[0];
+		c->vector[1] = a->vector[1];
+		c->vector[2] = a->vector[2];
+		PR_NEXT;
+
+	PR_OP(OPS_BAD)
+		goto badop;
+
+#if !idthreaded
+	}
+#endif
+
+badop:
+	pr_xstatement = st - pr_code;
+	PR_PROFILE;
+	PR_RunError ("Bad opcode %i", pr_statements[pr_xstatement].op);
+
+runaway:
+	pr_xstatement = st - pr_code;
+	pr_xfunction->profile += profilestart - runaway - 1;
+	pr_fusedstatements += fused;
+	PR_RunError ("runaway loop error");
+}
+
+/*
+====================
+PR_CompareOp
+
+Returns the offset of a float compare's superinstructions from the OP_EQ_F
+ones, or -1 if op isn't one
+====================
+*/
+static int PR_CompareOp (int op)
+{
+	switch (op)
+	{
+	case OP_EQ_F:	return 0;
+	case OP_NE_F:	return 1;
+	case OP_LE:		return 2;
+	case OP_GE:		return 3;
+	case OP_LT:		return 4;
+	case OP_GT:		return 5;
+	}
+	return -1;
+}
+
+/*
+====================
+PR_FuseStatement
+
+Returns the superinstruction that can start at statement i, or its own
+opcode.  start marks the first statement of every function, which a
+superinstruction must not run into.
+====================
+*/
+static int PR_FuseStatement (int i, byte *start)
+{
+	dstatement_t	*st;
+	int		n, op0, op1, op2;
+
+	st = &pr_statements[i];
+	op0 = st[0].op;
+
+	for (n=1 ; n<3 && i+n<progs->numstatements && !start[i+n] ; n++)
+		;
+	if (n < 2)
+		return op0;
+	op1 = st[1].op;
+	op2 = n > 2 ? st[2].op : OP_DONE;
+
+	switch (op0)
+	{
+	case OP_LOAD_F:
+	case OP_LOAD_ENT:
+	case OP_LOAD_FLD:
+	case OP_LOAD_S:
+	case OP_LOAD_FNC:
+		if (PR_CompareOp (op1) >= 0 && op2 == OP_IFNOT)
+			return OPS_LOAD_EQ_F_IFNOT + PR_CompareOp (op1);
+		if (op1 == OP_IF)
+			return OPS_LOAD_IF;
+		if (op1 == OP_IFNOT)
+			return OPS_LOAD_IFNOT;
+		if (op1 >= OP_STORE_F && op1 <= OP_STORE_FNC && op1 != OP_STORE_V)
+			return OPS_LOAD_STORE;
+		break;
+
+	case OP_LOAD_V:
+		if (op1 == OP_STORE_V)
+			return OPS_LOAD_STORE_V;
+		break;
+
+	case OP_ADDRESS:
+		if (op1 >= OP_STOREP_F && op1 <= OP_STOREP_FNC)
+			return op1 == OP_STOREP_V ? OPS_ADDRESS_STOREP_V : OPS_ADDRESS_STOREP;
+		break;
+
+	case OP_STORE_ENT:
+		if (st[1].a != st->b)
+			break;
+		if (op1 == OP_LOAD_V)
+			return OPS_STORE_LOAD_V;
+		if (op1 >= OP_LOAD_F && op1 <= OP_LOAD_FNC)
+			return OPS_STORE_LOAD;
+		break;
+
+	case OP_IF:
+	case OP_IFNOT:
+		if (st->b == 2 && op1 == OP_GOTO)
+			return op0 == OP_IF ? OPS_IF_GOTO : OPS_IFNOT_GOTO;
+		break;
+
+	default:
+		if (PR_CompareOp (op0) >= 0 && op1 == OP_IFNOT)
+			return OPS_EQ_F_IFNOT + PR_CompareOp (op0);
+		break;
+	}
+
+	return op0;
+}
+
+/*
+====================
+PR_DecodeProgs
+
+Builds pr_code for the threaded engine from the loaded pr_statements
+====================
+*/
+void PR_DecodeProgs (void)
+{
+	int		i, op;
+	dstatement_t	*st;
+	prcode_t	*code;
+	byte	*start;
+
+	pr_code = NULL;
+	if (!pr_threaded.value)
+		return;		// saves the hunk space
+
+	pr_code = Hunk_AllocName (progs->numstatements * sizeof(prcode_t), "prcode");
+
+	start = Hunk_TempAlloc (progs->numstatements);
+	memset (start, 0, progs->numstatements);
+	for (i=0 ; i<progs->numfunctions ; i++)
+		if (pr_functions[i].first_statement > 0
+		&& pr_functions[i].first_statement < progs->numstatements)
+			start[pr_functions[i].first_statement] = 1;
+
+#if idthreaded
+	PR_ExecuteThreaded (NULL, 0);
+#endif
+
+	for (i=0 ; i<progs->numstatements ; i++)
+	{
+		st = &pr_statements[i];
+		code = &pr_code[i];
+
+		if (st->op >= OPS_LOAD_IF)
+			op = OPS_BAD;
+		else if (pr_superops.value)
+			op = PR_FuseStatement (i, start);
+		else
+			op = st->op;
+#if idthreaded
+		code->handler = pr_handlers[op];
+#else
+		code->op = op;
+#endif
+
+		code->a = (eval_t *)&pr_globals[st->a];
+		code->b = (eval_t *)&pr_globals[st->b];
+		code->c = (eval_t *)&pr_globals[st->c];
+		if (st->op == OP_IF || st->op == OP_IFNOT)
+			code->jump = pr_code + i + st->b;
+		else if (st->op == OP_GOTO)
+			code->jump = pr_code + i + st->a;
+	}
+}
+
+/*
+====================
+PR_ExecuteProgram
+====================
+*/
+void PR_ExecuteProgram (func_t fnum)
+{
+	dfunction_t	*f;
+	int		exitdepth;
+	int		s;
+
+	if (!fnum || fnum >= progs->numfunctions)
+	{
+		if (pr_global_struct->self)
+			ED_Print (PROG_TO_EDICT(pr_global_struct->self));
+		Host_Error ("PR_ExecuteProgram: NULL function");
+	}
+	
+	f = &pr_functions[fnum];
+
+	pr_trace = false;
+
+// make a stack frame
+	exitdepth = pr_depth;
+
+	s = PR_EnterFunction (f);
+
+	if (pr_code && pr_threaded.value)
+		PR_ExecuteThreaded (pr_code + s + 1, exitdepth);
+	else
+		PR_ExecuteSwitch (s, exitdepth, 100000);
+}
+
+#if idtiming
+static dfunction_t	*time_function;
+static int		time_statements[MAX_TIMING_PASSES];
+static int		time_fused[MAX_TIMING_PASSES];
+
+/*
+====================
+PR_CountStatements
+
+The statements run so far, from the profile counts
+====================
+*/
+static int PR_CountStatements (void)
+{
+	int		i, statements;
+
+	statements = 0;
+	for (i=0 ; i<progs->numfunctions ; i++)
+		statements += pr_functions[i].profile;
+	return statements;
+}
+
+/*
+====================
+PR_TimeProgsBegin
+
+Ends the statement counts of the pass before, and starts the pass's own
+====================
+*/
+static void PR_TimeProgsBegin (int pass)
+{
+	if (pass)
+	{
+		time_statements[pass-1] += PR_CountStatements ();
+		time_fused[pass-1] += pr_fusedstatements;
+	}
+	time_statements[pass] = -PR_CountStatements ();
+	time_fused[pass] = -pr_fusedstatements;
+}
+
+/*
+====================
+PR_TimeProgsRun
+====================
+*/
+static int PR_TimeProgsRun (int pass, qboolean check)
+{
+	pr_global_struct->self = EDICT_TO_PROG(sv.edicts);
+	pr_global_struct->other = EDICT_TO_PROG(sv.edicts);
+	pr_global_struct->time = sv.time;
+	PR_ExecuteProgram (time_function - pr_functions);
+	return 0;
+}
+
+/*
+====================
+PR_TimeProgs_f
+
+timeprogs [function] [count]
+Runs a progs function under both engines
+====================
+*/
+void PR_TimeProgs_f (void)
+{
+	timing_t	t;
+	char	*name;
+	int		count, pass;
+
+	if (!Timing_Server ())
+		return;
+
+	name = Cmd_Argc () > 1 ? Cmd_Argv (1) : "StartFrame";
+	count = Timing_Count (2, 1000);
+
+	time_function = ED_FindFunction (name);
+	if (!time_function || time_function->first_statement < 0)
+	{
+		Con_Printf ("No progs function %s\n", name);
+		return;
+	}
+
+	memset (&t, 0, sizeof(t));
+	t.numpasses = 2;
+	t.names[0] = "switch";
+	t.names[1] = "threaded";
+	t.cvar = "pr_threaded";
+	t.values[0] = 0;
+	t.values[1] = 1;
+	t.unit = "statement";
+	t.begin = PR_TimeProgsBegin;
+	t.run = PR_TimeProgsRun;
+	if (!pr_code)
+	{
+		Con_Printf ("threaded: no decoded progs, set pr_threaded 1 and reload the map\n");
+		t.numpasses = 1;
+	}
+
+	Timing_Run (&t, count);
+	time_statements[t.numpasses-1] += PR_CountStatements ();
+	time_fused[t.numpasses-1] += pr_fusedstatements;
+
+	Timing_Print (&t, time_statements[0]);
+	for (pass=0 ; pass<t.numpasses ; pass++)
+		Con_Printf ("%-10s %i statements  %i dispatches\n", t.names[pass],
+			time_statements[pass], time_statements[pass] - time_fused[pass]);
+}
+#endif
@@ -36,6 +36,8 @@ typedef struct edict_s
 {
 	qboolean	free;
 	link_t		area;				// linked to a division node or leaf
+	int			areanode;			// area node the edict belongs to
+	unsigned	areaseq;			// link order, SV_ClipToLinks visits in it
 	
 	int			num_leafs;
 	short		leafnums[MAX_ENT_LEAFS];
@@ -43,6 +45,7 @@ typedef struct edict_s
 	entity_state_t	baseline;
 	
 	float		freetime;			// sv.time when the object was freed
+	qboolean	asleep;				// skipped by SV_Physics until woken
 	entvars_t	v;					// C exported fields from progs
 // other fields from progs come immediately after
 } edict_t;
@@ -68,13 +71,19 @@ void PR_Init (void);
 void PR_ExecuteProgram (func_t fnum);
 void PR_LoadProgs (void);
 
+void PR_DecodeProgs (void);
 void PR_Profile_f (void);
+#if idtiming
+void PR_TimeProgs_f (void);
+void PR_TimeFind_f (void);
+#endif
 
 edict_t *ED_Alloc (void);
 void ED_Free (edict_t *ed);
 
 char	*ED_NewString (char *string);
 // returns a copy of the string allocated from the server's string heap
+// (an interned copy, which must not be written to)
 
 void ED_Print (edict_t *ed);
 void ED_Write (FILE *f, edict_t *ed);
@@ -85,6 +94,8 @@ void ED_ParseGlobals (char *data);
 
 void ED_LoadFromFile (char *data);
 
+dfunction_t *ED_FindFunction (char *name);
+
 //define EDICT_NUM(n) ((edict_t *)(sv.edicts+ (n)*pr_edict_size))
 //define NUM_FOR_EDICT(e) (((byte *)(e) - sv.edicts)/pr_edict_size)
 
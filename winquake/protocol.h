@@ -20,6 +20,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 // protocol.h -- communications protocols
 
 #define	PROTOCOL_VERSION	15
+#define	PROTOCOL_DELTA		16	// entities are sent as delta compressed
+								// snapshots, only used when the client
+								// offered it in its connect request
 
 // if the high bit of the servercmd is set, the low bits are fast update flags:
 #define	U_MOREBITS	(1<<0)
@@ -40,6 +43,37 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define	U_EFFECTS	(1<<13)
 #define	U_LONGENTITY	(1<<14)
 
+// svc_packetentities sends each entity as a short number followed by the
+// update bits above and the changed fields.  U_NOLERP is part of the state,
+// and entities that left the view are sent as just the number with PE_REMOVE
+#define	PE_REMOVE		(1<<15)
+
+#define	UPDATE_BACKUP	16	// copies of snapshots kept, must be power of 2
+#define	UPDATE_MASK		(UPDATE_BACKUP-1)
+
+#define	MAX_PACKET_ENTITIES	128		// entities in a single snapshot
+
+// entity state as it goes over the wire, so both sides agree exactly
+typedef struct
+{
+	unsigned short	number;
+	short	origin[3];		// 1/8 units
+	byte	angles[3];		// 256ths of a circle
+	byte	modelindex;
+	byte	frame;
+	byte	colormap;
+	byte	skin;
+	byte	effects;
+	byte	flags;			// U_NOLERP
+} packedentity_t;
+
+typedef struct
+{
+	int				sequence;	// 0 if the snapshot is not valid
+	int				num_entities;
+	packedentity_t	entities[MAX_PACKET_ENTITIES];
+} snapshot_t;
+
 
 #define	SU_VIEWHEIGHT	(1<<0)
 #define	SU_IDEALPITCH	(1<<1)
@@ -130,6 +164,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #define svc_cutscene		34
 
+#define	svc_packetentities	35		// [long] sequence [byte] delta <entities>
+									// delta is 0 for a full snapshot
+
 //
 // client to server
 //
@@ -138,6 +175,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define	clc_disconnect	2
 #define	clc_move		3			// [usercmd_t]
 #define	clc_stringcmd	4		// [string] message
+#define	clc_delta		5		// [long] last snapshot received
 
 
 //
@@ -75,6 +75,32 @@ void	VID_UnlockBuffer (void);
 #define UNALIGNED_OK	0
 #endif
 
+// gcc vector extensions for the span drawers, only where they map onto
+// SSE2 or NEON registers; build with -Didsimd=0 to leave them out
+#ifndef idsimd
+#if defined __GNUC__ && (defined __SSE2__ || defined __ARM_NEON)
+#define idsimd	1
+#else
+#define idsimd	0
+#endif
+#endif
+
+// direct threaded QuakeC dispatch through gcc's labels as values; build
+// with -Didthreaded=0 to decode into a switch dispatched loop instead
+#ifndef idthreaded
+#if defined __GNUC__
+#define idthreaded	1
+#else
+#define idthreaded	0
+#endif
+#endif
+
+// developer commands that time the same work done different ways; build
+// with -Didtiming=1 to put them in
+#ifndef idtiming
+#define idtiming	0
+#endif
+
 // !!! if this is changed, it must be changed in d_ifacea.h too !!!
 #define CACHE_SIZE	32		// used to align key data structures
 
@@ -259,6 +285,7 @@ typedef struct
 #include "menu.h"
 #include "crc.h"
 #include "cdaudio.h"
+#include "timing.h"
 
 #ifdef GLQUAKE
 #include "glquake.h"
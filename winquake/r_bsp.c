@@ -26,14 +26,15 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 // current entity info
 //
 qboolean		insubmodel;
-entity_t		*currententity;
-vec3_t			modelorg, base_modelorg;
+THREADLOCAL entity_t	*currententity;
+THREADLOCAL vec3_t	modelorg;
+vec3_t			base_modelorg;
 								// modelorg is the viewpoint reletive to
 								// the currently rendering entity
 vec3_t			r_entorigin;	// the currently rendering entity in world
 								// coordinates
 
-float			entity_rotation[3][3];
+THREADLOCAL float	entity_rotation[3][3];
 
 vec3_t			r_worldmodelorg;
 
@@ -41,7 +41,7 @@ polydesc_t		r_polydesc;
 
 
 clipplane_t	*entity_clipplanes;
-clipplane_t	view_clipplanes[4];
+THREADLOCAL clipplane_t	view_clipplanes[4];
 clipplane_t	world_clipplanes[16];
 
 medge_t			*r_pedge;
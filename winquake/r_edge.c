@@ -37,7 +37,8 @@ have a sentinal at both ends?
 edge_t	*auxedges;
 edge_t	*r_edges, *edge_p, *edge_max;
 
-surf_t	*surfaces, *surface_p, *surf_max;
+THREADLOCAL surf_t	*surfaces, *surface_p;
+surf_t	*surf_max;
 
 // surfaces are generated in back to front order by the bsp, so if a surf
 // pointer is greater than another one, it should be drawn in front
@@ -46,24 +47,34 @@ surf_t	*surfaces, *surface_p, *surf_max;
 edge_t	*newedges[MAXHEIGHT];
 edge_t	*removeedges[MAXHEIGHT];
 
-espan_t	*span_p, *max_span_p;
+THREADLOCAL espan_t	*span_p, *max_span_p;
 
 int		r_currentkey;
 
 extern	int	screenwidth;
 
-int	current_iv;
+THREADLOCAL int	current_iv;
 
-int	edge_head_u_shift20, edge_tail_u_shift20;
+THREADLOCAL int	edge_head_u_shift20, edge_tail_u_shift20;
 
 static void (*pdrawfunc)(void);
 
-edge_t	edge_head;
-edge_t	edge_tail;
-edge_t	edge_aftertail;
-edge_t	edge_sentinel;
+THREADLOCAL edge_t	edge_head;
+THREADLOCAL edge_t	edge_tail;
+THREADLOCAL edge_t	edge_aftertail;
+THREADLOCAL edge_t	edge_sentinel;
 
-float	fv;
+THREADLOCAL float	fv;
+
+// banded scanning, see R_ScanEdges
+typedef struct
+{
+	int		top, bottom;		// scan lines top..bottom-1
+	int		drawnpolycount;
+} rband_t;
+
+qboolean	r_bandscan;			// bands are being scanned on worker threads
+static surf_t	*r_bandsurfaces, *r_bandsurface_p;
 
 void R_GenerateSpans (void);
 void R_GenerateSpansBackward (void);
@@ -650,19 +661,17 @@ void R_GenerateSpansBackward (void)
 
 /*
 ==============
-R_ScanEdges
+R_ScanEdgeLines
 
-Input: 
-newedges[] array
-	this has links to edges, which have links to surfaces
-
-Output:
-Each surface has a linked list of its visible spans
+Scans the lines top..bottom-1.  Edges are taken from edgebase, which is
+r_edges itself or a band's private copy of it; the lines above top only
+step the active edge table, so a band starts with exactly the edge order
+the full scan would have had at that line
 ==============
 */
-void R_ScanEdges (void)
+void R_ScanEdgeLines (edge_t *edgebase, int top, int bottom)
 {
-	int		iv, bottom;
+	int		iv, last;
 	byte	basespans[MAXSPANS*sizeof(espan_t)+CACHE_SIZE];
 	espan_t	*basespan_p;
 	surf_t	*s;
@@ -700,12 +709,27 @@ void R_ScanEdges (void)
 	edge_sentinel.u = 2000 << 24;		// make sure nothing sorts past this
 	edge_sentinel.prev = &edge_aftertail;
 
+//
+// bring the active edges down to the first line of the band
+//
+	for (iv=r_refdef.vrect.y ; iv<top ; iv++)
+	{
+		if (newedges[iv])
+			R_InsertNewEdges (edgebase + (newedges[iv] - r_edges), edge_head.next);
+
+		if (removeedges[iv])
+			R_RemoveEdges (edgebase + (removeedges[iv] - r_edges));
+
+		if (edge_head.next != &edge_tail)
+			R_StepActiveU (edge_head.next);
+	}
+
 //	
 // process all scan lines
 //
-	bottom = r_refdef.vrectbottom - 1;
+	last = bottom - 1;
 
-	for (iv=r_refdef.vrect.y ; iv<bottom ; iv++)
+	for ( ; iv<last ; iv++)
 	{
 		current_iv = iv;
 		fv = (float)iv;
@@ -715,7 +739,7 @@ void R_ScanEdges (void)
 
 		if (newedges[iv])
 		{
-			R_InsertNewEdges (newedges[iv], edge_head.next);
+			R_InsertNewEdges (edgebase + (newedges[iv] - r_edges), edge_head.next);
 		}
 
 		(*pdrawfunc) ();
@@ -724,9 +748,12 @@ void R_ScanEdges (void)
 	// the next scan
 		if (span_p >= max_span_p)
 		{
-			VID_UnlockBuffer ();
-			S_ExtraUpdate ();	// don't let sound get messed up if going slow
-			VID_LockBuffer ();
+			if (!r_bandscan)
+			{
+				VID_UnlockBuffer ();
+				S_ExtraUpdate ();	// don't let sound get messed up if going slow
+				VID_LockBuffer ();
+			}
 		
 			if (r_drawculledpolys)
 			{
@@ -745,7 +772,7 @@ void R_ScanEdges (void)
 		}
 
 		if (removeedges[iv])
-			R_RemoveEdges (removeedges[iv]);
+			R_RemoveEdges (edgebase + (removeedges[iv] - r_edges));
 
 		if (edge_head.next != &edge_tail)
 			R_StepActiveU (edge_head.next);
@@ -760,7 +787,7 @@ void R_ScanEdges (void)
 	surfaces[1].spanstate = 1;
 
 	if (newedges[iv])
-		R_InsertNewEdges (newedges[iv], edge_head.next);
+		R_InsertNewEdges (edgebase + (newedges[iv] - r_edges), edge_head.next);
 
 	(*pdrawfunc) ();
 
@@ -772,3 +799,127 @@ void R_ScanEdges (void)
 }
 
 
+/*
+==============
+R_ScanBand
+
+Worker job for one band.  Edges and surfaces are copied onto this thread's
+stack the same way R_EdgeDrawing keeps them, as scanning links them into
+the active edge and surface stacks
+==============
+*/
+void R_ScanBand (int band, void *arg)
+{
+	rband_t	*pband;
+	edge_t	ledges[NUMSTACKEDGES +
+				((CACHE_SIZE - 1) / sizeof(edge_t)) + 1];
+	surf_t	lsurfs[NUMSTACKSURFACES +
+				((CACHE_SIZE - 1) / sizeof(surf_t)) + 1];
+	edge_t	*edges, *pedge;
+	int		i, numedges;
+
+	pband = (rband_t *)arg + band;
+
+	edges = (edge_t *)
+			(((long)&ledges[0] + CACHE_SIZE - 1) & ~(CACHE_SIZE - 1));
+	numedges = edge_p - r_edges;
+
+	for (i=0 ; i<numedges ; i++)
+	{
+		pedge = &edges[i];
+		*pedge = r_edges[i];
+		if (pedge->next)
+			pedge->next = edges + (pedge->next - r_edges);
+		if (pedge->nextremove)
+			pedge->nextremove = edges + (pedge->nextremove - r_edges);
+	}
+
+	surfaces = (surf_t *)
+			(((long)&lsurfs[0] + CACHE_SIZE - 1) & ~(CACHE_SIZE - 1));
+	surfaces--;
+	surface_p = surfaces + (r_bandsurface_p - r_bandsurfaces);
+	memcpy (&surfaces[1], &r_bandsurfaces[1],
+			(surface_p - &surfaces[1]) * sizeof(surf_t));
+
+// drawing starts from the unrotated world view
+	VectorCopy (base_vpn, vpn);
+	VectorCopy (base_vup, vup);
+	VectorCopy (base_vright, vright);
+	VectorCopy (base_modelorg, modelorg);
+
+	r_drawnpolycount = 0;
+
+	R_ScanEdgeLines (edges, pband->top, pband->bottom);
+
+	pband->drawnpolycount = r_drawnpolycount;
+}
+
+
+/*
+==============
+R_ScanEdges
+
+Input: 
+newedges[] array
+	this has links to edges, which have links to surfaces
+
+Output:
+Each surface has a linked list of its visible spans
+
+With r_bands, the screen is split into horizontal bands that are scanned
+and drawn in parallel, each from its own copy of this frame's edges and
+surfaces
+==============
+*/
+void R_ScanEdges (void)
+{
+	rband_t	bands[MAX_BANDS];
+	int		i, numbands, drawnpolycount;
+
+	numbands = (int)r_bands.value;
+	if (numbands > MAX_BANDS)
+		numbands = MAX_BANDS;
+	if (numbands > r_refdef.vrect.height)
+		numbands = r_refdef.vrect.height;
+
+	if (numbands < 2 || Sys_NumWorkers () < 2 || r_drawculledpolys
+		|| edge_p - r_edges > NUMSTACKEDGES
+		|| surface_p - surfaces > NUMSTACKSURFACES)
+	{
+		R_ScanEdgeLines (r_edges, r_refdef.vrect.y, r_refdef.vrectbottom);
+		return;
+	}
+
+	for (i=0 ; i<numbands ; i++)
+	{
+		bands[i].top = r_refdef.vrect.y + r_refdef.vrect.height * i / numbands;
+		bands[i].bottom = r_refdef.vrect.y +
+				r_refdef.vrect.height * (i + 1) / numbands;
+	}
+
+// the sky is shared by all bands, so build it up front
+	if (!r_skymade)
+		R_MakeSky ();
+
+	r_bandsurfaces = surfaces;
+	r_bandsurface_p = surface_p;
+	drawnpolycount = r_drawnpolycount;
+	r_bandscan = true;
+
+	Sys_RunWorkers (numbands, R_ScanBand, bands);
+
+	r_bandscan = false;
+	surfaces = r_bandsurfaces;
+	surface_p = r_bandsurface_p;
+
+// the calling thread ran bands too, put its view back
+	VectorCopy (base_vpn, vpn);
+	VectorCopy (base_vup, vup);
+	VectorCopy (base_vright, vright);
+	VectorCopy (base_modelorg, modelorg);
+	currententity = &cl_entities[0];
+
+	for (i=0 ; i<numbands ; i++)
+		drawnpolycount += bands[i].drawnpolycount;
+	r_drawnpolycount = drawnpolycount;
+}
@@ -69,7 +69,7 @@ R_MarkLights
 void R_MarkLights (dlight_t *light, int bit, mnode_t *node)
 {
 	mplane_t	*splitplane;
-	float		dist;
+	float		dist, surfdist;
 	msurface_t	*surf;
 	int			i;
 	
@@ -94,6 +94,13 @@ void R_MarkLights (dlight_t *light, int bit, mnode_t *node)
 	surf = cl.worldmodel->surfaces + node->firstsurface;
 	for (i=0 ; i<node->numsurfaces ; i++, surf++)
 	{
+	// R_AddDynamicLights would add nothing, so don't make the surface
+	// cache rebuild it
+		surfdist = DotProduct (light->origin, surf->plane->normal) -
+				surf->plane->dist;
+		if (light->radius - fabs(surfdist) < light->minlight)
+			continue;
+
 		if (surf->dlightframe != r_dlightframecount)
 		{
 			surf->dlightbits = 0;
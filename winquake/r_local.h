@@ -71,6 +71,7 @@ extern cvar_t	r_numsurfs;
 extern cvar_t	r_reportedgeout;
 extern cvar_t	r_maxedges;
 extern cvar_t	r_numedges;
+extern cvar_t	r_bands;
 
 #define XCENTERING	(1.0 / 2.0)
 #define YCENTERING	(1.0 / 2.0)
@@ -94,7 +95,7 @@ typedef struct clipplane_s
 	byte		reserved[2];
 } clipplane_t;
 
-extern	clipplane_t	view_clipplanes[4];
+extern	THREADLOCAL clipplane_t	view_clipplanes[4];
 
 //=============================================================================
 
@@ -161,6 +162,8 @@ surf_t *R_GetSurf (void);
 void R_AliasDrawModel (alight_t *plighting);
 void R_BeginEdgeFrame (void);
 void R_ScanEdges (void);
+void R_ScanEdgeLines (edge_t *edgebase, int top, int bottom);
+void R_ScanBand (int band, void *arg);
 void D_DrawSurfaces (void);
 void R_InsertNewEdges (edge_t *edgestoadd, edge_t *edgelist);
 void R_StepActiveU (edge_t *pedge);
@@ -189,15 +192,15 @@ extern int		*pfrustum_indexes[4];
 extern int			ubasestep, errorterm, erroradjustup, erroradjustdown;
 extern int			vstartscan;
 
-extern fixed16_t	sadjust, tadjust;
-extern fixed16_t	bbextents, bbextentt;
+extern THREADLOCAL fixed16_t	sadjust, tadjust;
+extern THREADLOCAL fixed16_t	bbextents, bbextentt;
 
 #define MAXBVERTINDEXES	1000	// new clipped vertices when clipping bmodels
 								//  to the world BSP
 extern mvertex_t	*r_ptverts, *r_ptvertsmax;
 
 extern vec3_t			sbaseaxis[3], tbaseaxis[3];
-extern float			entity_rotation[3][3];
+extern THREADLOCAL float	entity_rotation[3][3];
 
 extern int		reinit_surfcache;
 
@@ -264,10 +267,10 @@ extern	edge_t	*removeedges[MAXHEIGHT];
 extern	int	screenwidth;
 
 // FIXME: make stack vars when debugging done
-extern	edge_t	edge_head;
-extern	edge_t	edge_tail;
-extern	edge_t	edge_aftertail;
-extern int		r_bmodelactive;
+extern	THREADLOCAL edge_t	edge_head;
+extern	THREADLOCAL edge_t	edge_tail;
+extern	THREADLOCAL edge_t	edge_aftertail;
+extern THREADLOCAL int		r_bmodelactive;
 extern vrect_t	*pconupdate;
 
 extern float		aliasxscale, aliasyscale, aliasxcenter, aliasycenter;
@@ -300,10 +303,12 @@ extern qboolean	r_fov_greater_than_90;
 
 void R_StoreEfrags (efrag_t **ppefrag);
 void R_TimeRefresh_f (void);
+void R_TimeSurfaceBlocks_f (void);
 void R_TimeGraph (void);
 void R_PrintAliasStats (void);
 void R_PrintTimes (void);
 void R_PrintDSpeeds (void);
+void R_AccumulateSpeeds (void);
 void R_AnimateLight (void);
 int R_LightPoint (vec3_t p);
 void R_SetupFrame (void);
@@ -45,6 +45,8 @@ btofpoly_t	*pbtofpolys;
 mvertex_t	*r_pcurrentvertbase;
 
 int			c_surf;
+qboolean	r_collectspeeds;
+rspeeds_t	r_speedstotal;
 int			r_maxsurfsseen, r_maxedgesseen, r_cnumsurfs;
 qboolean	r_surfsonstack;
 int			r_clipflags;
@@ -58,9 +60,8 @@ qboolean	r_fov_greater_than_90;
 //
 // view origin
 //
-vec3_t	vup, base_vup;
-vec3_t	vpn, base_vpn;
-vec3_t	vright, base_vright;
+THREADLOCAL vec3_t	vup, vpn, vright;
+vec3_t	base_vup, base_vpn, base_vright;
 vec3_t	r_origin;
 
 //
@@ -89,7 +90,7 @@ int		r_framecount = 1;	// so frame counts initialized to 0 don't match
 int		r_visframecount;
 int		d_spanpixcount;
 int		r_polycount;
-int		r_drawnpolycount;
+THREADLOCAL int	r_drawnpolycount;
 int		r_wholepolycount;
 
 #define		VIEWMODNAME_LENGTH	256
@@ -136,6 +137,7 @@ cvar_t	r_maxedges = {"r_maxedges", "0"};
 cvar_t	r_numedges = {"r_numedges", "0"};
 cvar_t	r_aliastransbase = {"r_aliastransbase", "200"};
 cvar_t	r_aliastransadj = {"r_aliastransadj", "100"};
+cvar_t	r_bands = {"r_bands", "0"};
 
 extern cvar_t	scr_fov;
 
@@ -156,6 +158,7 @@ void	R_InitTextures (void)
 	r_notexture_mip = Hunk_AllocName (sizeof(texture_t) + 16*16+8*8+4*4+2*2, "notexture");
 	
 	r_notexture_mip->width = r_notexture_mip->height = 16;
+	r_notexture_mip->pixels = (byte *)r_notexture_mip;
 	r_notexture_mip->offsets[0] = sizeof(texture_t);
 	r_notexture_mip->offsets[1] = r_notexture_mip->offsets[0] + 16*16;
 	r_notexture_mip->offsets[2] = r_notexture_mip->offsets[1] + 8*8;
@@ -163,7 +166,7 @@ void	R_InitTextures (void)
 	
 	for (m=0 ; m<4 ; m++)
 	{
-		dest = (byte *)r_notexture_mip + r_notexture_mip->offsets[m];
+		dest = r_notexture_mip->pixels + r_notexture_mip->offsets[m];
 		for (y=0 ; y< (16>>m) ; y++)
 			for (x=0 ; x< (16>>m) ; x++)
 			{
@@ -190,6 +193,7 @@ void R_Init (void)
 	R_InitTurb ();
 	
 	Cmd_AddCommand ("timerefresh", R_TimeRefresh_f);	
+	Cmd_AddCommand ("timesurfblocks", R_TimeSurfaceBlocks_f);
 	Cmd_AddCommand ("pointfile", R_ReadPointFile_f);	
 
 	Cvar_RegisterVariable (&r_draworder);
@@ -213,6 +217,7 @@ void R_Init (void)
 	Cvar_RegisterVariable (&r_numedges);
 	Cvar_RegisterVariable (&r_aliastransbase);
 	Cvar_RegisterVariable (&r_aliastransadj);
+	Cvar_RegisterVariable (&r_bands);
 
 	Cvar_SetValue ("r_maxedges", (float)NUMSTACKEDGES);
 	Cvar_SetValue ("r_maxsurfs", (float)NUMSTACKSURFACES);
@@ -903,7 +908,7 @@ void R_EdgeDrawing (void)
 
 	R_BeginEdgeFrame ();
 
-	if (r_dspeeds.value)
+	if (r_dspeeds.value || r_collectspeeds)
 	{
 		rw_time1 = Sys_FloatTime ();
 	}
@@ -917,7 +922,7 @@ void R_EdgeDrawing (void)
 // z writes, so have the driver turn z compares on now
 	D_TurnZOn ();
 
-	if (r_dspeeds.value)
+	if (r_dspeeds.value || r_collectspeeds)
 	{
 		rw_time2 = Sys_FloatTime ();
 		db_time1 = rw_time2;
@@ -925,7 +930,7 @@ void R_EdgeDrawing (void)
 
 	R_DrawBEntitiesOnList ();
 
-	if (r_dspeeds.value)
+	if (r_dspeeds.value || r_collectspeeds)
 	{
 		db_time2 = Sys_FloatTime ();
 		se_time1 = db_time2;
@@ -956,7 +961,7 @@ void R_RenderView_ (void)
 
 	r_warpbuffer = warpbuffer;
 
-	if (r_timegraph.value || r_speeds.value || r_dspeeds.value)
+	if (r_timegraph.value || r_speeds.value || r_dspeeds.value || r_collectspeeds)
 		r_time1 = Sys_FloatTime ();
 
 	R_SetupFrame ();
@@ -992,7 +997,7 @@ SetVisibilityByPassages ();
 		VID_LockBuffer ();
 	}
 	
-	if (r_dspeeds.value)
+	if (r_dspeeds.value || r_collectspeeds)
 	{
 		se_time2 = Sys_FloatTime ();
 		de_time1 = se_time2;
@@ -1000,7 +1005,7 @@ SetVisibilityByPassages ();
 
 	R_DrawEntitiesOnList ();
 
-	if (r_dspeeds.value)
+	if (r_dspeeds.value || r_collectspeeds)
 	{
 		de_time2 = Sys_FloatTime ();
 		dv_time1 = de_time2;
@@ -1008,7 +1013,7 @@ SetVisibilityByPassages ();
 
 	R_DrawViewModel ();
 
-	if (r_dspeeds.value)
+	if (r_dspeeds.value || r_collectspeeds)
 	{
 		dv_time2 = Sys_FloatTime ();
 		dp_time1 = Sys_FloatTime ();
@@ -1016,7 +1021,7 @@ SetVisibilityByPassages ();
 
 	R_DrawParticles ();
 
-	if (r_dspeeds.value)
+	if (r_dspeeds.value || r_collectspeeds)
 		dp_time2 = Sys_FloatTime ();
 
 	if (r_dowarp)
@@ -1030,6 +1035,9 @@ SetVisibilityByPassages ();
 	if (r_aliasstats.value)
 		R_PrintAliasStats ();
 		
+	if (r_collectspeeds)
+		R_AccumulateSpeeds ();
+
 	if (r_speeds.value)
 		R_PrintTimes ();
 
@@ -231,6 +231,37 @@ void R_PrintDSpeeds (void)
 }
 
 
+/*
+=============
+R_AccumulateSpeeds
+
+Adds this frame's r_speeds / r_dspeeds figures to r_speedstotal
+=============
+*/
+void R_AccumulateSpeeds (void)
+{
+	float	r_time2;
+
+	r_time2 = Sys_FloatTime ();
+
+	r_speedstotal.frames++;
+	r_speedstotal.ms += (r_time2 - r_time1) * 1000;
+	r_speedstotal.rw_time += (rw_time2 - rw_time1) * 1000;
+	r_speedstotal.db_time += (db_time2 - db_time1) * 1000;
+	r_speedstotal.se_time += (se_time2 - se_time1) * 1000;
+	r_speedstotal.de_time += (de_time2 - de_time1) * 1000;
+	r_speedstotal.dv_time += (dv_time2 - dv_time1) * 1000;
+	r_speedstotal.dp_time += (dp_time2 - dp_time1) * 1000;
+	r_speedstotal.faceclip += c_faceclip;
+	r_speedstotal.polycount += r_polycount;
+	r_speedstotal.drawnpolycount += r_drawnpolycount;
+	r_speedstotal.surf += c_surf;
+
+	if (!r_speeds.value)
+		c_surf = 0;		// R_PrintTimes clears it otherwise
+}
+
+
 /*
 =============
 R_PrintAliasStats
@@ -44,29 +44,31 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 extern void	R_DrawLine (polyvert_t *polyvert0, polyvert_t *polyvert1);
 
-extern int		cachewidth;
-extern pixel_t	*cacheblock;
+extern THREADLOCAL int		cachewidth;
+extern THREADLOCAL pixel_t	*cacheblock;
 extern int		screenwidth;
 
 extern	float	pixelAspect;
 
-extern int		r_drawnpolycount;
+extern THREADLOCAL int		r_drawnpolycount;
 
 extern cvar_t	r_clearcolor;
 
 extern int	sintable[SIN_BUFFER_SIZE];
 extern int	intsintable[SIN_BUFFER_SIZE];
 
-extern	vec3_t	vup, base_vup;
-extern	vec3_t	vpn, base_vpn;
-extern	vec3_t	vright, base_vright;
-extern	entity_t		*currententity;
+extern	THREADLOCAL vec3_t	vup, vpn, vright;
+extern	vec3_t	base_vup, base_vpn, base_vright;
+extern	THREADLOCAL entity_t	*currententity;
 
 #define NUMSTACKEDGES		2400
 #define	MINEDGES			NUMSTACKEDGES
 #define NUMSTACKSURFACES	800
 #define MINSURFACES			NUMSTACKSURFACES
 #define	MAXSPANS			3000
+#define	MAX_BANDS			32		// r_bands limit
+
+extern qboolean	r_bandscan;		// set while R_ScanEdges runs bands on workers
 
 // !!! if this is changed, it must be changed in asm_draw.h too !!!
 typedef struct espan_s
@@ -98,7 +100,8 @@ typedef struct surf_s
 	int			pad[2];				// to 64 bytes
 } surf_t;
 
-extern	surf_t	*surfaces, *surface_p, *surf_max;
+extern	THREADLOCAL surf_t	*surfaces, *surface_p;
+extern	surf_t	*surf_max;
 
 // surfaces are generated in back to front order by the bsp, so if a surf
 // pointer is greater than another one, it should be drawn in front
@@ -111,7 +114,8 @@ extern	surf_t	*surfaces, *surface_p, *surf_max;
 extern vec3_t	sxformaxis[4];	// s axis transformed into viewspace
 extern vec3_t	txformaxis[4];	// t axis transformed into viewspac
 
-extern vec3_t	modelorg, base_modelorg;
+extern THREADLOCAL vec3_t	modelorg;
+extern vec3_t	base_modelorg;
 
 extern	float	xcenter, ycenter;
 extern	float	xscale, yscale;
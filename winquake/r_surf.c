@@ -21,21 +21,23 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 #include "r_local.h"
-
-drawsurf_t	r_drawsurf;
-
-int				lightleft, sourcesstep, blocksize, sourcetstep;
-int				lightdelta, lightdeltastep;
-int				lightright, lightleftstep, lightrightstep, blockdivshift;
-unsigned		blockdivmask;
-void			*prowdestbase;
-unsigned char	*pbasesource;
-int				surfrowbytes;	// used by ASM files
-unsigned		*r_lightptr;
-int				r_stepback;
-int				r_lightwidth;
-int				r_numhblocks, r_numvblocks;
-unsigned char	*r_source, *r_sourcemax;
+#include "d_local.h"
+
+// surfaces can be built on several worker threads at once
+THREADLOCAL drawsurf_t	r_drawsurf;
+
+THREADLOCAL int				lightleft, sourcesstep, blocksize, sourcetstep;
+THREADLOCAL int				lightdelta, lightdeltastep;
+THREADLOCAL int				lightright, lightleftstep, lightrightstep, blockdivshift;
+THREADLOCAL unsigned		blockdivmask;
+THREADLOCAL void			*prowdestbase;
+THREADLOCAL unsigned char	*pbasesource;
+THREADLOCAL int				surfrowbytes;	// used by ASM files
+THREADLOCAL unsigned		*r_lightptr;
+THREADLOCAL int				r_stepback;
+THREADLOCAL int				r_lightwidth;
+THREADLOCAL int				r_numhblocks, r_numvblocks;
+THREADLOCAL unsigned char	*r_source, *r_sourcemax;
 
 void R_DrawSurfaceBlock8_mip0 (void);
 void R_DrawSurfaceBlock8_mip1 (void);
@@ -49,9 +51,33 @@ static void	(*surfmiptable[4])(void) = {
 	R_DrawSurfaceBlock8_mip3
 };
 
+#if	idsimd
+void R_DrawSurfaceBlock8Vec_mip0 (void);
+void R_DrawSurfaceBlock8Vec_mip1 (void);
+void R_DrawSurfaceBlock8Vec_mip2 (void);
+void R_DrawSurfaceBlock8Vec_mip3 (void);
+
+static void	(*surfmiptablevec[4])(void) = {
+	R_DrawSurfaceBlock8Vec_mip0,
+	R_DrawSurfaceBlock8Vec_mip1,
+	R_DrawSurfaceBlock8Vec_mip2,
+	R_DrawSurfaceBlock8Vec_mip3
+};
+
+// zero extending interleaves, the generic forms of punpck[lh]bw / punpck[lh]wd
+#define	WIDEN_LO8(t)	((vec8us_t)VEC_SHUFFLE (t, (vec16ub_t){0}, \
+	0,16, 1,17, 2,18, 3,19, 4,20, 5,21, 6,22, 7,23))
+#define	WIDEN_HI8(t)	((vec8us_t)VEC_SHUFFLE (t, (vec16ub_t){0}, \
+	8,24, 9,25, 10,26, 11,27, 12,28, 13,29, 14,30, 15,31))
+#define	WIDEN_LO16(t)	((vec4i_t)VEC_SHUFFLE (t, (vec8us_t){0}, \
+	0,8, 1,9, 2,10, 3,11))
+#define	WIDEN_HI16(t)	((vec4i_t)VEC_SHUFFLE (t, (vec8us_t){0}, \
+	4,12, 5,13, 6,14, 7,15))
+#endif
 
 
-unsigned		blocklights[18*18];
+
+THREADLOCAL unsigned	blocklights[18*18 + 3];	// vector lanes may run past the end
 
 /*
 ===============
@@ -139,6 +165,178 @@ void R_AddDynamicLights (void)
 	}
 }
 
+#if	idsimd
+
+/*
+===============
+R_AddDynamicLightsVec
+
+R_AddDynamicLights four samples of a row at a time.  Lanes past the end of
+a row fall through to the next row or the padding of blocklights and are
+written back unchanged.  The float math is done in the same order as the C
+version, so the results are the same
+===============
+*/
+static void R_AddDynamicLightsVec (void)
+{
+	msurface_t *surf;
+	int			lnum;
+	int			td;
+	float		dist, rad, minlight;
+	vec3_t		impact, local;
+	int			s, t;
+	int			i;
+	int			smax, tmax;
+	mtexinfo_t	*tex;
+	unsigned	*pbl;
+	vec4i_t		sd, sdist, lit, lanes, mask, bl;
+	vec4f_t		fdist;
+
+	surf = r_drawsurf.surf;
+	smax = (surf->extents[0]>>4)+1;
+	tmax = (surf->extents[1]>>4)+1;
+	tex = surf->texinfo;
+	lanes = (vec4i_t){0, 1, 2, 3};
+
+	for (lnum=0 ; lnum<MAX_DLIGHTS ; lnum++)
+	{
+		if ( !(surf->dlightbits & (1<<lnum) ) )
+			continue;		// not lit by this light
+
+		rad = cl_dlights[lnum].radius;
+		dist = DotProduct (cl_dlights[lnum].origin, surf->plane->normal) -
+				surf->plane->dist;
+		rad -= fabs(dist);
+		minlight = cl_dlights[lnum].minlight;
+		if (rad < minlight)
+			continue;
+		minlight = rad - minlight;
+
+		for (i=0 ; i<3 ; i++)
+		{
+			impact[i] = cl_dlights[lnum].origin[i] -
+					surf->plane->normal[i]*dist;
+		}
+
+		local[0] = DotProduct (impact, tex->vecs[0]) + tex->vecs[0][3];
+		local[1] = DotProduct (impact, tex->vecs[1]) + tex->vecs[1][3];
+
+		local[0] -= surf->texturemins[0];
+		local[1] -= surf->texturemins[1];
+		
+		for (t = 0 ; t<tmax ; t++)
+		{
+			td = local[1] - t*16;
+			if (td < 0)
+				td = -td;
+			pbl = blocklights + t*smax;
+
+			for (s=0 ; s<smax ; s+=4)
+			{
+				sd = __builtin_convertvector (local[0] -
+						__builtin_convertvector ((s + lanes) * 16, vec4f_t),
+						vec4i_t);
+				sd = (sd ^ (sd >> 31)) - (sd >> 31);
+
+				mask = sd > td;
+				sdist = ((sd + (td>>1)) & mask) | ((td + (sd>>1)) & ~mask);
+				fdist = __builtin_convertvector (sdist, vec4f_t);
+
+				memcpy (&bl, pbl + s, sizeof(bl));
+				lit = __builtin_convertvector (__builtin_convertvector (bl,
+						vec4f_t) + (rad - fdist)*256, vec4i_t);
+				mask = (fdist < minlight) & (s + lanes < smax);
+				bl = (lit & mask) | (bl & ~mask);
+				memcpy (pbl + s, &bl, sizeof(bl));
+			}
+		}
+	}
+}
+
+/*
+===============
+R_BuildLightMapVec
+
+R_BuildLightMap for lit surfaces, summing all the styles of four samples in
+vector registers before they are stored.  Without dynamic lights the bound,
+invert and shift is done in the same pass
+===============
+*/
+static void R_BuildLightMapVec (msurface_t *surf, int size, byte *lightmap)
+{
+	int			i, t, maps, nummaps, lightsample;
+	unsigned	scale[MAXLIGHTMAPS];
+	qboolean	dynamic;
+	vec4i_t		acc, mask;
+	vec16ub_t	samples;
+
+	nummaps = 0;
+	if (lightmap)
+		while (nummaps < MAXLIGHTMAPS && surf->styles[nummaps] != 255)
+		{
+			scale[nummaps] = r_drawsurf.lightadj[nummaps];	// 8.8 fraction
+			nummaps++;
+		}
+
+	dynamic = surf->dlightframe == r_framecount;
+
+	for (i=0 ; i+4<=size ; i+=4)
+	{
+		acc = (vec4i_t){0, 0, 0, 0} + (r_refdef.ambientlight<<8);
+		for (maps=0 ; maps<nummaps ; maps++)
+		{
+			memcpy (&lightsample, lightmap + maps*size + i, 4);
+			samples = (vec16ub_t)(vec4i_t){lightsample, 0, 0, 0};
+			acc += WIDEN_LO16(WIDEN_LO8(samples)) * (int)scale[maps];
+		}
+
+		if (!dynamic)
+		{
+			acc = (255*256 - acc) >> (8 - VID_CBITS);
+			mask = acc < (1 << 6);
+			acc = (acc & ~mask) | ((1 << 6) & mask);
+		}
+		memcpy (blocklights + i, &acc, sizeof(acc));
+	}
+
+	for ( ; i<size ; i++)
+	{
+		t = r_refdef.ambientlight<<8;
+		for (maps=0 ; maps<nummaps ; maps++)
+			t += lightmap[maps*size + i] * scale[maps];
+
+		if (!dynamic)
+		{
+			t = (255*256 - t) >> (8 - VID_CBITS);
+			if (t < (1 << 6))
+				t = (1 << 6);
+		}
+		blocklights[i] = t;
+	}
+
+	if (!dynamic)
+		return;
+
+// add all the dynamic lights
+#ifdef QUAKE2
+	R_AddDynamicLights ();
+#else
+	R_AddDynamicLightsVec ();
+#endif
+
+// bound, invert, and shift
+	for (i=0 ; i<size ; i+=4)
+	{
+		memcpy (&acc, blocklights + i, sizeof(acc));
+		acc = (255*256 - acc) >> (8 - VID_CBITS);
+		mask = acc < (1 << 6);
+		acc = (acc & ~mask) | ((1 << 6) & mask);
+		memcpy (blocklights + i, &acc, sizeof(acc));
+	}
+}
+
+#endif
+
 /*
 ===============
 R_BuildLightMap
@@ -170,6 +368,14 @@ void R_BuildLightMap (void)
 		return;
 	}
 
+#if	idsimd
+	if (d_simd.value)
+	{
+		R_BuildLightMapVec (surf, size, lightmap);
+		return;
+	}
+#endif
+
 // clear to ambient
 	for (i=0 ; i<size ; i++)
 		blocklights[i] = r_refdef.ambientlight<<8;
@@ -263,7 +469,7 @@ void R_DrawSurface (void)
 
 	mt = r_drawsurf.texture;
 	
-	r_source = (byte *)mt + mt->offsets[r_drawsurf.surfmip];
+	r_source = mt->pixels + mt->offsets[r_drawsurf.surfmip];
 	
 // the fractional light values should range from 0 to (VID_GRADES - 1) << 16
 // from a source range of 0 - 255
@@ -284,6 +490,10 @@ void R_DrawSurface (void)
 	if (r_pixbytes == 1)
 	{
 		pblockdrawer = surfmiptable[r_drawsurf.surfmip];
+#if	idsimd
+		if (d_simd.value)
+			pblockdrawer = surfmiptablevec[r_drawsurf.surfmip];
+#endif
 	// TODO: only needs to be set when there is a display settings change
 		horzblockstep = blocksize;
 	}
@@ -585,6 +795,284 @@ void R_DrawSurfaceBlock16 (void)
 #endif
 
 
+#if	idsimd
+
+/*
+================
+R_DrawLitTexelsVec
+
+Lights four texels and writes them through the colormap
+================
+*/
+static inline void R_DrawLitTexelsVec (unsigned char *pdest,
+	unsigned char *colormap, vec4i_t light, vec4i_t texels)
+{
+	int		offs[4] __attribute__ ((aligned (16)));
+
+	*(vec4i_t *)offs = (light & 0xFF00) + texels;
+	pdest[0] = colormap[offs[0]];
+	pdest[1] = colormap[offs[1]];
+	pdest[2] = colormap[offs[2]];
+	pdest[3] = colormap[offs[3]];
+}
+
+/*
+================
+R_DrawSurfaceBlockVec
+
+R_DrawSurfaceBlock8_mip0..2 with the lighting of a row interpolated four
+texels at a time in vector registers, so only the colormap fetches are left
+as scalar code.  blockshift is 4, 3 or 2 for 16, 8 or 4 texel blocks, the
+output is the same as the C versions
+================
+*/
+static inline void R_DrawSurfaceBlockVec (int blockshift)
+{
+	int				v, i, size, lightstep;
+	int				left, right, leftstep, rightstep;
+	int				tstep, rowbytes, lightwidth, t0, t1;
+	unsigned char	*psource, *prowdest, *colormap;
+	unsigned		*lightptr;
+	vec4i_t			lv, step4;
+	vec16ub_t		texels;
+	vec8us_t		lo, hi;
+
+// the byte stores below could alias any global, so keep everything local
+	psource = pbasesource;
+	prowdest = prowdestbase;
+	lightptr = r_lightptr;
+	colormap = (unsigned char *)vid.colormap;
+	tstep = sourcetstep;
+	rowbytes = surfrowbytes;
+	lightwidth = r_lightwidth;
+	size = 1 << blockshift;
+
+	for (v=0 ; v<r_numvblocks ; v++)
+	{
+		left = lightptr[0];
+		right = lightptr[1];
+		lightptr += lightwidth;
+		leftstep = (lightptr[0] - left) >> blockshift;
+		rightstep = (lightptr[1] - right) >> blockshift;
+
+		for (i=0 ; i<size ; i++)
+		{
+			lightstep = (left - right) >> blockshift;
+
+		// texel b gets right + (size - 1 - b) * lightstep, as if stepped
+		// from the right edge like the C versions
+			lv = right + (size - 1) * lightstep -
+					(vec4i_t){0, lightstep, lightstep*2, lightstep*3};
+			step4 = (vec4i_t){0, 0, 0, 0} + lightstep*4;
+
+		// loads narrower than a register go through ints, so the compiler
+		// does not assemble them on the stack
+			if (size == 16)
+				memcpy (&texels, psource, 16);
+			else
+			{
+				memcpy (&t0, psource, 4);
+				t1 = 0;
+				if (size == 8)
+					memcpy (&t1, psource + 4, 4);
+				texels = (vec16ub_t)(vec4i_t){t0, t1, 0, 0};
+			}
+			lo = WIDEN_LO8(texels);
+
+			R_DrawLitTexelsVec (prowdest, colormap, lv, WIDEN_LO16(lo));
+			if (size > 4)
+			{
+				lv -= step4;
+				R_DrawLitTexelsVec (prowdest + 4, colormap, lv,
+						WIDEN_HI16(lo));
+			}
+			if (size > 8)
+			{
+				hi = WIDEN_HI8(texels);
+				lv -= step4;
+				R_DrawLitTexelsVec (prowdest + 8, colormap, lv,
+						WIDEN_LO16(hi));
+				lv -= step4;
+				R_DrawLitTexelsVec (prowdest + 12, colormap, lv,
+						WIDEN_HI16(hi));
+			}
+
+			psource += tstep;
+			right += rightstep;
+			left += leftstep;
+			prowdest += rowbytes;
+		}
+
+		if (psource >= r_sourcemax)
+			psource -= r_stepback;
+	}
+
+	r_lightptr = lightptr;
+}
+
+void R_DrawSurfaceBlock8Vec_mip0 (void)
+{
+	R_DrawSurfaceBlockVec (4);
+}
+
+void R_DrawSurfaceBlock8Vec_mip1 (void)
+{
+	R_DrawSurfaceBlockVec (3);
+}
+
+void R_DrawSurfaceBlock8Vec_mip2 (void)
+{
+	R_DrawSurfaceBlockVec (2);
+}
+
+/*
+================
+R_DrawSurfaceBlock8Vec_mip3
+
+The blocks are only two texels wide here, so a vector covers two rows
+================
+*/
+void R_DrawSurfaceBlock8Vec_mip3 (void)
+{
+	int				v, lightstep, lightstep2;
+	int				left, right, leftstep, rightstep;
+	int				tstep, rowbytes, lightwidth;
+	int				offs[4] __attribute__ ((aligned (16)));
+	unsigned char	*psource, *prowdest, *colormap;
+	unsigned		*lightptr;
+
+	psource = pbasesource;
+	prowdest = prowdestbase;
+	lightptr = r_lightptr;
+	colormap = (unsigned char *)vid.colormap;
+	tstep = sourcetstep;
+	rowbytes = surfrowbytes;
+	lightwidth = r_lightwidth;
+
+	for (v=0 ; v<r_numvblocks ; v++)
+	{
+		left = lightptr[0];
+		right = lightptr[1];
+		lightptr += lightwidth;
+		leftstep = (lightptr[0] - left) >> 1;
+		rightstep = (lightptr[1] - right) >> 1;
+
+		lightstep = (left - right) >> 1;
+		lightstep2 = ((left + leftstep) - (right + rightstep)) >> 1;
+
+		*(vec4i_t *)offs = ((vec4i_t){right + lightstep, right,
+				right + rightstep + lightstep2, right + rightstep} & 0xFF00)
+				+ (vec4i_t){psource[0], psource[1],
+				psource[tstep], psource[tstep+1]};
+
+		prowdest[0] = colormap[offs[0]];
+		prowdest[1] = colormap[offs[1]];
+		prowdest[rowbytes] = colormap[offs[2]];
+		prowdest[rowbytes+1] = colormap[offs[3]];
+
+		psource += tstep*2;
+		prowdest += rowbytes*2;
+
+		if (psource >= r_sourcemax)
+			psource -= r_stepback;
+	}
+
+	r_lightptr = lightptr;
+}
+
+#endif
+
+
+/*
+================
+R_TimeSurfaceBlocks_f
+
+For program optimization: builds a 128*128 surface with random texels and
+lighting at each mip level, using the C and the vector block drawers, and
+checks that both give the same pixels
+================
+*/
+#define	TIMEBLOCKS_SIZE		128
+
+static double R_TimeSurfaceBlockDrawer (void (*drawer)(void), int mip,
+	unsigned char *pdest, unsigned *lights, int count)
+{
+	int		i, u, size;
+	double	start;
+
+	size = 16 >> mip;
+	r_lightwidth = TIMEBLOCKS_SIZE / size + 1;
+	r_numhblocks = TIMEBLOCKS_SIZE / size;
+	r_numvblocks = TIMEBLOCKS_SIZE / size;
+
+	start = Sys_FloatTime ();
+	for (i=0 ; i<count ; i++)
+	{
+		for (u=0 ; u<r_numhblocks ; u++)
+		{
+			r_lightptr = lights + u;
+			prowdestbase = pdest + u * size;
+			pbasesource = r_source + u * size;
+			(*drawer)();
+		}
+	}
+	return Sys_FloatTime () - start;
+}
+
+void R_TimeSurfaceBlocks_f (void)
+{
+	int				i, mip, count, pixels;
+	unsigned char	*buffer, *ref, *vec;
+	unsigned		*lights;
+	double			time;
+#if	idsimd
+	double			vectime;
+#endif
+
+	count = 200;
+	if (Cmd_Argc () > 1)
+		count = Q_atoi (Cmd_Argv (1));
+	if (count < 1)
+		count = 1;
+
+	pixels = TIMEBLOCKS_SIZE * TIMEBLOCKS_SIZE;
+	buffer = Hunk_TempAlloc (pixels * 3 + (TIMEBLOCKS_SIZE/2 + 1) *
+			(TIMEBLOCKS_SIZE/2 + 1) * sizeof(unsigned));
+	r_source = buffer;
+	ref = buffer + pixels;
+	vec = ref + pixels;
+	lights = (unsigned *)(vec + pixels);
+
+	for (i=0 ; i<pixels ; i++)
+		r_source[i] = rand () & 255;
+// same range as R_BuildLightMap leaves in blocklights
+	for (i=0 ; i<(TIMEBLOCKS_SIZE/2 + 1) * (TIMEBLOCKS_SIZE/2 + 1) ; i++)
+		lights[i] = (1<<6) + rand () % ((255*256 >> (8 - VID_CBITS)) - (1<<6));
+
+	surfrowbytes = TIMEBLOCKS_SIZE;
+	sourcetstep = TIMEBLOCKS_SIZE;
+	r_stepback = pixels;
+	r_sourcemax = r_source + pixels;
+
+	for (mip=0 ; mip<4 ; mip++)
+	{
+		time = R_TimeSurfaceBlockDrawer (surfmiptable[mip], mip, ref, lights,
+				count);
+#if	idsimd
+		vectime = R_TimeSurfaceBlockDrawer (surfmiptablevec[mip], mip, vec,
+				lights, count);
+		Con_Printf ("mip%i: C %6.1f Mpix/s, vector %6.1f Mpix/s (%4.2fx)%s\n",
+				mip, (double)pixels * count / time / 1e6,
+				(double)pixels * count / vectime / 1e6, time / vectime,
+				Q_memcmp (ref, vec, pixels) ? " MISMATCH" : "");
+#else
+		Con_Printf ("mip%i: C %6.1f Mpix/s, no vector drawers in this build\n",
+				mip, (double)pixels * count / time / 1e6);
+#endif
+	}
+}
+
+
 //============================================================================
 
 /*
@@ -651,12 +1139,12 @@ void R_GenTile (msurface_t *psurf, void *pdest)
 		if (r_pixbytes == 1)
 		{
 			R_GenTurbTile ((pixel_t *)
-				((byte *)psurf->texinfo->texture + psurf->texinfo->texture->offsets[0]), pdest);
+				(psurf->texinfo->texture->pixels + psurf->texinfo->texture->offsets[0]), pdest);
 		}
 		else
 		{
 			R_GenTurbTile16 ((pixel_t *)
-				((byte *)psurf->texinfo->texture + psurf->texinfo->texture->offsets[0]), pdest);
+				(psurf->texinfo->texture->pixels + psurf->texinfo->texture->offsets[0]), pdest);
 		}
 	}
 	else if (psurf->flags & SURF_DRAWSKY)
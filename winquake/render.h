@@ -108,10 +108,32 @@ extern	int		reinit_surfcache;
 
 
 extern	refdef_t	r_refdef;
-extern vec3_t	r_origin, vpn, vright, vup;
+extern vec3_t	r_origin;
+extern THREADLOCAL vec3_t	vpn, vright, vup;
 
 extern	struct texture_s	*r_notexture_mip;
 
+// per-stage refresh timings, summed over every frame rendered while
+// r_collectspeeds is set (same breakdown as r_speeds / r_dspeeds)
+typedef struct
+{
+	int		frames;
+	double	ms;			// whole refresh
+	double	rw_time;	// world edges
+	double	db_time;	// brush models
+	double	se_time;	// scan edges / span drawing
+	double	de_time;	// alias and sprite models
+	double	dv_time;	// view model
+	double	dp_time;	// particles
+	int		faceclip;
+	int		polycount;
+	int		drawnpolycount;
+	int		surf;		// surface cache builds
+} rspeeds_t;
+
+extern	qboolean	r_collectspeeds;
+extern	rspeeds_t	r_speedstotal;
+
 
 void R_Init (void);
 void R_InitTextures (void);
@@ -154,5 +176,20 @@ int	D_SurfaceCacheForRes (int width, int height);
 void D_FlushCaches (void);
 void D_DeleteSurfaceCache (void);
 void D_InitCaches (void *buffer, int size);
+
+typedef struct
+{
+	int		size;			// bytes of cache
+	int		blocks;			// surfaces held
+	int		lookups;		// surfaces drawn from the cache
+	int		builds;			// surfaces lit and built
+	int		evictions;
+	int		frameevictions;	// evicted after being drawn in the same frame
+	int		freebytes;
+	int		freeblocks;
+	int		largestfree;
+} surfcachestats_t;
+
+void D_SurfaceCacheStats (surfcachestats_t *stats);
 void R_SetVrect (vrect_t *pvrect, vrect_t *pvrectin, int lineadj);
 
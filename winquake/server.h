@@ -43,6 +43,7 @@ typedef struct
 	
 	int			lastcheck;			// used by PF_checkclient
 	double		lastchecktime;
+	struct mleaf_s	*checkleaf;		// whose PVS is in checkpvs
 	
 	char		name[64];			// map name
 #ifdef QUAKE2
@@ -69,11 +70,15 @@ typedef struct
 
 	sizebuf_t	signon;
 	byte		signon_buf[8192];
+
+	snapshot_t	*snapshots;			// [maxclients][UPDATE_BACKUP], NULL if
+									// PROTOCOL_DELTA is not offered
 } server_t;
 
 
 #define	NUM_PING_TIMES		16
 #define	NUM_SPAWN_PARMS		16
+#define	MAX_FAT_LEAFS		32		// more than this and fatpvs isn't cached
 
 typedef struct client_s
 {
@@ -106,6 +111,27 @@ typedef struct client_s
 
 // client known data for deltas	
 	int				old_frags;
+
+// the unreliable update for this frame, built on the worker threads
+	sizebuf_t		datagram;
+	byte			datagram_buf[MAX_DATAGRAM];
+	unsigned		fatpvs[MAX_MAP_LEAFS/32];	// PVS around the client's eye
+	short			fatleafs[MAX_FAT_LEAFS];	// leafs it was made from
+	int				numfatleafs;		// -1 if fatpvs is not cached
+
+// delta compressed entities
+	int				protocol;			// chosen in SV_SendServerinfo
+	int				snapshotsequence;	// of the next snapshot sent
+	int				snapshotack;		// last snapshot the client received
+	int				entitybytes;		// in the datagram being built
+	qboolean		deltaframe;			// datagram being built is a delta
+
+// bandwidth counters
+	int				datagrams;
+	int				datagrambytes;
+	int				totalentitybytes;
+	int				deltaframes;
+	int				overflows;
 } client_t;
 
 
@@ -239,11 +265,21 @@ void SV_ClientPrintf (char *fmt, ...);
 void SV_BroadcastPrintf (char *fmt, ...);
 
 void SV_Physics (void);
+void SV_WakeEdict (edict_t *ent);
+void SV_WakeAllEdicts (void);
+int SV_NumAwakeEdicts (void);
 
 qboolean SV_CheckBottom (edict_t *ent);
 qboolean SV_movestep (edict_t *ent, vec3_t move, qboolean relink);
 
 void SV_WriteClientdataToMessage (edict_t *ent, sizebuf_t *msg);
+#if idtiming
+void SV_TimeSend_f (void);
+#endif
+void SV_ClientStats_f (void);
+#if idtiming
+void SV_TimePVS_f (void);
+#endif
 
 void SV_MoveToGoal (void);
 
@@ -46,6 +46,13 @@ void SV_Init (void)
 	extern	cvar_t	sv_accelerate;
 	extern	cvar_t	sv_idealpitchscale;
 	extern	cvar_t	sv_aim;
+	extern	cvar_t	sv_areagrid;
+	extern	cvar_t	sv_tracecache;
+	extern	cvar_t	sv_iterativehull;
+	extern	cvar_t	sv_parallelclients;
+	extern	cvar_t	sv_deltaentities;
+	extern	cvar_t	sv_pvsindex;
+	extern	cvar_t	sv_activeedicts;
 
 	Cvar_RegisterVariable (&sv_maxvelocity);
 	Cvar_RegisterVariable (&sv_gravity);
@@ -57,6 +64,25 @@ void SV_Init (void)
 	Cvar_RegisterVariable (&sv_idealpitchscale);
 	Cvar_RegisterVariable (&sv_aim);
 	Cvar_RegisterVariable (&sv_nostep);
+	Cvar_RegisterVariable (&sv_areagrid);
+	Cvar_RegisterVariable (&sv_tracecache);
+	Cvar_RegisterVariable (&sv_iterativehull);
+	Cvar_RegisterVariable (&sv_parallelclients);
+	Cvar_RegisterVariable (&sv_deltaentities);
+	Cvar_RegisterVariable (&sv_pvsindex);
+	Cvar_RegisterVariable (&sv_activeedicts);
+#if idtiming
+	Cmd_AddCommand ("timemove", SV_TimeMove_f);
+	Cmd_AddCommand ("timehull", SV_TimeHull_f);
+#endif
+	Cmd_AddCommand ("tracestats", SV_TraceStats_f);
+#if idtiming
+	Cmd_AddCommand ("timesend", SV_TimeSend_f);
+#endif
+	Cmd_AddCommand ("clientstats", SV_ClientStats_f);
+#if idtiming
+	Cmd_AddCommand ("timepvs", SV_TimePVS_f);
+#endif
 
 	for (i=0 ; i<MAX_MODELS ; i++)
 		sprintf (localmodels[i], "*%i", i);
@@ -190,13 +216,30 @@ void SV_SendServerinfo (client_t *client)
 {
 	char			**s;
 	char			message[2048];
+	snapshot_t		*snapshots;
+	int				i;
 
 	MSG_WriteByte (&client->message, svc_print);
 	sprintf (message, "%c\nVERSION %4.2f SERVER (%i CRC)", 2, VERSION, pr_crc);
 	MSG_WriteString (&client->message,message);
 
+	client->numfatleafs = -1;	// the leafs are from another map
+
+// use delta compressed snapshots if the client asked for them when
+// connecting, otherwise stay with the standard protocol
+	client->protocol = PROTOCOL_VERSION;
+	if (sv.snapshots && client->netconnection->maxprotocol >= PROTOCOL_DELTA)
+	{
+		client->protocol = PROTOCOL_DELTA;
+		client->snapshotsequence = 1;
+		client->snapshotack = 0;
+		snapshots = sv.snapshots + (client - svs.clients)*UPDATE_BACKUP;
+		for (i=0 ; i<UPDATE_BACKUP ; i++)
+			snapshots[i].sequence = 0;
+	}
+
 	MSG_WriteByte (&client->message, svc_serverinfo);
-	MSG_WriteLong (&client->message, PROTOCOL_VERSION);
+	MSG_WriteLong (&client->message, client->protocol);
 	MSG_WriteByte (&client->message, svs.maxclients);
 
 	if (!coop.value && deathmatch.value)
@@ -361,10 +404,7 @@ crosses a waterline.
 =============================================================================
 */
 
-int		fatbytes;
-byte	fatpvs[MAX_MAP_LEAFS/8];
-
-void SV_AddToFatPVS (vec3_t org, mnode_t *node)
+void SV_AddToFatPVS (vec3_t org, mnode_t *node, byte *fatpvs, int fatbytes)
 {
 	int		i;
 	byte	*pvs;
@@ -393,7 +433,7 @@ void SV_AddToFatPVS (vec3_t org, mnode_t *node)
 			node = node->children[1];
 		else
 		{	// go down both
-			SV_AddToFatPVS (org, node->children[0]);
+			SV_AddToFatPVS (org, node->children[0], fatpvs, fatbytes);
 			node = node->children[1];
 		}
 	}
@@ -404,67 +444,307 @@ void SV_AddToFatPVS (vec3_t org, mnode_t *node)
 SV_FatPVS
 
 Calculates a PVS that is the inclusive or of all leafs within 8 pixels of the
-given point.
+given point, into fatpvs.
 =============
 */
-byte *SV_FatPVS (vec3_t org)
+byte *SV_FatPVS (vec3_t org, byte *fatpvs)
 {
+	int		fatbytes;
+
 	fatbytes = (sv.worldmodel->numleafs+31)>>3;
 	Q_memset (fatpvs, 0, fatbytes);
-	SV_AddToFatPVS (org, sv.worldmodel->nodes);
+	SV_AddToFatPVS (org, sv.worldmodel->nodes, fatpvs, fatbytes);
 	return fatpvs;
 }
 
-//=============================================================================
+/*
+=============
+SV_FindFatLeafs
 
+Lists the leafs SV_AddToFatPVS would take the PVS of.  Stops listing at
+MAX_FAT_LEAFS, but keeps counting up to one more.
+=============
+*/
+void SV_FindFatLeafs (vec3_t org, mnode_t *node, short *leafs, int *numleafs)
+{
+	mplane_t	*plane;
+	float	d;
+
+	while (1)
+	{
+		if (node->contents < 0)
+		{
+			if (node->contents != CONTENTS_SOLID && *numleafs <= MAX_FAT_LEAFS)
+			{
+				if (*numleafs < MAX_FAT_LEAFS)
+					leafs[*numleafs] = (mleaf_t *)node - sv.worldmodel->leafs;
+				(*numleafs)++;
+			}
+			return;
+		}
+	
+		plane = node->plane;
+		d = DotProduct (org, plane->normal) - plane->dist;
+		if (d > 8)
+			node = node->children[0];
+		else if (d < -8)
+			node = node->children[1];
+		else
+		{	// go down both
+			SV_FindFatLeafs (org, node->children[0], leafs, numleafs);
+			node = node->children[1];
+		}
+	}
+}
 
 /*
 =============
-SV_WriteEntitiesToClient
+SV_ClientFatPVS
 
+SV_FatPVS around the client's eye, kept in client->fatpvs.  It is only
+made again, a word at a time, when the eye moves to a different set of
+leafs.
 =============
 */
-void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
+byte *SV_ClientFatPVS (client_t *client)
 {
-	int		e, i;
-	int		bits;
-	byte	*pvs;
-	vec3_t	org;
-	float	miss;
-	edict_t	*ent;
+	int			i, j, words, numleafs;
+	short		leafs[MAX_FAT_LEAFS];
+	unsigned	*pvs;
+	vec3_t		org;
+
+	VectorAdd (client->edict->v.origin, client->edict->v.view_ofs, org);
+	numleafs = 0;
+	SV_FindFatLeafs (org, sv.worldmodel->nodes, leafs, &numleafs);
+	if (numleafs > MAX_FAT_LEAFS)
+	{	// too many to remember
+		client->numfatleafs = -1;
+		return SV_FatPVS (org, (byte *)client->fatpvs);
+	}
 
-// find the client's PVS
-	VectorAdd (clent->v.origin, clent->v.view_ofs, org);
-	pvs = SV_FatPVS (org);
+	if (numleafs == client->numfatleafs
+	&& !memcmp (leafs, client->fatleafs, numleafs*sizeof(short)))
+		return (byte *)client->fatpvs;
 
-// send over all entities (excpet the client) that touch the pvs
-	ent = NEXT_EDICT(sv.edicts);
-	for (e=1 ; e<sv.num_edicts ; e++, ent = NEXT_EDICT(ent))
+	words = (sv.worldmodel->numleafs+31)>>5;
+	memset (client->fatpvs, 0, words*sizeof(unsigned));
+	for (i=0 ; i<numleafs ; i++)
 	{
+		pvs = (unsigned *)Mod_LeafPVS (sv.worldmodel->leafs + leafs[i], sv.worldmodel);
+		for (j=0 ; j<words ; j++)
+			client->fatpvs[j] |= pvs[j];
+	}
+	memcpy (client->fatleafs, leafs, numleafs*sizeof(short));
+	client->numfatleafs = numleafs;
+	return (byte *)client->fatpvs;
+}
+
+//=============================================================================
+
+
+/*
+=============
+SV_EntityVisible
+
+True if ent should be sent to the client playing clent
+=============
+*/
+qboolean SV_EntityVisible (edict_t *clent, edict_t *ent, byte *pvs)
+{
+	int		i;
+
 #ifdef QUAKE2
-		// don't send if flagged for NODRAW and there are no lighting effects
-		if (ent->v.effects == EF_NODRAW)
-			continue;
+	// don't send if flagged for NODRAW and there are no lighting effects
+	if (ent->v.effects == EF_NODRAW)
+		return false;
 #endif
 
+	if (ent == clent)	// clent is ALLWAYS sent
+		return true;
+
+// ignore ents without visible models
+	if (!ent->v.modelindex || !pr_strings[ent->v.model])
+		return false;
+
 // ignore if not touching a PV leaf
-		if (ent != clent)	// clent is ALLWAYS sent
+	for (i=0 ; i < ent->num_leafs ; i++)
+		if (pvs[ent->leafnums[i] >> 3] & (1 << (ent->leafnums[i]&7) ))
+			return true;
+
+	return false;
+}
+
+cvar_t	sv_pvsindex = {"sv_pvsindex", "1"};
+
+/*
+=============
+SV_VisibleEdicts
+
+Lists the numbers of the edicts that should be sent to the client, in
+order, and returns how many there are.  With sv_pvsindex, only the edicts
+the PVS edict index turns up are checked.
+=============
+*/
+int SV_VisibleEdicts (client_t *client, short *list)
+{
+	int			e, i, j, words, count;
+	unsigned	edicts[PVS_EDICTWORDS], bits;
+	byte		*pvs;
+	vec3_t		org;
+	edict_t		*clent, *ent;
+
+	clent = client->edict;
+	count = 0;
+
+	if (!sv_pvsindex.value)
+	{
+		VectorAdd (clent->v.origin, clent->v.view_ofs, org);
+		pvs = SV_FatPVS (org, (byte *)client->fatpvs);
+		client->numfatleafs = -1;
+
+		ent = NEXT_EDICT(sv.edicts);
+		for (e=1 ; e<sv.num_edicts ; e++, ent = NEXT_EDICT(ent))
+			if (SV_EntityVisible (clent, ent, pvs))
+				list[count++] = e;
+		return count;
+	}
+
+	pvs = SV_ClientFatPVS (client);
+	SV_PVSEdicts (pvs, edicts);
+	e = NUM_FOR_EDICT(clent);
+	edicts[e>>5] |= 1u << (e&31);	// clent is ALLWAYS sent
+
+	words = (sv.num_edicts+31)>>5;
+	for (i=0 ; i<words ; i++)
+	{
+		bits = edicts[i];
+		for (j=0 ; bits ; j++, bits >>= 1)
 		{
-// ignore ents without visible models
-			if (!ent->v.modelindex || !pr_strings[ent->v.model])
+			if (!(bits & 1))
+				continue;
+			e = (i<<5) + j;
+			if (e == 0 || e >= sv.num_edicts)
 				continue;
+			if (SV_EntityVisible (clent, EDICT_NUM(e), pvs))
+				list[count++] = e;
+		}
+	}
+	return count;
+}
+
+#if idtiming
+static client_t	*time_pvsclients[MAX_SCOREBOARD];
+static int		time_numpvsclients;
+static int		time_counts[MAX_SCOREBOARD];
+static short	*time_lists;
 
-			for (i=0 ; i < ent->num_leafs ; i++)
-				if (pvs[ent->leafnums[i] >> 3] & (1 << (ent->leafnums[i]&7) ))
-					break;
-				
-			if (i == ent->num_leafs)
-				continue;		// not visible
+/*
+=============
+SV_TimePVSRun
+
+Finds the visible edicts of every client, with a fat PVS made every time
+on the second pass
+=============
+*/
+static int SV_TimePVSRun (int pass, qboolean check)
+{
+	short	list[MAX_EDICTS];
+	int		i, diffs, numvisible;
+
+	diffs = 0;
+	for (i=0 ; i<time_numpvsclients ; i++)
+	{
+		if (pass == 1)
+			time_pvsclients[i]->numfatleafs = -1;
+		numvisible = SV_VisibleEdicts (time_pvsclients[i], list);
+		if (!check)
+			continue;
+		if (!pass)
+		{
+			time_counts[i] = numvisible;
+			memcpy (time_lists + i*MAX_EDICTS, list, numvisible*sizeof(short));
 		}
+		else if (time_counts[i] != numvisible
+		|| memcmp (time_lists + i*MAX_EDICTS, list, numvisible*sizeof(short)))
+			diffs++;
+	}
+	return diffs;
+}
+
+/*
+=============
+SV_TimePVS_f
+
+timepvs [count]
+Finds the visible edicts of every spawned client with the original fat
+PVS and edict loop, with the index and a fat PVS made every time, and
+with the index and the cached fat PVS, and checks the lists agree.
+=============
+*/
+void SV_TimePVS_f (void)
+{
+	timing_t	t;
+	int			i, count;
+
+	if (!Timing_Server ())
+		return;
+	count = Timing_Count (1, 1000);
+
+	time_numpvsclients = 0;
+	for (i=0 ; i<svs.maxclients ; i++)
+		if (svs.clients[i].active && svs.clients[i].spawned)
+			time_pvsclients[time_numpvsclients++] = &svs.clients[i];
+	if (!time_numpvsclients)
+	{
+		Con_Printf ("No spawned clients\n");
+		return;
+	}
+	time_lists = Hunk_TempAlloc (time_numpvsclients * MAX_EDICTS * sizeof(short));
+
+	memset (&t, 0, sizeof(t));
+	t.numpasses = 3;
+	t.names[0] = "loop";
+	t.names[1] = "index";
+	t.names[2] = "cached";
+	t.cvar = "sv_pvsindex";
+	t.values[0] = 0;
+	t.values[1] = 1;
+	t.values[2] = 1;
+	t.unit = "client";
+	t.results = "lists";
+	t.run = SV_TimePVSRun;
+	Timing_Run (&t, count);
+
+	Con_Printf ("%i clients, %i edicts\n", time_numpvsclients, sv.num_edicts);
+	Timing_Print (&t, count * time_numpvsclients);
+}
+#endif
+
+/*
+=============
+SV_WriteEntitiesToClient
+
+Sets msg->overflowed if some entities didn't fit.
+=============
+*/
+void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg)
+{
+	int		e, i, v, numvisible;
+	int		bits;
+	short	visible[MAX_EDICTS];
+	float	miss;
+	edict_t	*ent;
+
+// send over all entities (excpet the client) that touch the pvs
+	numvisible = SV_VisibleEdicts (client, visible);
+	for (v=0 ; v<numvisible ; v++)
+	{
+		e = visible[v];
+		ent = EDICT_NUM(e);
 
 		if (msg->maxsize - msg->cursize < 16)
 		{
-			Con_Printf ("packet overflow\n");
+			msg->overflowed = true;
 			return;
 		}
 
@@ -548,6 +828,310 @@ void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
 	}
 }
 
+/*
+=============================================================================
+
+DELTA COMPRESSED SNAPSHOTS
+
+A PROTOCOL_DELTA client is sent everything it can see as a numbered
+snapshot.  Each snapshot only carries the differences from the last one the
+client said it received, so entities that are standing still cost nothing.
+The last UPDATE_BACKUP snapshots of each client are kept to delta from.
+
+=============================================================================
+*/
+
+cvar_t	sv_deltaentities = {"sv_deltaentities", "1"};
+
+/*
+=============
+SV_PackEntity
+
+Rounds the entity off the same way MSG_WriteCoord and MSG_WriteAngle do
+=============
+*/
+void SV_PackEntity (edict_t *ent, int num, packedentity_t *to)
+{
+	int		i;
+
+	to->number = num;
+	for (i=0 ; i<3 ; i++)
+	{
+		to->origin[i] = (int)(ent->v.origin[i]*8);
+		to->angles[i] = (int)ent->v.angles[i]*256/360;
+	}
+	to->modelindex = (int)ent->v.modelindex;
+	to->frame = (int)ent->v.frame;
+	to->colormap = (int)ent->v.colormap;
+	to->skin = (int)ent->v.skin;
+	to->effects = (int)ent->v.effects;
+	to->flags = ent->v.movetype == MOVETYPE_STEP ? U_NOLERP : 0;
+}
+
+/*
+=============
+SV_PackBaseline
+
+The baseline as the client got it in svc_spawnbaseline
+=============
+*/
+void SV_PackBaseline (edict_t *ent, int num, packedentity_t *to)
+{
+	int		i;
+
+	to->number = num;
+	for (i=0 ; i<3 ; i++)
+	{
+		to->origin[i] = (int)(ent->baseline.origin[i]*8);
+		to->angles[i] = (int)ent->baseline.angles[i]*256/360;
+	}
+	to->modelindex = ent->baseline.modelindex;
+	to->frame = ent->baseline.frame;
+	to->colormap = ent->baseline.colormap;
+	to->skin = ent->baseline.skin;
+	to->effects = ent->baseline.effects;
+	to->flags = 0;
+}
+
+/*
+=============
+SV_DeltaBits
+
+The fields that changed, with U_NOLERP standing for a change of flags
+=============
+*/
+int SV_DeltaBits (packedentity_t *from, packedentity_t *to)
+{
+	int		i;
+	int		bits;
+
+	bits = 0;
+	for (i=0 ; i<3 ; i++)
+		if (to->origin[i] != from->origin[i])
+			bits |= U_ORIGIN1<<i;
+	if (to->angles[0] != from->angles[0])
+		bits |= U_ANGLE1;
+	if (to->angles[1] != from->angles[1])
+		bits |= U_ANGLE2;
+	if (to->angles[2] != from->angles[2])
+		bits |= U_ANGLE3;
+	if (to->modelindex != from->modelindex)
+		bits |= U_MODEL;
+	if (to->frame != from->frame)
+		bits |= U_FRAME;
+	if (to->colormap != from->colormap)
+		bits |= U_COLORMAP;
+	if (to->skin != from->skin)
+		bits |= U_SKIN;
+	if (to->effects != from->effects)
+		bits |= U_EFFECTS;
+	if (to->flags != from->flags)
+		bits |= U_NOLERP;
+
+	return bits;
+}
+
+/*
+=============
+SV_WriteDeltaEntity
+
+Writes nothing if the entity didn't change, unless force is set
+=============
+*/
+void SV_WriteDeltaEntity (packedentity_t *from, packedentity_t *to, sizebuf_t *msg, qboolean force)
+{
+	int		bits;
+
+	bits = SV_DeltaBits (from, to);
+	if (!bits && !force)
+		return;
+
+	bits = (bits & ~U_NOLERP) | to->flags;
+	if (bits >= 256)
+		bits |= U_MOREBITS;
+
+	MSG_WriteShort (msg, to->number);
+	MSG_WriteByte (msg, bits & 255);
+	if (bits & U_MOREBITS)
+		MSG_WriteByte (msg, bits>>8);
+
+	if (bits & U_MODEL)
+		MSG_WriteByte (msg, to->modelindex);
+	if (bits & U_FRAME)
+		MSG_WriteByte (msg, to->frame);
+	if (bits & U_COLORMAP)
+		MSG_WriteByte (msg, to->colormap);
+	if (bits & U_SKIN)
+		MSG_WriteByte (msg, to->skin);
+	if (bits & U_EFFECTS)
+		MSG_WriteByte (msg, to->effects);
+	if (bits & U_ORIGIN1)
+		MSG_WriteShort (msg, to->origin[0]);
+	if (bits & U_ANGLE1)
+		MSG_WriteByte (msg, to->angles[0]);
+	if (bits & U_ORIGIN2)
+		MSG_WriteShort (msg, to->origin[1]);
+	if (bits & U_ANGLE2)
+		MSG_WriteByte (msg, to->angles[1]);
+	if (bits & U_ORIGIN3)
+		MSG_WriteShort (msg, to->origin[2]);
+	if (bits & U_ANGLE3)
+		MSG_WriteByte (msg, to->angles[2]);
+}
+
+#define	MAX_DELTA_ENTITY	18		// number, bits and every field
+
+/*
+=============
+SV_WriteSnapshotToClient
+
+The PROTOCOL_DELTA version of SV_WriteEntitiesToClient.  If the datagram
+fills up, the entities that didn't make it are left in the stored snapshot
+as the client still has them, so the next delta is right.
+=============
+*/
+void SV_WriteSnapshotToClient (client_t *client, sizebuf_t *msg)
+{
+	snapshot_t	*snapshots, *from, *to;
+	packedentity_t	visible[MAX_PACKET_ENTITIES];
+	packedentity_t	base;
+	short		edicts[MAX_EDICTS];
+	int			i, j, numedicts, numvisible, numold;
+	int			newnum, oldnum, removes, reserve;
+
+// pack everything the client can see, in entity order
+	numedicts = SV_VisibleEdicts (client, edicts);
+	numvisible = 0;
+	for (i=0 ; i<numedicts ; i++)
+	{
+		if (numvisible == MAX_PACKET_ENTITIES)
+		{
+			msg->overflowed = true;
+			break;
+		}
+		SV_PackEntity (EDICT_NUM(edicts[i]), edicts[i], &visible[numvisible++]);
+	}
+
+// delta from the last snapshot the client received if it is still around,
+// otherwise send everything against the baselines
+	snapshots = sv.snapshots + (client - svs.clients)*UPDATE_BACKUP;
+	from = NULL;
+	numold = 0;
+	if (client->snapshotack > 0 && client->snapshotack < client->snapshotsequence
+	&& client->snapshotsequence - client->snapshotack < UPDATE_BACKUP)
+	{
+		from = &snapshots[client->snapshotack & UPDATE_MASK];
+		if (from->sequence == client->snapshotack)
+			numold = from->num_entities;
+		else
+			from = NULL;
+	}
+
+// removes always go out, so room is kept for them and the terminator
+	removes = 0;
+	for (i=j=0 ; j<numold ; j++)
+	{
+		while (i < numvisible && visible[i].number < from->entities[j].number)
+			i++;
+		if (i == numvisible || visible[i].number != from->entities[j].number)
+			removes++;
+	}
+	reserve = removes*2 + 2;
+
+	if (msg->maxsize - msg->cursize < 6 + reserve)
+	{
+		msg->overflowed = true;
+		return;
+	}
+
+	MSG_WriteByte (msg, svc_packetentities);
+	MSG_WriteLong (msg, client->snapshotsequence);
+	MSG_WriteByte (msg, from ? client->snapshotsequence - from->sequence : 0);
+	client->deltaframe = from != NULL;
+
+	to = &snapshots[client->snapshotsequence & UPDATE_MASK];
+	to->sequence = client->snapshotsequence;
+	to->num_entities = 0;
+
+	i = j = 0;
+	while (i < numvisible || j < numold)
+	{
+		newnum = i < numvisible ? visible[i].number : MAX_EDICTS;
+		oldnum = j < numold ? from->entities[j].number : MAX_EDICTS;
+
+		if (newnum == oldnum)
+		{	// the client has it, send what changed
+			if (msg->maxsize - msg->cursize - reserve < MAX_DELTA_ENTITY
+			&& SV_DeltaBits (&from->entities[j], &visible[i]))
+			{
+				msg->overflowed = true;
+				to->entities[to->num_entities++] = from->entities[j];
+			}
+			else
+			{
+				SV_WriteDeltaEntity (&from->entities[j], &visible[i], msg, false);
+				to->entities[to->num_entities++] = visible[i];
+			}
+			i++;
+			j++;
+		}
+		else if (newnum < oldnum)
+		{	// coming into view, send it against the baseline
+			if (msg->maxsize - msg->cursize - reserve < MAX_DELTA_ENTITY)
+				msg->overflowed = true;
+			else
+			{
+				SV_PackBaseline (EDICT_NUM(newnum), newnum, &base);
+				SV_WriteDeltaEntity (&base, &visible[i], msg, true);
+				to->entities[to->num_entities++] = visible[i];
+			}
+			i++;
+		}
+		else
+		{	// out of view
+			MSG_WriteShort (msg, oldnum | PE_REMOVE);
+			reserve -= 2;
+			j++;
+		}
+	}
+
+	MSG_WriteShort (msg, 0);
+	client->snapshotsequence++;
+}
+
+/*
+=============
+SV_ClientStats_f
+
+Prints what each client has been sent
+=============
+*/
+void SV_ClientStats_f (void)
+{
+	client_t	*client;
+	int			i;
+
+	if (!sv.active)
+	{
+		Con_Printf ("Not running a server\n");
+		return;
+	}
+
+	for (i=0, client = svs.clients ; i<svs.maxclients ; i++, client++)
+	{
+		if (!client->active)
+			continue;
+		Con_Printf ("%-16.16s protocol %i\n", client->name, client->protocol);
+		if (!client->datagrams)
+			continue;
+		Con_Printf ("  %i datagrams, %i delta, %i overflowed\n", client->datagrams,
+			client->deltaframes, client->overflows);
+		Con_Printf ("  %i bytes, %i in entities per datagram\n",
+			client->datagrambytes / client->datagrams,
+			client->totalentitybytes / client->datagrams);
+	}
+}
+
 /*
 =============
 SV_CleanupEnts
@@ -571,6 +1155,7 @@ void SV_CleanupEnts (void)
 ==================
 SV_WriteClientdataToMessage
 
+Call SV_SetIdealPitch first
 ==================
 */
 void SV_WriteClientdataToMessage (edict_t *ent, sizebuf_t *msg)
@@ -599,11 +1184,6 @@ void SV_WriteClientdataToMessage (edict_t *ent, sizebuf_t *msg)
 		ent->v.dmg_save = 0;
 	}
 
-//
-// send the current viewpos offset from the view entity
-//
-	SV_SetIdealPitch ();		// how much to look up / down ideally
-
 // a fixangle might get lost in a dropped packet.  Oh well.
 	if ( ent->v.fixangle )
 	{
@@ -714,32 +1294,64 @@ void SV_WriteClientdataToMessage (edict_t *ent, sizebuf_t *msg)
 
 /*
 =======================
-SV_SendClientDatagram
+SV_BuildClientDatagram
+
+Writes this frame's unreliable update for a client into client->datagram.
+Other than the client's own edict nothing is changed, so the updates for
+different clients can be built at the same time.
 =======================
 */
-qboolean SV_SendClientDatagram (client_t *client)
+void SV_BuildClientDatagram (client_t *client)
 {
-	byte		buf[MAX_DATAGRAM];
-	sizebuf_t	msg;
-	
-	msg.data = buf;
-	msg.maxsize = sizeof(buf);
-	msg.cursize = 0;
+	sizebuf_t	*msg;
+	int			start;
+
+	msg = &client->datagram;
+	msg->data = client->datagram_buf;
+	msg->maxsize = sizeof(client->datagram_buf);
+	msg->cursize = 0;
+	msg->overflowed = false;
 
-	MSG_WriteByte (&msg, svc_time);
-	MSG_WriteFloat (&msg, sv.time);
+	MSG_WriteByte (msg, svc_time);
+	MSG_WriteFloat (msg, sv.time);
 
 // add the client specific data to the datagram
-	SV_WriteClientdataToMessage (client->edict, &msg);
+	SV_WriteClientdataToMessage (client->edict, msg);
 
-	SV_WriteEntitiesToClient (client->edict, &msg);
+	start = msg->cursize;
+	client->deltaframe = false;
+	if (client->protocol == PROTOCOL_DELTA)
+		SV_WriteSnapshotToClient (client, msg);
+	else
+		SV_WriteEntitiesToClient (client, msg);
+	client->entitybytes = msg->cursize - start;
 
 // copy the server datagram if there is space
-	if (msg.cursize + sv.datagram.cursize < msg.maxsize)
-		SZ_Write (&msg, sv.datagram.data, sv.datagram.cursize);
+	if (msg->cursize + sv.datagram.cursize < msg->maxsize)
+		SZ_Write (msg, sv.datagram.data, sv.datagram.cursize);
+}
+
+/*
+=======================
+SV_SendBuiltDatagram
+=======================
+*/
+qboolean SV_SendBuiltDatagram (client_t *client)
+{
+	if (client->datagram.overflowed)
+	{
+		Con_Printf ("packet overflow\n");
+		client->overflows++;
+	}
+
+	client->datagrams++;
+	client->datagrambytes += client->datagram.cursize;
+	client->totalentitybytes += client->entitybytes;
+	if (client->deltaframe)
+		client->deltaframes++;
 
 // send the datagram
-	if (NET_SendUnreliableMessage (client->netconnection, &msg) == -1)
+	if (NET_SendUnreliableMessage (client->netconnection, &client->datagram) == -1)
 	{
 		SV_DropClient (true);// if the message couldn't send, kick off
 		return false;
@@ -748,6 +1360,46 @@ qboolean SV_SendClientDatagram (client_t *client)
 	return true;
 }
 
+/*
+=======================
+SV_SendClientDatagram
+=======================
+*/
+qboolean SV_SendClientDatagram (client_t *client)
+{
+	SV_SetIdealPitch ();		// how much to look up / down ideally
+	SV_BuildClientDatagram (client);
+	return SV_SendBuiltDatagram (client);
+}
+
+/*
+=======================
+SV_BuildDatagramJob
+=======================
+*/
+void SV_BuildDatagramJob (int job, void *arg)
+{
+	SV_BuildClientDatagram (((client_t **)arg)[job]);
+}
+
+/*
+=======================
+SV_BuildClientDatagrams
+
+Builds the unreliable updates for the count clients on the worker threads.
+SV_SetIdealPitch only ever looks at sv_player, so it is done once up front.
+=======================
+*/
+void SV_BuildClientDatagrams (client_t **clients, int count)
+{
+	if (!count)
+		return;
+
+	SV_SetIdealPitch ();
+
+	Sys_RunWorkers (count, SV_BuildDatagramJob, clients);
+}
+
 /*
 =======================
 SV_UpdateToReliableMessages
@@ -811,6 +1463,8 @@ void SV_SendNop (client_t *client)
 	client->last_message = realtime;
 }
 
+cvar_t	sv_parallelclients = {"sv_parallelclients", "1"};
+
 /*
 =======================
 SV_SendClientMessages
@@ -818,11 +1472,25 @@ SV_SendClientMessages
 */
 void SV_SendClientMessages (void)
 {
-	int			i;
+	int			i, count;
+	client_t	*built[MAX_SCOREBOARD];
+	qboolean	parallel;
 	
 // update frags, names, etc
 	SV_UpdateToReliableMessages ();
 
+// with worker threads, build the datagrams for every spawned client
+// first and then send them all
+	count = 0;
+	parallel = sv_parallelclients.value && Sys_NumWorkers () > 1;
+	if (parallel)
+	{
+		for (i=0, host_client = svs.clients ; i<svs.maxclients ; i++, host_client++)
+			if (host_client->active && host_client->spawned)
+				built[count++] = host_client;
+		SV_BuildClientDatagrams (built, count);
+	}
+
 // build individual updates
 	for (i=0, host_client = svs.clients ; i<svs.maxclients ; i++, host_client++)
 	{
@@ -831,7 +1499,12 @@ void SV_SendClientMessages (void)
 
 		if (host_client->spawned)
 		{
-			if (!SV_SendClientDatagram (host_client))
+			if (parallel)
+			{
+				if (!SV_SendBuiltDatagram (host_client))
+					continue;
+			}
+			else if (!SV_SendClientDatagram (host_client))
 				continue;
 		}
 		else
@@ -887,6 +1560,136 @@ void SV_SendClientMessages (void)
 }
 
 
+#if idtiming
+static client_t	*time_clients[MAX_SCOREBOARD];
+static int		time_numclients;
+static float	time_damage[MAX_SCOREBOARD][3];
+static int		time_sequence[MAX_SCOREBOARD];
+static int		time_sizes[MAX_SCOREBOARD];
+static byte		*time_datagrams;
+
+/*
+=======================
+SV_TimeSendRestore
+
+Building a datagram clears the damage and fixangle of the client and moves
+on its snapshot sequence, so they are put back before every build, and for
+the real one later in the frame
+=======================
+*/
+static void SV_TimeSendRestore (void)
+{
+	edict_t	*ent;
+	int		i;
+
+	for (i=0 ; i<time_numclients ; i++)
+	{
+		ent = time_clients[i]->edict;
+		ent->v.dmg_take = time_damage[i][0];
+		ent->v.dmg_save = time_damage[i][1];
+		ent->v.fixangle = time_damage[i][2];
+		time_clients[i]->snapshotsequence = time_sequence[i];
+	}
+}
+
+/*
+=======================
+SV_TimeSendRun
+
+Builds the datagrams one after another as SV_SendClientDatagram does, or
+on the worker threads
+=======================
+*/
+static int SV_TimeSendRun (int pass, qboolean check)
+{
+	client_t	*client;
+	int			i, diffs;
+
+	SV_TimeSendRestore ();
+	if (!pass)
+	{
+		for (i=0 ; i<time_numclients ; i++)
+		{
+			SV_SetIdealPitch ();
+			SV_BuildClientDatagram (time_clients[i]);
+		}
+	}
+	else
+		SV_BuildClientDatagrams (time_clients, time_numclients);
+
+	if (!check)
+		return 0;
+	diffs = 0;
+	for (i=0 ; i<time_numclients ; i++)
+	{
+		client = time_clients[i];
+		if (!pass)
+		{
+			time_sizes[i] = client->datagram.cursize;
+			memcpy (time_datagrams + i*MAX_DATAGRAM, client->datagram.data, time_sizes[i]);
+		}
+		else if (time_sizes[i] != client->datagram.cursize
+		|| memcmp (time_datagrams + i*MAX_DATAGRAM, client->datagram.data, time_sizes[i]))
+			diffs++;
+	}
+	return diffs;
+}
+
+/*
+=======================
+SV_TimeSend_f
+
+timesend [count]
+Builds the datagrams for every spawned client one after another and then
+on the worker threads, and checks the two give the same bytes
+=======================
+*/
+void SV_TimeSend_f (void)
+{
+	timing_t	t;
+	edict_t		*ent;
+	int			i, count;
+
+	if (!Timing_Server ())
+		return;
+	count = Timing_Count (1, 100);
+
+	time_numclients = 0;
+	for (i=0 ; i<svs.maxclients ; i++)
+		if (svs.clients[i].active && svs.clients[i].spawned)
+			time_clients[time_numclients++] = &svs.clients[i];
+	if (!time_numclients)
+	{
+		Con_Printf ("No spawned clients\n");
+		return;
+	}
+
+	for (i=0 ; i<time_numclients ; i++)
+	{
+		ent = time_clients[i]->edict;
+		time_damage[i][0] = ent->v.dmg_take;
+		time_damage[i][1] = ent->v.dmg_save;
+		time_damage[i][2] = ent->v.fixangle;
+		time_sequence[i] = time_clients[i]->snapshotsequence;
+	}
+	time_datagrams = Hunk_TempAlloc (time_numclients * MAX_DATAGRAM);
+
+	memset (&t, 0, sizeof(t));
+	t.numpasses = 2;
+	t.names[0] = "serial";
+	t.names[1] = "parallel";
+	t.unit = "frame";
+	t.results = "datagrams";
+	t.run = SV_TimeSendRun;
+	Timing_Run (&t, count);
+	SV_TimeSendRestore ();
+
+	Con_Printf ("%i clients, %i workers\n", time_numclients, Sys_NumWorkers ());
+	Timing_Print (&t, count);
+}
+#endif
+
+
 /*
 ==============================================================================
 
@@ -1100,6 +1903,10 @@ void SV_SpawnServer (char *server)
 	
 	sv.edicts = Hunk_AllocName (sv.max_edicts*pr_edict_size, "edicts");
 
+// only remote clients can take delta compressed snapshots
+	if (svs.maxclients > 1 && sv_deltaentities.value)
+		sv.snapshots = Hunk_AllocName (svs.maxclients*UPDATE_BACKUP*sizeof(snapshot_t), "snapshots");
+
 	sv.datagram.maxsize = sizeof(sv.datagram_buf);
 	sv.datagram.cursize = 0;
 	sv.datagram.data = sv.datagram_buf;
@@ -1140,6 +1947,7 @@ void SV_SpawnServer (char *server)
 // clear world interaction links
 //
 	SV_ClearWorld ();
+	SV_WakeAllEdicts ();
 	
 	sv.sound_precache[0] = pr_strings;
 
@@ -1498,6 +1498,84 @@ void SV_Physics_Step (edict_t *ent)
 
 //============================================================================
 
+/*
+===============================================================================
+
+AWAKE EDICTS
+
+Free edicts and MOVETYPE_NONE edicts that have nothing to think are put to
+sleep by SV_Physics, which then skips them without reading them until they
+are woken.  Progs wake an edict whenever they take the address of one of
+its fields to store into it, and ED_Alloc wakes the edicts it hands out,
+so the only way a sleeping edict changes is through a wake.
+
+===============================================================================
+*/
+
+cvar_t	sv_activeedicts = {"sv_activeedicts", "1"};
+
+static	unsigned	sv_awake[(MAX_EDICTS+31)>>5];	// a bit for each awake edict
+
+/*
+================
+SV_WakeEdict
+================
+*/
+void SV_WakeEdict (edict_t *ent)
+{
+	int		e;
+
+	e = NUM_FOR_EDICT(ent);
+	sv_awake[e>>5] |= 1u << (e&31);
+	ent->asleep = false;
+}
+
+/*
+================
+SV_WakeAllEdicts
+
+Called when edicts have been written behind the progs' back, by a new map
+or a loaded game
+================
+*/
+void SV_WakeAllEdicts (void)
+{
+	int		i;
+
+	memset (sv_awake, 0xff, sizeof(sv_awake));
+	for (i=0 ; i<sv.max_edicts ; i++)
+		EDICT_NUM(i)->asleep = false;
+}
+
+/*
+================
+SV_SleepEdict
+================
+*/
+void SV_SleepEdict (edict_t *ent, int e)
+{
+	sv_awake[e>>5] &= ~(1u << (e&31));
+	ent->asleep = true;
+}
+
+/*
+================
+SV_NumAwakeEdicts
+================
+*/
+int SV_NumAwakeEdicts (void)
+{
+	int		i, count;
+
+	count = 0;
+	for (i=0 ; i<sv.num_edicts ; i++)
+		if (sv_awake[i>>5] & (1u << (i&31)))
+			count++;
+	return count;
+}
+
+//============================================================================
+
 /*
 ================
 SV_Physics
@@ -1507,8 +1585,11 @@ SV_Physics
 void SV_Physics (void)
 {
 	int		i;
+	unsigned	bits;
 	edict_t	*ent;
 
+	SV_InvalidateTraces ();
+
 // let the progs know that a new frame has started
 	pr_global_struct->self = EDICT_TO_PROG(sv.edicts);
 	pr_global_struct->other = EDICT_TO_PROG(sv.edicts);
@@ -1520,11 +1601,26 @@ void SV_Physics (void)
 //
 // treat each object in turn
 //
-	ent = sv.edicts;
-	for (i=0 ; i<sv.num_edicts ; i++, ent = NEXT_EDICT(ent))
+	for (i=0 ; i<sv.num_edicts ; i++)
 	{
+		if (sv_activeedicts.value && !pr_global_struct->force_retouch)
+		{
+			bits = sv_awake[i>>5] >> (i&31);
+			if (!(bits & 1))
+			{
+				if (!bits)
+					i |= 31;	// the rest of this word is asleep
+				continue;
+			}
+		}
+
+		ent = EDICT_NUM(i);
 		if (ent->free)
+		{
+			if (i > svs.maxclients && !ent->asleep)
+				SV_SleepEdict (ent, i);
 			continue;
+		}
 
 		if (pr_global_struct->force_retouch)
 		{
@@ -1555,6 +1651,10 @@ void SV_Physics (void)
 			SV_Physics_Toss (ent);
 		else
 			Sys_Error ("SV_Physics: bad movetype %i", (int)ent->v.movetype);			
+
+		if (i > svs.maxclients && !ent->asleep
+		&& (ent->free || (ent->v.movetype == MOVETYPE_NONE && ent->v.nextthink <= 0)))
+			SV_SleepEdict (ent, i);
 	}
 	
 	if (pr_global_struct->force_retouch)
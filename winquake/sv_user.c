@@ -584,6 +584,10 @@ nextmsg:
 			case clc_move:
 				SV_ReadClientMove (&host_client->cmd);
 				break;
+
+			case clc_delta:
+				host_client->snapshotack = MSG_ReadLong ();
+				break;
 			}
 		}
 	} while (ret == 1);
@@ -38,6 +38,10 @@ void Sys_mkdir (char *path);
 void Sys_FileSync (int handle);
 void Sys_File_gets (int handle, char *buf, int len);
 
+// returns the first length bytes of the file mapped read only, or NULL if
+// the port can't map files.  The mapping stays until exit
+void *Sys_FileMap (int handle, int length);
+
 //
 // memory protection
 //
@@ -83,3 +87,37 @@ void Sys_LowFPPrecision (void);
 void Sys_HighFPPrecision (void);
 void Sys_SetFPCW (void);
 
+//
+// worker threads
+//
+
+// renderer state that every worker thread needs its own copy of
+#ifdef WINQUAKE_THREADS
+#define	THREADLOCAL	__thread
+#else
+#define	THREADLOCAL
+#endif
+
+// for counters and stamps shared threads touch without a lock
+#ifdef WINQUAKE_THREADS
+#define	THREADSAFE_INC(x)	__atomic_fetch_add (&(x), 1, __ATOMIC_RELAXED)
+#define	THREADSAFE_SET(x,v)	__atomic_store_n (&(x), (v), __ATOMIC_RELAXED)
+#else
+#define	THREADSAFE_INC(x)	((x)++)
+#define	THREADSAFE_SET(x,v)	((x) = (v))
+#endif
+
+typedef void (*workfunc_t) (int job, void *arg);
+
+int Sys_NumWorkers (void);
+// number of threads Sys_RunWorkers spreads the jobs over, 1 without threads
+
+void Sys_RunWorkers (int numjobs, workfunc_t func, void *arg);
+// calls func for every job 0..numjobs-1 on the workers and the calling
+// thread, and returns once all of them are done; not reentrant
+
+void *Sys_LockCreate (void);
+void Sys_LockShared (void *lock);
+void Sys_LockExclusive (void *lock);
+void Sys_Unlock (void *lock);
+// readers/writer lock around data the workers share
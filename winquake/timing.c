@@ -0,0 +1,137 @@
+/*
+Copyright (C) 1996-1997 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// timing.c -- the loop behind the developer timing commands
+
+#include "quakedef.h"
+
+#if idtiming
+
+/*
+============
+Timing_Count
+============
+*/
+int Timing_Count (int arg, int defcount)
+{
+	int		count;
+
+	count = Cmd_Argc () > arg ? Q_atoi (Cmd_Argv (arg)) : defcount;
+	if (count < 1)
+		count = 1;
+	return count;
+}
+
+/*
+============
+Timing_Server
+============
+*/
+qboolean Timing_Server (void)
+{
+	if (!sv.active)
+	{
+		Con_Printf ("Not running a server\n");
+		return false;
+	}
+	return true;
+}
+
+/*
+============
+Timing_SaveCvar
+============
+*/
+static void Timing_SaveCvar (char *name, char *saved, int size)
+{
+	Q_strncpy (saved, Cvar_VariableString (name), size - 1);
+	saved[size - 1] = 0;
+}
+
+/*
+============
+Timing_Run
+============
+*/
+void Timing_Run (timing_t *t, int count)
+{
+	char	saved[32], savedoff[32];
+	int		pass, i, diffs;
+	double	start;
+
+	if (t->cvar)
+		Timing_SaveCvar (t->cvar, saved, sizeof(saved));
+	if (t->off)
+	{
+		Timing_SaveCvar (t->off, savedoff, sizeof(savedoff));
+		Cvar_SetValue (t->off, 0);
+	}
+
+	t->diffs = 0;
+	for (pass=0 ; pass<t->numpasses ; pass++)
+	{
+		if (t->cvar)
+			Cvar_SetValue (t->cvar, t->values[pass]);
+		if (t->begin)
+			t->begin (pass);
+
+		start = Sys_FloatTime ();
+		for (i=0 ; i<count ; i++)
+		{
+			diffs = t->run (pass, !i);
+			if (pass)
+				t->diffs += diffs;
+		}
+		t->time[pass] = Sys_FloatTime () - start;
+	}
+
+	if (t->cvar)
+		Cvar_Set (t->cvar, saved);
+	if (t->off)
+		Cvar_Set (t->off, savedoff);
+}
+
+/*
+============
+Timing_Print
+============
+*/
+void Timing_Print (timing_t *t, int items)
+{
+	int		pass;
+
+	if (items < 1)
+		items = 1;
+	for (pass=0 ; pass<t->numpasses ; pass++)
+	{
+		if (t->time[0] < items * 1e-6)
+			Con_Printf ("%-10s %8.2f ms  %8.2f ns per %s", t->names[pass],
+				t->time[pass] * 1000, t->time[pass] * 1e9 / items, t->unit);
+		else
+			Con_Printf ("%-10s %8.2f ms  %8.2f us per %s", t->names[pass],
+				t->time[pass] * 1000, t->time[pass] * 1e6 / items, t->unit);
+		if (pass)
+			Con_Printf ("  %.2fx", t->time[pass] ? t->time[0] / t->time[pass] : 0);
+		Con_Printf ("\n");
+	}
+	if (t->results && t->numpasses > 1)
+		Con_Printf ("%i %s differ\n", t->diffs, t->results);
+}
+
+#endif
@@ -0,0 +1,61 @@
+/*
+Copyright (C) 1996-1997 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// timing.h -- timing the same work done different ways, for the developer
+// commands that are only built with idtiming
+
+#if idtiming
+
+#define	MAX_TIMING_PASSES	3
+
+typedef struct
+{
+	int		numpasses;
+	char	*names[MAX_TIMING_PASSES];	// the first pass is the reference
+	char	*cvar;						// set to values[pass] for each pass
+	float	values[MAX_TIMING_PASSES];
+	char	*off;						// held at 0 for every pass
+	char	*unit;						// what the times are given per
+	char	*results;					// what the passes are checked on
+
+	void	(*begin) (int pass);
+	int		(*run) (int pass, qboolean check);
+// runs one round of the work.  On the first round of the first pass, check
+// is set and the results are kept; on the first round of the others, it
+// is set and the return is how many results differ from the kept ones.
+
+	double	time[MAX_TIMING_PASSES];	// filled in by Timing_Run
+	int		diffs;
+} timing_t;
+
+int Timing_Count (int arg, int defcount);
+// Cmd_Argv(arg) if it is given, otherwise defcount, and at least 1
+
+qboolean Timing_Server (void);
+// false, with a message, if there is no server to time
+
+void Timing_Run (timing_t *t, int count);
+// runs count rounds of every pass, each with its cvar set through
+// Cvar_Set, and sets the cvars back afterwards
+
+void Timing_Print (timing_t *t, int items);
+// prints the time of each pass per item, against the first pass, and
+// how many results differed
+
+#endif
@@ -56,6 +56,10 @@ HULL BOXES
 static	hull_t		box_hull;
 static	dclipnode_t	box_clipnodes[6];
 static	mplane_t	box_planes[6];
+static	short		box_children[6][2];
+static	float		box_dist[6];
+static	vec3_t		box_normal[6];
+static	byte		box_type[6];
 
 /*
 ===================
@@ -74,6 +78,10 @@ void SV_InitBoxHull (void)
 	box_hull.planes = box_planes;
 	box_hull.firstclipnode = 0;
 	box_hull.lastclipnode = 5;
+	box_hull.node_children = box_children;
+	box_hull.node_dist = box_dist;
+	box_hull.node_normal = box_normal;
+	box_hull.node_type = box_type;
 
 	for (i=0 ; i<6 ; i++)
 	{
@@ -89,6 +97,11 @@ void SV_InitBoxHull (void)
 		
 		box_planes[i].type = i>>1;
 		box_planes[i].normal[i>>1] = 1;
+
+		box_children[i][0] = box_clipnodes[i].children[0];
+		box_children[i][1] = box_clipnodes[i].children[1];
+		box_type[i] = box_planes[i].type;
+		box_normal[i][i>>1] = 1;
 	}
 	
 }
@@ -111,6 +124,13 @@ hull_t	*SV_HullForBox (vec3_t mins, vec3_t maxs)
 	box_planes[4].dist = maxs[2];
 	box_planes[5].dist = mins[2];
 
+	box_dist[0] = maxs[0];
+	box_dist[1] = mins[0];
+	box_dist[2] = maxs[1];
+	box_dist[3] = mins[1];
+	box_dist[4] = maxs[2];
+	box_dist[5] = mins[2];
+
 	return &box_hull;
 }
 
@@ -173,6 +193,74 @@ hull_t *SV_HullForEntity (edict_t *ent, vec3_t mins, vec3_t maxs, vec3_t offset)
 /*
 ===============================================================================
 
+TRACE CACHE
+
+With sv_tracecache set, SV_Move remembers its recent traces and hands back
+the same trace when asked for the exact same move again.  Every link and
+unlink throws every remembered trace away, and so does the start of each
+server frame and any progs store into an entity field that a trace reads,
+so progs that move an edict or change its solid or owner without relinking
+it still see fresh traces.  The owner of passedict is part of the key.
+
+===============================================================================
+*/
+
+#define	TRACE_CACHE		64		// power of two
+
+typedef struct
+{
+	unsigned	frame;			// sv_traceframe when remembered
+	unsigned	key[12];		// start, end, mins and maxs, bit for bit
+	int			type;
+	edict_t		*passedict;
+	int			owner;			// passedict->v.owner
+	trace_t		trace;
+} cachedtrace_t;
+
+cvar_t	sv_tracecache = {"sv_tracecache", "0"};
+
+byte	sv_tracefields[sizeof(entvars_t)/4];	// set for the fields SV_Move reads
+
+static	cachedtrace_t	sv_traces[TRACE_CACHE];
+static	unsigned		sv_traceframe;
+static	int				sv_tracehits, sv_tracemisses, sv_traceflushes;
+
+/*
+===============
+SV_InvalidateTraces
+
+Forgets every remembered trace
+===============
+*/
+void SV_InvalidateTraces (void)
+{
+	sv_traceflushes++;
+	if (++sv_traceframe)
+		return;
+
+	memset (sv_traces, 0, sizeof(sv_traces));
+	sv_traceframe = 1;
+}
+
+/*
+===============
+SV_TraceStats_f
+===============
+*/
+void SV_TraceStats_f (void)
+{
+	int		total;
+
+	total = sv_tracehits + sv_tracemisses;
+	Con_Printf ("trace cache %s, %i entries\n", sv_tracecache.value ? "on" : "off", TRACE_CACHE);
+	Con_Printf ("%i hits, %i misses, %.1f%% hit rate\n", sv_tracehits, sv_tracemisses,
+		total ? sv_tracehits * 100.0 / total : 0);
+	Con_Printf ("%i flushes\n", sv_traceflushes);
+}
+
+/*
+===============================================================================
+
 ENTITY AREA CHECKING
 
 ===============================================================================
@@ -193,6 +281,33 @@ typedef struct areanode_s
 static	areanode_t	sv_areanodes[AREA_NODES];
 static	int			sv_numareanodes;
 
+/*
+With sv_areagrid set, solid edicts are kept in a loose grid over the x and y
+extent of the world instead of on the area nodes.  An edict is filed in the
+cell holding the corner of its absmin, and anything wider than a cell goes on
+a separate list.  The area node an edict would have been linked to and the
+order it was linked in are still recorded, and the edicts found in the grid
+are clipped against in that same order, so every trace comes out exactly as
+it would from the area nodes.  Triggers always stay on the area nodes.
+*/
+#define	AREA_GRID		32		// most cells along each axis
+#define	AREA_MINCELL	128
+
+cvar_t	sv_areagrid = {"sv_areagrid", "1"};
+
+static	qboolean	sv_usegrid;
+static	link_t		sv_gridcells[AREA_GRID*AREA_GRID];
+static	link_t		sv_gridlarge;		// edicts wider than a cell
+static	int			sv_gridsize[2];
+static	float		sv_gridmins[2];
+static	float		sv_gridcell, sv_gridscale;
+static	unsigned	sv_areaseq;
+
+static	edict_t		*sv_gridtouch[MAX_EDICTS];
+
+static	unsigned	*sv_pvsblocks;		// [sv_numpvsblocks][PVS_EDICTWORDS]
+static	int			sv_numpvsblocks;
+
 /*
 ===============
 SV_CreateAreaNode
@@ -238,6 +353,22 @@ areanode_t *SV_CreateAreaNode (int depth, vec3_t mins, vec3_t maxs)
 	return anode;
 }
 
+/*
+===============
+SV_MarkTraceField
+
+Marks count words of the entvars starting at field as read by SV_Move
+===============
+*/
+static void SV_MarkTraceField (entvars_t *v, void *field, int count)
+{
+	int		ofs;
+
+	ofs = (int *)field - (int *)v;
+	while (count--)
+		sv_tracefields[ofs++] = 1;
+}
+
 /*
 ===============
 SV_ClearWorld
@@ -246,11 +377,187 @@ SV_ClearWorld
 */
 void SV_ClearWorld (void)
 {
+	int		i;
+	float	size;
+	entvars_t	*v;
+
 	SV_InitBoxHull ();
 	
 	memset (sv_areanodes, 0, sizeof(sv_areanodes));
 	sv_numareanodes = 0;
 	SV_CreateAreaNode (0, sv.worldmodel->mins, sv.worldmodel->maxs);
+
+	size = 0;
+	for (i=0 ; i<2 ; i++)
+	{
+		sv_gridmins[i] = sv.worldmodel->mins[i];
+		if (sv.worldmodel->maxs[i] - sv.worldmodel->mins[i] > size)
+			size = sv.worldmodel->maxs[i] - sv.worldmodel->mins[i];
+	}
+	sv_gridcell = size / AREA_GRID;
+	if (sv_gridcell < AREA_MINCELL)
+		sv_gridcell = AREA_MINCELL;
+	sv_gridscale = 1.0 / sv_gridcell;
+	for (i=0 ; i<2 ; i++)
+	{
+		sv_gridsize[i] = (sv.worldmodel->maxs[i] - sv.worldmodel->mins[i]) * sv_gridscale + 1;
+		if (sv_gridsize[i] > AREA_GRID)
+			sv_gridsize[i] = AREA_GRID;
+	}
+	for (i=0 ; i<AREA_GRID*AREA_GRID ; i++)
+		ClearLink (&sv_gridcells[i]);
+	ClearLink (&sv_gridlarge);
+
+	sv_usegrid = sv_areagrid.value != 0;
+	sv_areaseq = 0;
+
+	memset (sv_traces, 0, sizeof(sv_traces));
+	sv_traceframe = 1;
+	sv_tracehits = sv_tracemisses = sv_traceflushes = 0;
+
+	v = &sv.edicts->v;
+	memset (sv_tracefields, 0, sizeof(sv_tracefields));
+	SV_MarkTraceField (v, v->origin, 3);
+	SV_MarkTraceField (v, v->mins, 3);
+	SV_MarkTraceField (v, v->maxs, 3);
+	SV_MarkTraceField (v, v->absmin, 3);
+	SV_MarkTraceField (v, v->absmax, 3);
+	SV_MarkTraceField (v, &v->solid, 1);
+	SV_MarkTraceField (v, &v->owner, 1);
+	SV_MarkTraceField (v, &v->flags, 1);
+	SV_MarkTraceField (v, &v->modelindex, 1);
+
+	sv_numpvsblocks = (sv.worldmodel->numleafs+31)>>5;
+	sv_pvsblocks = Hunk_AllocName (sv_numpvsblocks*PVS_EDICTWORDS*sizeof(unsigned), "pvsindex");
+}
+
+/*
+===============
+SV_GridCell
+
+Cell coordinate of v along axis, clamped to the grid
+===============
+*/
+static int SV_GridCell (float v, int axis)
+{
+	v = (v - sv_gridmins[axis]) * sv_gridscale;
+	if (!(v >= 0))
+		return 0;
+	if (v >= sv_gridsize[axis])
+		return sv_gridsize[axis] - 1;
+	return (int)v;
+}
+
+/*
+===============
+SV_AreaLink
+
+Links a solid edict into the grid or onto its area node
+===============
+*/
+static void SV_AreaLink (edict_t *ent)
+{
+	if (!sv_usegrid)
+		InsertLinkBefore (&ent->area, &sv_areanodes[ent->areanode].solid_edicts);
+	else if (ent->v.absmax[0] - ent->v.absmin[0] > sv_gridcell
+	|| ent->v.absmax[1] - ent->v.absmin[1] > sv_gridcell)
+		InsertLinkBefore (&ent->area, &sv_gridlarge);
+	else
+		InsertLinkBefore (&ent->area, &sv_gridcells[SV_GridCell (ent->v.absmin[1], 1) * AREA_GRID
+			+ SV_GridCell (ent->v.absmin[0], 0)]);
+}
+
+/*
+===============
+SV_AreaOrder
+
+Sorts edicts into the order SV_ClipToLinks visits them: by area node, and
+in link order within a node
+===============
+*/
+static int SV_AreaOrder (const void *a, const void *b)
+{
+	edict_t	*ea, *eb;
+
+	ea = *(edict_t **)a;
+	eb = *(edict_t **)b;
+	if (ea->areanode != eb->areanode)
+		return ea->areanode - eb->areanode;
+	if (ea->areaseq != eb->areaseq)
+		return ea->areaseq < eb->areaseq ? -1 : 1;
+	return 0;
+}
+
+/*
+===============
+SV_LinkOrder
+
+Sorts edicts into the order they were linked in
+===============
+*/
+static int SV_LinkOrder (const void *a, const void *b)
+{
+	edict_t	*ea, *eb;
+
+	ea = *(edict_t **)a;
+	eb = *(edict_t **)b;
+	if (ea->areaseq != eb->areaseq)
+		return ea->areaseq < eb->areaseq ? -1 : 1;
+	return 0;
+}
+
+/*
+===============
+SV_TakeLinks
+
+Empties list onto sv_gridtouch from count on, and returns the new count
+===============
+*/
+static int SV_TakeLinks (link_t *list, int count)
+{
+	link_t	*l;
+
+	for (l = list->next ; l != list ; l = l->next)
+		sv_gridtouch[count++] = EDICT_FROM_AREA(l);
+	ClearLink (list);
+
+	return count;
+}
+
+/*
+===============
+SV_RelinkSolids
+
+Moves every solid edict into the grid or back onto the area nodes, keeping
+the order they were linked in.  Also renumbers that order before
+sv_areaseq can wrap.
+===============
+*/
+static void SV_RelinkSolids (qboolean grid)
+{
+	int		i, count;
+
+	count = 0;
+	if (sv_usegrid)
+	{
+		for (i=0 ; i<AREA_GRID*AREA_GRID ; i++)
+			count = SV_TakeLinks (&sv_gridcells[i], count);
+		count = SV_TakeLinks (&sv_gridlarge, count);
+	}
+	else
+	{
+		for (i=0 ; i<sv_numareanodes ; i++)
+			count = SV_TakeLinks (&sv_areanodes[i].solid_edicts, count);
+	}
+	qsort (sv_gridtouch, count, sizeof(sv_gridtouch[0]), SV_LinkOrder);
+
+	sv_usegrid = grid;
+	for (i=0 ; i<count ; i++)
+	{
+		sv_gridtouch[i]->areaseq = i;
+		SV_AreaLink (sv_gridtouch[i]);
+	}
+	sv_areaseq = count;
 }
 
 
@@ -266,6 +573,7 @@ void SV_UnlinkEdict (edict_t *ent)
 		return;		// not linked in anywhere
 	RemoveLink (&ent->area);
 	ent->area.prev = ent->area.next = NULL;
+	SV_InvalidateTraces ();
 }
 
 
@@ -319,6 +627,69 @@ void SV_TouchLinks ( edict_t *ent, areanode_t *node )
 }
 
 
+/*
+===============================================================================
+
+PVS EDICT INDEX
+
+The leafs are split into blocks of 32, one for each word of a PVS row, and
+each block has a bit for every edict that touches one of its leafs.  The
+edicts a PVS might show are then the union of the blocks it has any bit
+set in, which saves looking at every edict's leafs for every client.
+
+===============================================================================
+*/
+
+/*
+===============
+SV_IndexEdictLeafs
+
+Sets or clears the edict's bit in the blocks of its leafs
+===============
+*/
+void SV_IndexEdictLeafs (edict_t *ent, qboolean set)
+{
+	int			i, e;
+	unsigned	*word, bit;
+
+	e = NUM_FOR_EDICT(ent);
+	bit = 1u << (e&31);
+	for (i=0 ; i<ent->num_leafs ; i++)
+	{
+		word = sv_pvsblocks + (ent->leafnums[i]>>5)*PVS_EDICTWORDS + (e>>5);
+		if (set)
+			*word |= bit;
+		else
+			*word &= ~bit;
+	}
+}
+
+/*
+===============
+SV_PVSEdicts
+
+Sets a bit in edicts for every edict that touches a leaf in a block pvs
+has any bit set in.  Some of them can still be out of the PVS, so the
+caller checks each one's leafs.  pvs must be word aligned.
+===============
+*/
+void SV_PVSEdicts (byte *pvs, unsigned *edicts)
+{
+	unsigned	*words, *block;
+	int			i, j;
+
+	memset (edicts, 0, PVS_EDICTWORDS*sizeof(unsigned));
+	words = (unsigned *)pvs;
+	block = sv_pvsblocks;
+	for (i=0 ; i<sv_numpvsblocks ; i++, block += PVS_EDICTWORDS)
+	{
+		if (!words[i])
+			continue;
+		for (j=0 ; j<PVS_EDICTWORDS ; j++)
+			edicts[j] |= block[j];
+	}
+}
+
 /*
 ===============
 SV_FindTouchedLeafs
@@ -373,6 +744,8 @@ void SV_LinkEdict (edict_t *ent, qboolean touch_triggers)
 {
 	areanode_t	*node;
 
+	SV_InvalidateTraces ();
+
 	if (ent->area.prev)
 		SV_UnlinkEdict (ent);	// unlink from old position
 		
@@ -437,9 +810,11 @@ void SV_LinkEdict (edict_t *ent, qboolean touch_triggers)
 	}
 	
 // link to PVS leafs
+	SV_IndexEdictLeafs (ent, false);
 	ent->num_leafs = 0;
 	if (ent->v.modelindex)
 		SV_FindTouchedLeafs (ent, sv.worldmodel->nodes);
+	SV_IndexEdictLeafs (ent, true);
 
 	if (ent->v.solid == SOLID_NOT)
 		return;
@@ -460,10 +835,15 @@ void SV_LinkEdict (edict_t *ent, qboolean touch_triggers)
 	
 // link it in	
 
+	ent->areanode = node - sv_areanodes;
+	if (sv_areaseq >= 0x7fffff00)
+		SV_RelinkSolids (sv_usegrid);
+	ent->areaseq = sv_areaseq++;
+
 	if (ent->v.solid == SOLID_TRIGGER)
 		InsertLinkBefore (&ent->area, &node->trigger_edicts);
 	else
-		InsertLinkBefore (&ent->area, &node->solid_edicts);
+		SV_AreaLink (ent);
 	
 // if touch_triggers, touch all entities at this node and decend for more
 	if (touch_triggers)
@@ -711,6 +1091,202 @@ qboolean SV_RecursiveHullCheck (hull_t *hull, int num, float p1f, float p2f, vec
 }
 
 
+/*
+==================
+SV_HullContents
+
+SV_HullPointContents on the flattened clipnodes
+==================
+*/
+static int SV_HullContents (hull_t *hull, int num, vec3_t p)
+{
+	float	d;
+	int		type;
+
+	while (num >= 0)
+	{
+		if (num < hull->firstclipnode || num > hull->lastclipnode)
+			Sys_Error ("SV_HullContents: bad node number");
+
+		type = hull->node_type[num];
+		if (type < 3)
+			d = p[type] - hull->node_dist[num];
+		else
+			d = DotProduct (hull->node_normal[num], p) - hull->node_dist[num];
+		num = hull->node_children[num][d < 0];
+	}
+
+	return num;
+}
+
+#define	HULL_STACK	64
+
+typedef struct
+{
+	int			num, side;
+	float		p1f, p2f, midf, frac;
+	vec3_t		p1, p2, mid;
+} hullframe_t;
+
+cvar_t	sv_iterativehull = {"sv_iterativehull", "0"};
+
+/*
+==================
+SV_HullCheck
+
+SV_RecursiveHullCheck as a loop over the flattened clipnodes.  Each node
+the line crosses is pushed while the near side is traced, and popped to
+go past it or find the impact, which gives exactly the same trace.
+==================
+*/
+static qboolean SV_HullCheck (hull_t *hull, int num, float p1f, float p2f, vec3_t p1, vec3_t p2, trace_t *trace)
+{
+	hullframe_t	stack[HULL_STACK], *f;
+	int			sp, i, side, type;
+	float		t1, t2, frac, midf, dist;
+	float		*normal;
+	vec3_t		start, end;
+
+	VectorCopy (p1, start);
+	VectorCopy (p2, end);
+	sp = 0;
+
+	while (1)
+	{
+	// walk down to a leaf, keeping every node the line crosses
+		while (num >= 0)
+		{
+			if (num < hull->firstclipnode || num > hull->lastclipnode)
+				Sys_Error ("SV_HullCheck: bad node number");
+
+			type = hull->node_type[num];
+			dist = hull->node_dist[num];
+			if (type < 3)
+			{
+				t1 = start[type] - dist;
+				t2 = end[type] - dist;
+			}
+			else
+			{
+				normal = hull->node_normal[num];
+				t1 = DotProduct (normal, start) - dist;
+				t2 = DotProduct (normal, end) - dist;
+			}
+
+			if (t1 >= 0 && t2 >= 0)
+			{
+				num = hull->node_children[num][0];
+				continue;
+			}
+			if (t1 < 0 && t2 < 0)
+			{
+				num = hull->node_children[num][1];
+				continue;
+			}
+
+			if (sp == HULL_STACK)
+			{	// deeper than any real map, so finish this part the old way
+				if (!SV_RecursiveHullCheck (hull, num, p1f, p2f, start, end, trace))
+					return false;
+				goto pastnode;
+			}
+
+		// put the crosspoint DIST_EPSILON pixels on the near side
+			if (t1 < 0)
+				frac = (t1 + DIST_EPSILON)/(t1-t2);
+			else
+				frac = (t1 - DIST_EPSILON)/(t1-t2);
+			if (frac < 0)
+				frac = 0;
+			if (frac > 1)
+				frac = 1;
+
+			f = &stack[sp++];
+			f->num = num;
+			f->side = side = (t1 < 0);
+			f->p1f = p1f;
+			f->p2f = p2f;
+			f->frac = frac;
+			f->midf = midf = p1f + (p2f - p1f)*frac;
+			for (i=0 ; i<3 ; i++)
+				f->mid[i] = start[i] + frac*(end[i] - start[i]);
+			VectorCopy (start, f->p1);
+			VectorCopy (end, f->p2);
+
+		// move up to the node
+			num = hull->node_children[num][side];
+			p2f = midf;
+			VectorCopy (f->mid, end);
+		}
+
+	// check for empty
+		if (num != CONTENTS_SOLID)
+		{
+			trace->allsolid = false;
+			if (num == CONTENTS_EMPTY)
+				trace->inopen = true;
+			else
+				trace->inwater = true;
+		}
+		else
+			trace->startsolid = true;
+
+pastnode:
+		if (!sp)
+			return true;
+		f = &stack[--sp];
+		num = hull->node_children[f->num][f->side^1];
+
+		if (SV_HullContents (hull, num, f->mid) != CONTENTS_SOLID)
+		{	// go past the node
+			p1f = f->midf;
+			p2f = f->p2f;
+			VectorCopy (f->mid, start);
+			VectorCopy (f->p2, end);
+			continue;
+		}
+
+		if (trace->allsolid)
+			return false;		// never got out of the solid area
+
+	// the other side of the node is solid, this is the impact point
+		if (!f->side)
+		{
+			VectorCopy (hull->node_normal[f->num], trace->plane.normal);
+			trace->plane.dist = hull->node_dist[f->num];
+		}
+		else
+		{
+			VectorSubtract (vec3_origin, hull->node_normal[f->num], trace->plane.normal);
+			trace->plane.dist = -hull->node_dist[f->num];
+		}
+
+		frac = f->frac;
+		midf = f->midf;
+		while (SV_HullContents (hull, hull->firstclipnode, f->mid)
+		== CONTENTS_SOLID)
+		{ // shouldn't really happen, but does occasionally
+			frac -= 0.1;
+			if (frac < 0)
+			{
+				trace->fraction = midf;
+				VectorCopy (f->mid, trace->endpos);
+				Con_DPrintf ("backup past 0\n");
+				return false;
+			}
+			midf = f->p1f + (f->p2f - f->p1f)*frac;
+			for (i=0 ; i<3 ; i++)
+				f->mid[i] = f->p1[i] + frac*(f->p2[i] - f->p1[i]);
+		}
+
+		trace->fraction = midf;
+		VectorCopy (f->mid, trace->endpos);
+
+		return false;
+	}
+}
+
+
 /*
 ==================
 SV_ClipMoveToEntity
@@ -762,7 +1338,10 @@ trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t max
 #endif
 
 // trace a line through the apropriate clipping hull
-	SV_RecursiveHullCheck (hull, hull->firstclipnode, 0, 1, start_l, end_l, &trace);
+	if (sv_iterativehull.value)
+		SV_HullCheck (hull, hull->firstclipnode, 0, 1, start_l, end_l, &trace);
+	else
+		SV_RecursiveHullCheck (hull, hull->firstclipnode, 0, 1, start_l, end_l, &trace);
 
 #ifdef QUAKE2
 	// rotate endpos back to world frame of reference
@@ -804,6 +1383,71 @@ trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t max
 
 //===========================================================================
 
+/*
+====================
+SV_ClipToEdict
+
+Returns false once the move is all in solid and nothing else can change it
+====================
+*/
+static qboolean SV_ClipToEdict ( edict_t *touch, moveclip_t *clip )
+{
+	trace_t		trace;
+
+	if (touch->v.solid == SOLID_NOT)
+		return true;
+	if (touch == clip->passedict)
+		return true;
+	if (touch->v.solid == SOLID_TRIGGER)
+		Sys_Error ("Trigger in clipping list");
+
+	if (clip->type == MOVE_NOMONSTERS && touch->v.solid != SOLID_BSP)
+		return true;
+
+	if (clip->boxmins[0] > touch->v.absmax[0]
+	|| clip->boxmins[1] > touch->v.absmax[1]
+	|| clip->boxmins[2] > touch->v.absmax[2]
+	|| clip->boxmaxs[0] < touch->v.absmin[0]
+	|| clip->boxmaxs[1] < touch->v.absmin[1]
+	|| clip->boxmaxs[2] < touch->v.absmin[2] )
+		return true;
+
+	if (clip->passedict && clip->passedict->v.size[0] && !touch->v.size[0])
+		return true;	// points never interact
+
+// might intersect, so do an exact clip
+	if (clip->trace.allsolid)
+		return false;
+	if (clip->passedict)
+	{
+	 	if (PROG_TO_EDICT(touch->v.owner) == clip->passedict)
+			return true;	// don't clip against own missiles
+		if (PROG_TO_EDICT(clip->passedict->v.owner) == touch)
+			return true;	// don't clip against owner
+	}
+
+	if ((int)touch->v.flags & FL_MONSTER)
+		trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins2, clip->maxs2, clip->end);
+	else
+		trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins, clip->maxs, clip->end);
+	if (trace.allsolid || trace.startsolid ||
+	trace.fraction < clip->trace.fraction)
+	{
+		trace.ent = touch;
+	 	if (clip->trace.startsolid)
+		{
+			clip->trace = trace;
+			clip->trace.startsolid = true;
+		}
+		else
+			clip->trace = trace;
+	}
+	else if (trace.startsolid)
+		clip->trace.startsolid = true;
+
+	return true;
+}
+
 /*
 ====================
 SV_ClipToLinks
@@ -814,24 +1458,42 @@ Mins and maxs enclose the entire area swept by the move
 void SV_ClipToLinks ( areanode_t *node, moveclip_t *clip )
 {
 	link_t		*l, *next;
-	edict_t		*touch;
-	trace_t		trace;
 
 // touch linked edicts
 	for (l = node->solid_edicts.next ; l != &node->solid_edicts ; l = next)
 	{
 		next = l->next;
-		touch = EDICT_FROM_AREA(l);
-		if (touch->v.solid == SOLID_NOT)
-			continue;
-		if (touch == clip->passedict)
-			continue;
-		if (touch->v.solid == SOLID_TRIGGER)
-			Sys_Error ("Trigger in clipping list");
+		if (!SV_ClipToEdict (EDICT_FROM_AREA(l), clip))
+			return;
+	}
+	
+// recurse down both sides
+	if (node->axis == -1)
+		return;
 
-		if (clip->type == MOVE_NOMONSTERS && touch->v.solid != SOLID_BSP)
-			continue;
+	if ( clip->boxmaxs[node->axis] > node->dist )
+		SV_ClipToLinks ( node->children[0], clip );
+	if ( clip->boxmins[node->axis] < node->dist )
+		SV_ClipToLinks ( node->children[1], clip );
+}
+
+
+/*
+====================
+SV_GatherGrid
 
+Adds the edicts on list whose boxes meet the move to sv_gridtouch from
+count on, and returns the new count
+====================
+*/
+static int SV_GatherGrid ( link_t *list, moveclip_t *clip, int count )
+{
+	link_t		*l;
+	edict_t		*touch;
+
+	for (l = list->next ; l != list ; l = l->next)
+	{
+		touch = EDICT_FROM_AREA(l);
 		if (clip->boxmins[0] > touch->v.absmax[0]
 		|| clip->boxmins[1] > touch->v.absmax[1]
 		|| clip->boxmins[2] > touch->v.absmax[2]
@@ -839,52 +1501,51 @@ void SV_ClipToLinks ( areanode_t *node, moveclip_t *clip )
 		|| clip->boxmaxs[1] < touch->v.absmin[1]
 		|| clip->boxmaxs[2] < touch->v.absmin[2] )
 			continue;
+		sv_gridtouch[count++] = touch;
+	}
 
-		if (clip->passedict && clip->passedict->v.size[0] && !touch->v.size[0])
-			continue;	// points never interact
+	return count;
+}
 
-	// might intersect, so do an exact clip
-		if (clip->trace.allsolid)
-			return;
-		if (clip->passedict)
-		{
-		 	if (PROG_TO_EDICT(touch->v.owner) == clip->passedict)
-				continue;	// don't clip against own missiles
-			if (PROG_TO_EDICT(clip->passedict->v.owner) == touch)
-				continue;	// don't clip against owner
-		}
+/*
+====================
+SV_ClipToGrid
 
-		if ((int)touch->v.flags & FL_MONSTER)
-			trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins2, clip->maxs2, clip->end);
-		else
-			trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins, clip->maxs, clip->end);
-		if (trace.allsolid || trace.startsolid ||
-		trace.fraction < clip->trace.fraction)
-		{
-			trace.ent = touch;
-		 	if (clip->trace.startsolid)
-			{
-				clip->trace = trace;
-				clip->trace.startsolid = true;
-			}
-			else
-				clip->trace = trace;
-		}
-		else if (trace.startsolid)
-			clip->trace.startsolid = true;
+Gathers the solid edicts whose boxes meet the move from the grid cells it
+can reach, then clips against them in the order SV_ClipToLinks would
+====================
+*/
+static void SV_ClipToGrid ( moveclip_t *clip )
+{
+	int			x, y, x0, x1, y0, y1;
+	int			i, j, count;
+	edict_t		*touch;
+
+// an edict sits in the cell of its absmin and is at most a cell wide
+	x0 = SV_GridCell (clip->boxmins[0] - sv_gridcell, 0);
+	x1 = SV_GridCell (clip->boxmaxs[0], 0);
+	y0 = SV_GridCell (clip->boxmins[1] - sv_gridcell, 1);
+	y1 = SV_GridCell (clip->boxmaxs[1], 1);
+
+	count = SV_GatherGrid (&sv_gridlarge, clip, 0);
+	for (y=y0 ; y<=y1 ; y++)
+		for (x=x0 ; x<=x1 ; x++)
+			count = SV_GatherGrid (&sv_gridcells[y*AREA_GRID + x], clip, count);
+
+// usually only a handful, so an insertion sort beats qsort
+	for (i=1 ; i<count ; i++)
+	{
+		touch = sv_gridtouch[i];
+		for (j=i ; j>0 && SV_AreaOrder (&touch, &sv_gridtouch[j-1]) < 0 ; j--)
+			sv_gridtouch[j] = sv_gridtouch[j-1];
+		sv_gridtouch[j] = touch;
 	}
-	
-// recurse down both sides
-	if (node->axis == -1)
-		return;
 
-	if ( clip->boxmaxs[node->axis] > node->dist )
-		SV_ClipToLinks ( node->children[0], clip );
-	if ( clip->boxmins[node->axis] < node->dist )
-		SV_ClipToLinks ( node->children[1], clip );
+	for (i=0 ; i<count ; i++)
+		if (!SV_ClipToEdict (sv_gridtouch[i], clip))
+			return;
 }
 
-
 /*
 ==================
 SV_MoveBounds
@@ -924,6 +1585,34 @@ trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, e
 {
 	moveclip_t	clip;
 	int			i;
+	unsigned	key[12], hash;
+	int			owner;
+	cachedtrace_t	*cached;
+
+	cached = NULL;
+	owner = 0;
+	if (sv_tracecache.value)
+	{
+		memcpy (key, start, 12);
+		memcpy (key + 3, end, 12);
+		memcpy (key + 6, mins, 12);
+		memcpy (key + 9, maxs, 12);
+
+		owner = passedict ? passedict->v.owner : 0;
+		hash = type + (unsigned)((byte *)passedict - (byte *)sv.edicts) + owner * 31;
+		for (i=0 ; i<12 ; i++)
+			hash = (hash ^ key[i]) * 16777619;
+		cached = &sv_traces[(hash ^ (hash >> 16)) & (TRACE_CACHE-1)];
+
+		if (cached->frame == sv_traceframe && cached->type == type
+		&& cached->passedict == passedict && cached->owner == owner
+		&& !memcmp (cached->key, key, sizeof(key)))
+		{
+			sv_tracehits++;
+			return cached->trace;
+		}
+		sv_tracemisses++;
+	}
 
 	memset ( &clip, 0, sizeof ( moveclip_t ) );
 
@@ -955,8 +1644,219 @@ trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, e
 	SV_MoveBounds ( start, clip.mins2, clip.maxs2, end, clip.boxmins, clip.boxmaxs );
 
 // clip to entities
-	SV_ClipToLinks ( sv_areanodes, &clip );
+	if (sv_usegrid != (sv_areagrid.value != 0))
+		SV_RelinkSolids (sv_areagrid.value != 0);
+	if (sv_usegrid)
+		SV_ClipToGrid (&clip);
+	else
+		SV_ClipToLinks ( sv_areanodes, &clip );
+
+	if (cached)
+	{
+		cached->frame = sv_traceframe;
+		memcpy (cached->key, key, sizeof(key));
+		cached->type = type;
+		cached->passedict = passedict;
+		cached->owner = owner;
+		cached->trace = clip.trace;
+	}
 
 	return clip.trace;
 }
 
+
+#if idtiming
+static trace_t	*time_traces;
+static int		time_solids;
+
+/*
+==================
+SV_TimeMoveBegin
+==================
+*/
+static void SV_TimeMoveBegin (int pass)
+{
+	SV_RelinkSolids (pass);
+}
+
+/*
+==================
+SV_TimeMoveRun
+
+Moves every solid edict a little way along its own direction
+==================
+*/
+static int SV_TimeMoveRun (int pass, qboolean check)
+{
+	edict_t		*ent;
+	trace_t		trace;
+	vec3_t		end;
+	int			i, diffs;
+	float		angle;
+
+	diffs = 0;
+	for (i=1 ; i<sv.num_edicts ; i++)
+	{
+		ent = EDICT_NUM(i);
+		if (ent->free || ent->v.solid == SOLID_NOT || ent->v.solid == SOLID_TRIGGER)
+			continue;
+
+		angle = i * 0.7;
+		end[0] = ent->v.origin[0] + 64 * cos(angle);
+		end[1] = ent->v.origin[1] + 64 * sin(angle);
+		end[2] = ent->v.origin[2] - 16;
+		trace = SV_Move (ent->v.origin, ent->v.mins, ent->v.maxs, end,
+			ent->v.movetype == MOVETYPE_FLYMISSILE ? MOVE_MISSILE : MOVE_NORMAL, ent);
+
+		if (!check)
+			continue;
+		if (!pass)
+		{
+			time_traces[i] = trace;
+			time_solids++;
+		}
+		else if (trace.allsolid != time_traces[i].allsolid
+		|| trace.startsolid != time_traces[i].startsolid
+		|| trace.inopen != time_traces[i].inopen
+		|| trace.inwater != time_traces[i].inwater
+		|| trace.fraction != time_traces[i].fraction
+		|| !VectorCompare (trace.endpos, time_traces[i].endpos)
+		|| !VectorCompare (trace.plane.normal, time_traces[i].plane.normal)
+		|| trace.plane.dist != time_traces[i].plane.dist
+		|| trace.ent != time_traces[i].ent)
+			diffs++;
+	}
+	return diffs;
+}
+
+/*
+==================
+SV_TimeMove_f
+
+timemove [count]
+Moves every solid edict with the solid edicts on the area nodes and then
+in the grid, and checks that the two give the same traces
+==================
+*/
+void SV_TimeMove_f (void)
+{
+	timing_t	t;
+	int			count;
+
+	if (!Timing_Server ())
+		return;
+	count = Timing_Count (1, 10);
+
+	time_traces = Hunk_TempAlloc (sv.num_edicts * sizeof(trace_t));
+	time_solids = 0;
+
+	memset (&t, 0, sizeof(t));
+	t.numpasses = 2;
+	t.names[0] = "area nodes";
+	t.names[1] = "grid";
+	t.cvar = "sv_areagrid";
+	t.values[0] = 0;
+	t.values[1] = 1;
+	t.off = "sv_tracecache";
+	t.unit = "move";
+	t.results = "traces";
+	t.begin = SV_TimeMoveBegin;
+	t.run = SV_TimeMoveRun;
+	Timing_Run (&t, count);
+
+	Con_Printf ("%i solid edicts, %i moves\n", time_solids, time_solids * count);
+	Timing_Print (&t, time_solids * count);
+}
+
+static vec3_t	*time_lines;
+static trace_t	*time_hulltraces;
+static int		time_numlines;
+
+/*
+==================
+SV_TimeHullRun
+
+Traces the lines through the world's clipping hulls with
+SV_RecursiveHullCheck or SV_HullCheck
+==================
+*/
+static int SV_TimeHullRun (int pass, qboolean check)
+{
+	trace_t		trace;
+	hull_t		*hull;
+	int			i, diffs;
+
+	diffs = 0;
+	for (i=0 ; i<time_numlines ; i++)
+	{
+		hull = &sv.worldmodel->hulls[i % 3];
+		memset (&trace, 0, sizeof(trace_t));
+		trace.fraction = 1;
+		trace.allsolid = true;
+		VectorCopy (time_lines[i*2+1], trace.endpos);
+
+		if (!pass)
+			SV_RecursiveHullCheck (hull, hull->firstclipnode, 0, 1, time_lines[i*2], time_lines[i*2+1], &trace);
+		else
+			SV_HullCheck (hull, hull->firstclipnode, 0, 1, time_lines[i*2], time_lines[i*2+1], &trace);
+
+		if (!check)
+			continue;
+		if (!pass)
+			time_hulltraces[i] = trace;
+		else if (memcmp (&trace, &time_hulltraces[i], sizeof(trace_t)))
+			diffs++;
+	}
+	return diffs;
+}
+
+/*
+==================
+SV_TimeHull_f
+
+timehull [count]
+Traces the same short and long lines between random points in the world
+both ways, and checks that the two agree
+==================
+*/
+void SV_TimeHull_f (void)
+{
+	timing_t	t;
+	int			i, j, hits;
+	unsigned	seed;
+
+	if (!Timing_Server ())
+		return;
+	time_numlines = Timing_Count (1, 10000);
+
+	time_lines = Hunk_TempAlloc (time_numlines * (2*sizeof(vec3_t) + sizeof(trace_t)));
+	time_hulltraces = (trace_t *)(time_lines + time_numlines*2);
+
+	seed = 1;
+	for (i=0 ; i<time_numlines*2 ; i++)
+		for (j=0 ; j<3 ; j++)
+		{
+			seed = seed * 1103515245 + 12345;
+			time_lines[i][j] = sv.worldmodel->mins[j] + (sv.worldmodel->maxs[j]
+				- sv.worldmodel->mins[j]) * ((seed >> 8) & 0xffff) / 65535.0;
+			if ((i & 1) && (i & 2))
+				time_lines[i][j] = time_lines[i-1][j] + (time_lines[i][j] - time_lines[i-1][j]) * 0.125;
+		}
+
+	memset (&t, 0, sizeof(t));
+	t.numpasses = 2;
+	t.names[0] = "recursive";
+	t.names[1] = "iterative";
+	t.unit = "line";
+	t.results = "traces";
+	t.run = SV_TimeHullRun;
+	Timing_Run (&t, 1);
+
+	hits = 0;
+	for (i=0 ; i<time_numlines ; i++)
+		if (time_hulltraces[i].fraction < 1)
+			hits++;
+	Con_Printf ("%i lines, %i hit something\n", time_numlines, hits);
+	Timing_Print (&t, time_numlines);
+}
+#endif
@@ -64,6 +64,29 @@ int SV_TruePointContents (vec3_t p);
 
 edict_t	*SV_TestEntityPosition (edict_t *ent);
 
+#if idtiming
+void SV_TimeMove_f (void);
+// times SV_Move against the area nodes and the grid
+void SV_TimeHull_f (void);
+// times SV_HullCheck against SV_RecursiveHullCheck
+#endif
+
+void SV_InvalidateTraces (void);
+// forgets the traces SV_Move has remembered, called at the start of
+// every server frame, on every link and unlink, and when progs store
+// into a field SV_TRACEFIELD marks
+
+extern	byte	sv_tracefields[];
+#define	SV_TRACEFIELD(ofs)	((unsigned)(ofs) < sizeof(entvars_t)/4 && sv_tracefields[ofs])
+
+#define	PVS_EDICTWORDS	((MAX_EDICTS+31)>>5)
+
+void SV_PVSEdicts (byte *pvs, unsigned *edicts);
+// sets a bit in edicts[PVS_EDICTWORDS] for every edict that might be in
+// the word aligned pvs
+
+void SV_TraceStats_f (void);
+
 trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict);
 // mins and maxs are reletive
 
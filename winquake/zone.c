@@ -551,9 +551,19 @@ void *Hunk_TempAlloc (int size)
 
 CACHE MEMORY
 
+Blocks are kept in address order between the low and high hunk marks.  The
+free space after each block, up to the next one, is its gap; blocks with a
+gap are also kept on a list per power of two gap size, so an allocation
+doesn't have to walk every block to find room.  The space below the first
+block and above the last one moves with the hunk marks, so it is never on
+a gap list.
+
 ===============================================================================
 */
 
+#define	CACHE_MINCLASS		64		// smallest gap of size class 1
+#define	NUM_CACHE_CLASSES	24
+
 typedef struct cache_system_s
 {
 	int						size;		// including this header
@@ -561,11 +571,21 @@ typedef struct cache_system_s
 	char					name[16];
 	struct cache_system_s	*prev, *next;
 	struct cache_system_s	*lru_prev, *lru_next;	// for LRU flushing	
+	int						gap;		// free bytes up to next, 0 for the last
+	struct cache_system_s	*gap_prev, *gap_next;	// NULL if not on a gap list
 } cache_system_t;
 
 cache_system_t *Cache_TryAlloc (int size, qboolean nobottom);
 
 cache_system_t	cache_head;
+cache_system_t	cache_gaps[NUM_CACHE_CLASSES];	// heads of the gap lists
+
+qboolean		cache_linearsearch;	// first fit walk, for cachereplay
+
+static void Cache_FreeBlock (cache_system_t *cs);
+static void Cache_Record (char *event);
+static int Cache_RecordUser (cache_user_t *c);
+static int		cache_recordhandle = -1;
 
 /*
 ===========
@@ -585,14 +605,14 @@ void Cache_Move ( cache_system_t *c)
 		Q_memcpy ( new+1, c+1, c->size - sizeof(cache_system_t) );
 		new->user = c->user;
 		Q_memcpy (new->name, c->name, sizeof(new->name));
-		Cache_Free (c->user);
+		Cache_FreeBlock (c);
 		new->user->data = (void *)(new+1);
 	}
 	else
 	{
 //		Con_Printf ("cache_move failed\n");
 
-		Cache_Free (c->user);		// tough luck...
+		Cache_FreeBlock (c);		// tough luck...
 	}
 }
 
@@ -607,6 +627,9 @@ void Cache_FreeLow (int new_low_hunk)
 {
 	cache_system_t	*c;
 	
+	if (cache_recordhandle >= 0)
+		Cache_Record (va("l %i\n", new_low_hunk));
+
 	while (1)
 	{
 		c = cache_head.next;
@@ -629,6 +652,9 @@ void Cache_FreeHigh (int new_high_hunk)
 {
 	cache_system_t	*c, *prev;
 	
+	if (cache_recordhandle >= 0)
+		Cache_Record (va("h %i\n", new_high_hunk));
+
 	prev = NULL;
 	while (1)
 	{
@@ -638,7 +664,7 @@ void Cache_FreeHigh (int new_high_hunk)
 		if ( (byte *)c + c->size <= hunk_base + hunk_size - new_high_hunk)
 			return;		// there is space to grow the hunk
 		if (c == prev)
-			Cache_Free (c->user);	// didn't move out of the way
+			Cache_FreeBlock (c);	// didn't move out of the way
 		else
 		{
 			Cache_Move (c);	// try to move it
@@ -669,6 +695,139 @@ void Cache_MakeLRU (cache_system_t *cs)
 	cache_head.lru_next = cs;
 }
 
+static int Cache_SizeClass (int size)
+{
+	int		sizeclass;
+
+	sizeclass = 0;
+	while (size >= (CACHE_MINCLASS << 1) << sizeclass
+		&& sizeclass < NUM_CACHE_CLASSES - 1)
+		sizeclass++;
+
+	return sizeclass;
+}
+
+static void Cache_UnlinkGap (cache_system_t *cs)
+{
+	if (!cs->gap_next)
+		return;
+
+	cs->gap_next->gap_prev = cs->gap_prev;
+	cs->gap_prev->gap_next = cs->gap_next;
+
+	cs->gap_prev = cs->gap_next = NULL;
+}
+
+static void Cache_LinkGap (cache_system_t *cs)
+{
+	cache_system_t	*head;
+
+	if (cs->next == &cache_head || cs->gap <= 0)
+		return;
+
+	head = &cache_gaps[Cache_SizeClass (cs->gap)];
+	head->gap_next->gap_prev = cs;
+	cs->gap_next = head->gap_next;
+	cs->gap_prev = head;
+	head->gap_next = cs;
+}
+
+/*
+============
+Cache_SetGap
+
+Recomputes the gap after cs, which must not be the head
+============
+*/
+static void Cache_SetGap (cache_system_t *cs)
+{
+	Cache_UnlinkGap (cs);
+
+	if (cs->next == &cache_head)
+		cs->gap = 0;
+	else
+		cs->gap = (byte *)cs->next - ((byte *)cs + cs->size);
+
+	Cache_LinkGap (cs);
+}
+
+/*
+============
+Cache_Place
+
+Makes a block of size bytes at new, after prev in the block list
+============
+*/
+static cache_system_t *Cache_Place (cache_system_t *new, int size,
+	cache_system_t *prev)
+{
+	memset (new, 0, sizeof(*new));
+	new->size = size;
+
+	new->next = prev->next;
+	new->prev = prev;
+	prev->next->prev = new;
+	prev->next = new;
+
+	if (prev != &cache_head)
+		Cache_SetGap (prev);
+	Cache_SetGap (new);
+
+	Cache_MakeLRU (new);
+	return new;
+}
+
+/*
+============
+Cache_GapFits
+
+True if size bytes fit in the gap after cs, above the low hunk mark
+============
+*/
+static qboolean Cache_GapFits (cache_system_t *cs, int size)
+{
+	if (cs->gap < size)
+		return false;
+
+// the low mark has already been raised when Cache_FreeLow moves blocks
+// out from under it
+	return (byte *)cs + cs->size >= hunk_base + hunk_low_used;
+}
+
+/*
+============
+Cache_FindGap
+
+First fit in the smallest size class that can hold size, the first block
+of a larger class that is above the low mark is big enough
+============
+*/
+static cache_system_t *Cache_FindGap (int size)
+{
+	int				sizeclass;
+	cache_system_t	*cs, *head;
+
+	if (cache_linearsearch)
+	{
+	// the original bottom up walk
+		for (cs = cache_head.next ; cs != &cache_head ; cs = cs->next)
+			if (Cache_GapFits (cs, size))
+				return cs;
+		return NULL;
+	}
+
+	for (sizeclass = Cache_SizeClass (size) ; sizeclass < NUM_CACHE_CLASSES
+		; sizeclass++)
+	{
+		head = &cache_gaps[sizeclass];
+		for (cs = head->gap_next ; cs != head ; cs = cs->gap_next)
+			if (Cache_GapFits (cs, size))
+				return cs;
+	}
+
+	return NULL;
+}
+
 /*
 ============
 Cache_TryAlloc
@@ -679,72 +838,39 @@ Size should already include the header and padding
 */
 cache_system_t *Cache_TryAlloc (int size, qboolean nobottom)
 {
-	cache_system_t	*cs, *new;
+	cache_system_t	*cs;
+	byte			*bottom, *top;
+
+	bottom = hunk_base + hunk_low_used;
+	top = hunk_base + hunk_size - hunk_high_used;
 	
 // is the cache completely empty?
 
 	if (!nobottom && cache_head.prev == &cache_head)
 	{
-		if (hunk_size - hunk_high_used - hunk_low_used < size)
+		if (top - bottom < size)
 			Sys_Error ("Cache_TryAlloc: %i is greater then free hunk", size);
 
-		new = (cache_system_t *) (hunk_base + hunk_low_used);
-		memset (new, 0, sizeof(*new));
-		new->size = size;
-
-		cache_head.prev = cache_head.next = new;
-		new->prev = new->next = &cache_head;
-		
-		Cache_MakeLRU (new);
-		return new;
+		return Cache_Place ((cache_system_t *)bottom, size, &cache_head);
 	}
 	
-// search from the bottom up for space
+// below the first block
 
-	new = (cache_system_t *) (hunk_base + hunk_low_used);
-	cs = cache_head.next;
-	
-	do
-	{
-		if (!nobottom || cs != cache_head.next)
-		{
-			if ( (byte *)cs - (byte *)new >= size)
-			{	// found space
-				memset (new, 0, sizeof(*new));
-				new->size = size;
-				
-				new->next = cs;
-				new->prev = cs->prev;
-				cs->prev->next = new;
-				cs->prev = new;
-				
-				Cache_MakeLRU (new);
-	
-				return new;
-			}
-		}
+	if (!nobottom && (byte *)cache_head.next - bottom >= size)
+		return Cache_Place ((cache_system_t *)bottom, size, &cache_head);
 
-	// continue looking		
-		new = (cache_system_t *)((byte *)cs + cs->size);
-		cs = cs->next;
+// between two blocks
 
-	} while (cs != &cache_head);
+	cs = Cache_FindGap (size);
+	if (cs)
+		return Cache_Place ((cache_system_t *)((byte *)cs + cs->size), size, cs);
 	
 // try to allocate one at the very end
-	if ( hunk_base + hunk_size - hunk_high_used - (byte *)new >= size)
-	{
-		memset (new, 0, sizeof(*new));
-		new->size = size;
-		
-		new->next = &cache_head;
-		new->prev = cache_head.prev;
-		cache_head.prev->next = new;
-		cache_head.prev = new;
-		
-		Cache_MakeLRU (new);
-
-		return new;
-	}
+	cs = cache_head.prev;
+	if (cs != &cache_head)
+		bottom = (byte *)cs + cs->size;
+	if (top - bottom >= size)
+		return Cache_Place ((cache_system_t *)bottom, size, cs);
 	
 	return NULL;		// couldn't allocate
 }
@@ -758,8 +884,11 @@ Throw everything out, so new data will be demand cached
 */
 void Cache_Flush (void)
 {
+	if (cache_recordhandle >= 0)
+		Cache_Record ("x\n");
+
 	while (cache_head.next != &cache_head)
-		Cache_Free ( cache_head.next->user );	// reclaim the space
+		Cache_FreeBlock (cache_head.next);	// reclaim the space
 }
 
 
@@ -802,43 +931,82 @@ void Cache_Compact (void)
 
 /*
 ============
-Cache_Init
+Cache_Clear
 
+Empties the block, LRU and gap lists without touching the blocks
 ============
 */
-void Cache_Init (void)
+static void Cache_Clear (void)
 {
+	int		i;
+
 	cache_head.next = cache_head.prev = &cache_head;
 	cache_head.lru_next = cache_head.lru_prev = &cache_head;
 
+	for (i=0 ; i<NUM_CACHE_CLASSES ; i++)
+		cache_gaps[i].gap_next = cache_gaps[i].gap_prev = &cache_gaps[i];
+}
+
+void Cache_Record_f (void);
+void Cache_Replay_f (void);
+
+/*
+============
+Cache_Init
+
+============
+*/
+void Cache_Init (void)
+{
+	Cache_Clear ();
+
 	Cmd_AddCommand ("flush", Cache_Flush);
+	Cmd_AddCommand ("cacherecord", Cache_Record_f);
+	Cmd_AddCommand ("cachereplay", Cache_Replay_f);
 }
 
 /*
 ==============
-Cache_Free
+Cache_FreeBlock
 
 Frees the memory and removes it from the LRU list
 ==============
 */
-void Cache_Free (cache_user_t *c)
+static void Cache_FreeBlock (cache_system_t *cs)
 {
-	cache_system_t	*cs;
+	cache_system_t	*prev;
 
-	if (!c->data)
-		Sys_Error ("Cache_Free: not allocated");
-
-	cs = ((cache_system_t *)c->data) - 1;
+	Cache_UnlinkGap (cs);
 
+	prev = cs->prev;
 	cs->prev->next = cs->next;
 	cs->next->prev = cs->prev;
 	cs->next = cs->prev = NULL;
 
-	c->data = NULL;
+	if (prev != &cache_head)
+		Cache_SetGap (prev);
+
+	cs->user->data = NULL;
 
 	Cache_UnlinkLRU (cs);
 }
 
+/*
+==============
+Cache_Free
+==============
+*/
+void Cache_Free (cache_user_t *c)
+{
+	if (!c->data)
+		Sys_Error ("Cache_Free: not allocated");
+
+	if (cache_recordhandle >= 0)
+		Cache_Record (va("f %i\n", Cache_RecordUser (c)));
+
+	Cache_FreeBlock (((cache_system_t *)c->data) - 1);
+}
+
 
 
 /*
@@ -850,6 +1018,9 @@ void *Cache_Check (cache_user_t *c)
 {
 	cache_system_t	*cs;
 
+	if (cache_recordhandle >= 0)
+		Cache_Record (va("c %i\n", Cache_RecordUser (c)));
+
 	if (!c->data)
 		return NULL;
 
@@ -878,6 +1049,10 @@ void *Cache_Alloc (cache_user_t *c, int size, char *name)
 	if (size <= 0)
 		Sys_Error ("Cache_Alloc: size %i", size);
 
+	if (cache_recordhandle >= 0)
+		Cache_Record (va("a %i %i %i %i\n", Cache_RecordUser (c), size,
+			hunk_low_used, hunk_high_used));
+
 	size = (size + sizeof(cache_system_t) + 15) & ~15;
 
 // find memory for it	
@@ -896,10 +1071,303 @@ void *Cache_Alloc (cache_user_t *c, int size, char *name)
 		if (cache_head.lru_prev == &cache_head)
 			Sys_Error ("Cache_Alloc: out of memory");
 													// not enough memory at all
-		Cache_Free ( cache_head.lru_prev->user );
+		Cache_FreeBlock (cache_head.lru_prev);
 	} 
 	
-	return Cache_Check (c);
+// the new block is already at the head of the LRU
+	return c->data;
+}
+
+/*
+===============================================================================
+
+CACHE RECORDING
+
+cacherecord <file> writes every Cache_* call to <gamedir>/<file> until
+cacherecord is given without a file.  cachereplay <file> plays the calls
+back on a scratch copy of the cache, once with the gap lists and once
+with the original first fit walk, and prints how long each took.
+
+===============================================================================
+*/
+
+#define	MAX_RECORD_USERS	8192
+
+static cache_user_t	*cache_recordusers[MAX_RECORD_USERS];
+
+static void Cache_Record (char *event)
+{
+	Sys_FileWrite (cache_recordhandle, event, Q_strlen (event));
+}
+
+/*
+==============
+Cache_RecordUser
+
+Numbers the cache users in the order they show up
+==============
+*/
+static int Cache_RecordUser (cache_user_t *c)
+{
+	int		i, start;
+
+	i = start = ((intptr_t)c >> 4) & (MAX_RECORD_USERS - 1);
+	do
+	{
+		if (cache_recordusers[i] == c)
+			return i;
+		if (!cache_recordusers[i])
+		{
+			cache_recordusers[i] = c;
+			return i;
+		}
+		i = (i + 1) & (MAX_RECORD_USERS - 1);
+	} while (i != start);
+
+	Sys_Error ("Cache_RecordUser: more than %i users", MAX_RECORD_USERS);
+	return 0;
+}
+
+/*
+==============
+Cache_Record_f
+==============
+*/
+void Cache_Record_f (void)
+{
+	char	name[MAX_OSPATH];
+
+	if (cache_recordhandle >= 0)
+	{
+		Sys_FileClose (cache_recordhandle);
+		cache_recordhandle = -1;
+		Con_Printf ("cache recording stopped\n");
+	}
+
+	if (Cmd_Argc () != 2)
+		return;
+
+	sprintf (name, "%s/%s", com_gamedir, Cmd_Argv(1));
+	cache_recordhandle = Sys_FileOpenWrite (name);
+	if (cache_recordhandle < 0)
+	{
+		Con_Printf ("ERROR: couldn't open %s.\n", name);
+		return;
+	}
+
+// start from an empty cache, so the replay sees every block allocated
+	memset (cache_recordusers, 0, sizeof(cache_recordusers));
+	Cache_Record (va("s %i\n", hunk_size));
+	Cache_Flush ();
+
+	Con_Printf ("recording cache calls to %s\n", name);
+}
+
+typedef struct
+{
+	int		op;
+	int		user, size, low, high;
+} cacheevent_t;
+
+/*
+==============
+Cache_Replay
+
+Returns the number of calls that didn't apply, because the replay evicted
+something else than the recording did
+==============
+*/
+static int Cache_Replay (cacheevent_t *events, int numevents,
+	cache_user_t *users, int shift)
+{
+	int				i, skipped;
+	cacheevent_t	*ev;
+
+	skipped = 0;
+	for (i=0, ev=events ; i<numevents ; i++, ev++)
+	{
+		switch (ev->op)
+		{
+		case 'a':
+			hunk_low_used = ev->low - shift;
+			hunk_high_used = ev->high;
+			if (users[ev->user].data)
+				skipped++;
+			else
+				Cache_Alloc (&users[ev->user], ev->size, "replay");
+			break;
+		case 'f':
+			if (users[ev->user].data)
+				Cache_Free (&users[ev->user]);
+			else
+				skipped++;
+			break;
+		case 'c':
+			Cache_Check (&users[ev->user]);
+			break;
+		case 'x':
+			Cache_Flush ();
+			break;
+		case 'l':
+			hunk_low_used = ev->low - shift;
+			Cache_FreeLow (hunk_low_used);
+			break;
+		case 'h':
+			hunk_high_used = ev->high;
+			Cache_FreeHigh (hunk_high_used);
+			break;
+		}
+	}
+
+	Cache_Flush ();
+	return skipped;
+}
+
+/*
+==============
+Cache_Replay_f
+==============
+*/
+void Cache_Replay_f (void)
+{
+	char			*data;
+	cacheevent_t	*events, *ev;
+	cache_user_t	*users;
+	int				i, numevents, recsize, minlow, arenasize, shift, skipped;
+	int				mark;
+	double			time;
+	cache_system_t	savehead, savegaps[NUM_CACHE_CLASSES];
+	byte			*savebase;
+	int				savesize, savelow, savehigh;
+
+	if (Cmd_Argc () != 2)
+	{
+		Con_Printf ("cachereplay <file> : time a cacherecord file\n");
+		return;
+	}
+	if (cache_recordhandle >= 0)
+	{
+		Con_Printf ("can't replay while recording\n");
+		return;
+	}
+
+	mark = Hunk_LowMark ();
+	data = (char *)COM_LoadHunkFile (Cmd_Argv(1));
+	if (!data)
+	{
+		Con_Printf ("couldn't load %s\n", Cmd_Argv(1));
+		return;
+	}
+
+// one event per line
+	numevents = 0;
+	for (i=0 ; data[i] ; i++)
+		if (data[i] == '\n')
+			numevents++;
+	events = Hunk_AllocName (numevents * sizeof(*events), "cacheevt");
+
+	recsize = hunk_size;
+	minlow = recsize;
+	for (ev=events, i=0 ; i<numevents ; )
+	{
+		data = COM_Parse (data);
+		if (!data)
+			break;
+
+		memset (ev, 0, sizeof(*ev));
+		ev->op = com_token[0];
+		switch (ev->op)
+		{
+		case 's':
+			data = COM_Parse (data);
+			recsize = Q_atoi (com_token);
+			continue;
+		case 'a':
+			data = COM_Parse (data);
+			ev->user = Q_atoi (com_token);
+			data = COM_Parse (data);
+			ev->size = Q_atoi (com_token);
+			data = COM_Parse (data);
+			ev->low = Q_atoi (com_token);
+			data = COM_Parse (data);
+			ev->high = Q_atoi (com_token);
+			break;
+		case 'f':
+		case 'c':
+			data = COM_Parse (data);
+			ev->user = Q_atoi (com_token);
+			break;
+		case 'l':
+			data = COM_Parse (data);
+			ev->low = Q_atoi (com_token);
+			break;
+		case 'h':
+			data = COM_Parse (data);
+			ev->high = Q_atoi (com_token);
+			break;
+		case 'x':
+			break;
+		default:
+			Con_Printf ("bad cache event %s\n", com_token);
+			Hunk_FreeToLowMark (mark);
+			return;
+		}
+		if ((ev->op == 'a' || ev->op == 'l') && ev->low < minlow)
+			minlow = ev->low;
+		if (ev->user < 0 || ev->user >= MAX_RECORD_USERS)
+			ev->user = 0;
+		ev++;
+		i++;
+	}
+	numevents = i;
+
+	users = Hunk_AllocName (MAX_RECORD_USERS * sizeof(*users), "cacheusr");
+
+// the scratch hunk only has to hold what was above the lowest low mark
+	arenasize = recsize - minlow;
+	if (arenasize > hunk_size - hunk_low_used - hunk_high_used - 0x10000)
+	{
+		Con_Printf ("not enough hunk to replay, try a larger -mem\n");
+		Hunk_FreeToLowMark (mark);
+		return;
+	}
+	shift = recsize - arenasize;
+
+	savehead = cache_head;
+	memcpy (savegaps, cache_gaps, sizeof(savegaps));
+	savebase = hunk_base;
+	savesize = hunk_size;
+	savelow = hunk_low_used;
+	savehigh = hunk_high_used;
+
+	hunk_base = Hunk_AllocName (arenasize, "cacherep");
+	hunk_size = arenasize;
+
+	for (i=0 ; i<2 ; i++)
+	{
+		cache_linearsearch = i;
+		hunk_low_used = hunk_high_used = 0;
+		Cache_Clear ();
+		memset (users, 0, MAX_RECORD_USERS * sizeof(*users));
+
+		time = Sys_FloatTime ();
+		skipped = Cache_Replay (events, numevents, users, shift);
+		time = Sys_FloatTime () - time;
+
+		Con_Printf ("%s: %i calls in %.2f ms, %i not replayed\n",
+			i ? "first fit walk" : "gap lists", numevents, time * 1000,
+			skipped);
+	}
+	cache_linearsearch = false;
+
+	cache_head = savehead;
+	memcpy (cache_gaps, savegaps, sizeof(savegaps));
+	hunk_base = savebase;
+	hunk_size = savesize;
+	hunk_low_used = savelow;
+	hunk_high_used = savehigh;
+
+	Hunk_FreeToLowMark (mark);
 }
 
 //============================================================================